@@ -0,0 +1,21 @@
+#ifndef _MIPS_MEMBAR_H_
+#define _MIPS_MEMBAR_H_
+
+/*
+ * Memory barriers, for data shared between cpus (or with user level)
+ * without a lock. Spinlocks don't need these: LL/SC orders what's
+ * done under them. SYNC is a full barrier on MIPS32, so all of these
+ * are the same instruction; the names say what the caller needs.
+ *
+ *    membar_store_store - earlier stores are seen before later ones.
+ *    membar_load_load   - earlier loads are done before later ones.
+ *    membar_any_any     - both, and loads against stores.
+ */
+
+#define membar_any_any() \
+	__asm volatile(".set push; .set mips32; sync; .set pop" ::: "memory")
+#define membar_store_store()	membar_any_any()
+#define membar_load_load()	membar_any_any()
+
+
+#endif /* _MIPS_MEMBAR_H_ */
@@ -39,6 +39,8 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include <proc.h>
+#include "opt-A2.h"
 #include "opt-A3.h"
 
 /* in exception.S */
@@ -188,6 +190,10 @@ mips_trap(struct trapframe *tf)
 			doadjust = false;
 		}
 
+		/* For hardclock's cpu time accounting and profiling */
+		curcpu->c_intr_fromuser = !iskern;
+		curcpu->c_intr_pc = tf->tf_epc;
+
 		mainbus_interrupt(tf);
 
 		if (doadjust) {
@@ -198,6 +204,20 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+#if OPT_A2
+		/*
+		 * A thread whose process is being torn down leaves
+		 * instead of going back to user mode; the timer sees
+		 * to it that one running there comes through here
+		 * soon. Interrupts go back on first, as below.
+		 */
+		if (!iskern && curproc->p_exiting) {
+			spl = splhigh();
+			splx(spl);
+			proc_threadleave();
+		}
+#endif
 		goto done2;
 	}
 
@@ -318,6 +338,13 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+#if OPT_A2
+	/* As for interrupts, above */
+	if (!iskern && curproc->p_exiting) {
+		proc_threadleave();
+	}
+#endif
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -432,3 +459,21 @@ enter_new_process(int argc, userptr_t argv, vaddr_t stack, vaddr_t entry)
 	tf.tf_sp = stack;
 	mips_usermode(&tf);
 }
+
+/*
+ * Enter user mode in a new thread of the current process: call
+ * ENTRY with ARG, on the stack STACK.
+ */
+void
+enter_new_thread(vaddr_t entry, userptr_t arg, vaddr_t stack)
+{
+	struct trapframe tf;
+
+	bzero(&tf, sizeof(tf));
+
+	tf.tf_status = CST_IRQMASK | CST_IEp | CST_KUp;
+	tf.tf_epc = entry;
+	tf.tf_a0 = (vaddr_t)arg;
+	tf.tf_sp = stack;
+	mips_usermode(&tf);
+}
@@ -35,8 +35,251 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <copyinout.h>
+#include <ktrace.h>
 #include "opt-A2.h"
 
+////////////////////////////////////////////////////////////
+//
+// Handlers.
+//
+// Each one unpacks its argument words into the types the sys_*
+// function takes. Calls that don't need the trapframe or don't
+// return a value just ignore those parameters.
+
+static
+int
+sc_reboot(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)retval;
+	return sys_reboot((int)args[0]);
+}
+
+static
+int
+sc___time(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)retval;
+	return sys___time((userptr_t)args[0], (userptr_t)args[1]);
+}
+
+static
+int
+sc_sysstat(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	return sys_sysstat((userptr_t)args[0], (unsigned)args[1],
+			   (int *)retval);
+}
+
+static
+int
+sc_sysbatch(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	return sys_sysbatch((userptr_t)args[0], (int *)retval);
+}
+
+static
+int
+sc_futex(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	return sys_futex((userptr_t)args[0], (int)args[1], (int)args[2],
+			 (int *)retval);
+}
+
+#ifdef UW
+static
+int
+sc_write(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	return sys_write((int)args[0], (userptr_t)args[1],
+			 (unsigned)args[2], (int *)retval);
+}
+
+static
+int
+sc__exit(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)retval;
+	sys__exit((int)args[0]);
+	/* sys__exit does not return, execution should not get here */
+	panic("unexpected return from sys__exit");
+	return 0;
+}
+
+static
+int
+sc_getpid(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)args;
+	return sys_getpid((pid_t *)retval);
+}
+
+static
+int
+sc_waitpid(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	return sys_waitpid((pid_t)args[0], (userptr_t)args[1],
+			   (int)args[2], (pid_t *)retval);
+}
+
+static
+int
+sc_getrusage(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)retval;
+	return sys_getrusage((int)args[0], (userptr_t)args[1]);
+}
+
+static
+int
+sc_setaffinity(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)retval;
+	return sys_setaffinity(args[0]);
+}
+
+static
+int
+sc_getaffinity(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)retval;
+	return sys_getaffinity((userptr_t)args[0]);
+}
+#endif // UW
+
+#if OPT_A2
+static
+int
+sc_fork(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)args;
+	return sys_fork(tf, (pid_t *)retval);
+}
+
+static
+int
+sc_vfork(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)args;
+	return sys_vfork(tf, (pid_t *)retval);
+}
+
+static
+int
+sc_spawn(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	return sys_spawn((userptr_t)args[0], (userptr_t)args[1],
+			 (pid_t *)retval);
+}
+
+static
+int
+sc_execv(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)retval;
+	return sys_execv((userptr_t)args[0], (userptr_t)args[1]);
+}
+
+static
+int
+sc___thread_create(struct trapframe *tf, const uint32_t *args,
+		   int32_t *retval)
+{
+	(void)tf;
+	return sys___thread_create((userptr_t)args[0], (userptr_t)args[1],
+				   (userptr_t)args[2], (int *)retval);
+}
+
+static
+int
+sc_thread_exit(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	(void)retval;
+	sys_thread_exit((int)args[0]);
+	panic("unexpected return from sys_thread_exit");
+	return 0;
+}
+
+static
+int
+sc_thread_join(struct trapframe *tf, const uint32_t *args, int32_t *retval)
+{
+	(void)tf;
+	return sys_thread_join((int)args[0], (userptr_t)args[1],
+			       (int *)retval);
+}
+#endif /* OPT_A2 */
+
+/*
+ * The dispatch table. To add a call, write its sc_ handler and give
+ * it an entry here: name, number of argument words, flags, handler.
+ * Mark it SD_BATCH if sysbatch may run it: it mustn't use the
+ * trapframe, and should be short, since a batch runs all its calls
+ * before going back to user mode.
+ */
+const struct syscall_desc syscall_table[SYS_NCALLS] = {
+	[SYS_reboot] =		{ "reboot", 1, 0, sc_reboot },
+	[SYS___time] =		{ "__time", 2, SD_BATCH, sc___time },
+	[SYS_sysstat] =		{ "sysstat", 2, 0, sc_sysstat },
+	[SYS_sysbatch] =	{ "sysbatch", 1, 0, sc_sysbatch },
+	[SYS_futex] =		{ "futex", 3, 0, sc_futex },
+#ifdef UW
+	[SYS_write] =		{ "write", 3, SD_BATCH, sc_write },
+	[SYS__exit] =		{ "_exit", 1, SD_NORETURN, sc__exit },
+	[SYS_getpid] =		{ "getpid", 0, SD_BATCH, sc_getpid },
+	[SYS_waitpid] =		{ "waitpid", 3, 0, sc_waitpid },
+	[SYS_getrusage] =	{ "getrusage", 2, SD_BATCH, sc_getrusage },
+	[SYS_setaffinity] =	{ "setaffinity", 1, 0, sc_setaffinity },
+	[SYS_getaffinity] =	{ "getaffinity", 1, SD_BATCH, sc_getaffinity },
+#endif // UW
+#if OPT_A2
+	[SYS_fork] =		{ "fork", 0, 0, sc_fork },
+	[SYS_vfork] =		{ "vfork", 0, 0, sc_vfork },
+	[SYS_spawn] =		{ "spawn", 2, 0, sc_spawn },
+	[SYS_execv] =		{ "execv", 2, 0, sc_execv },
+	[SYS___thread_create] =	{ "__thread_create", 3, 0, sc___thread_create },
+	[SYS_thread_exit] =	{ "thread_exit", 1, SD_NORETURN, sc_thread_exit },
+	[SYS_thread_join] =	{ "thread_join", 2, 0, sc_thread_join },
+#endif /* OPT_A2 */
+};
+
+/*
+ * Collect the argument words a call takes: the first four from
+ * a0-a3, any more from the user stack past the four slots reserved
+ * for those.
+ */
+static
+int
+syscall_getargs(struct trapframe *tf, unsigned nargs, uint32_t *args)
+{
+	KASSERT(nargs <= SD_MAXARGS);
+
+	args[0] = tf->tf_a0;
+	args[1] = tf->tf_a1;
+	args[2] = tf->tf_a2;
+	args[3] = tf->tf_a3;
+	if (nargs <= 4) {
+		return 0;
+	}
+	return copyin((const_userptr_t)(tf->tf_sp + 16), &args[4],
+		      (nargs - 4) * sizeof(uint32_t));
+}
+
 /*
  * System call dispatcher.
  *
@@ -74,10 +317,17 @@
  * values) further arguments must be fetched from the user-level
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
+ *
+ * The call number indexes syscall_table, whose entry says how many
+ * argument words to collect (see syscall_getargs) and which handler
+ * gets them. Every call is counted, and timed, per cpu; see
+ * syscallstat.c.
  */
 void
 syscall(struct trapframe *tf)
 {
+	const struct syscall_desc *sd;
+	uint32_t args[SD_MAXARGS];
 	int callno;
 	int32_t retval;
 	int err;
@@ -87,6 +337,7 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	KTRACE(KT_SYSCALL, callno, 0);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -99,54 +350,28 @@ syscall(struct trapframe *tf)
 
 	retval = 0;
 
-	switch (callno) {
-	    case SYS_reboot:
-		err = sys_reboot(tf->tf_a0);
-		break;
-
-	    case SYS___time:
-		err = sys___time((userptr_t)tf->tf_a0,
-				 (userptr_t)tf->tf_a1);
-		break;
-#ifdef UW
-	case SYS_write:
-	  err = sys_write((int)tf->tf_a0,
-			  (userptr_t)tf->tf_a1,
-			  (int)tf->tf_a2,
-			  (int *)(&retval));
-	  break;
-	case SYS__exit:
-	  sys__exit((int)tf->tf_a0);
-	  /* sys__exit does not return, execution should not get here */
-	  panic("unexpected return from sys__exit");
-	  break;
-	case SYS_getpid:
-	  err = sys_getpid((pid_t *)&retval);
-	  break;
-	case SYS_waitpid:
-	  err = sys_waitpid((pid_t)tf->tf_a0,
-			    (userptr_t)tf->tf_a1,
-			    (int)tf->tf_a2,
-			    (pid_t *)&retval);
-	  break;
-#endif // UW
-
-#if OPT_A2
-	case SYS_fork:
-	  err = sys_fork(tf, (pid_t *) &retval); 
-	  break;
-	case SYS_execv:
-	  err = sys_execv((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1); 
-	  break; 
-#endif /* OPT_A2 */
-
-       	  
-	default:
-	  kprintf("Unknown syscall %d\n", callno);
-	  err = ENOSYS;
-	  break;
+	sd = NULL;
+	if (callno >= 0 && callno < SYS_NCALLS &&
+	    syscall_table[callno].sd_call != NULL) {
+		sd = &syscall_table[callno];
 	}
 
+	if (sd == NULL) {
+		kprintf("Unknown syscall %d\n", callno);
+		err = ENOSYS;
+	}
+	else {
+		syscallstat_begin();
+		err = syscall_getargs(tf, sd->sd_nargs, args);
+		if (!err) {
+			if (sd->sd_flags & SD_NORETURN) {
+				/* Count it now; there's no later */
+				syscallstat_end(callno);
+			}
+			err = sd->sd_call(tf, args, &retval);
+		}
+		syscallstat_end(callno);
+	}
 
 	if (err) {
 		/*
@@ -162,6 +387,7 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = retval;
 		tf->tf_a3 = 0;      /* signal no error */
 	}
+	KTRACE(KT_SYSRET, callno, err);
 	
 	/*
 	 * Now, advance the program counter, to avoid restarting
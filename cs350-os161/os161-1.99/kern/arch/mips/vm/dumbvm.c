@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/timepage.h>
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
@@ -37,6 +38,8 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <clock.h>
+#include <ktrace.h>
 #include "opt-A3.h"
 
 /*
@@ -44,7 +47,10 @@
  * enough to struggle off the ground.
  */
 
-/* under dumbvm, always have 48k of user stack */
+/*
+ * under dumbvm, always have 48k of user stack, plus whatever exec
+ * asked for its arguments (as_reserve_stack)
+ */
 #define DUMBVM_STACKPAGES    12
 
 /*
@@ -212,13 +218,25 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	uint32_t ehi, elo;
 	struct addrspace *as;
 	int spl;
+	bool is_timepage = false;
 #if OPT_A3
 	bool read_only = false; 
 #endif
 
+	KTRACE(KT_VMFAULT, faultaddress, faulttype);
+
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
+
+	/* The time page is shared and read-only; see <kern/timepage.h> */
+	if (faultaddress == TIMEPAGE_VADDR) {
+		if (faulttype != VM_FAULT_READ) {
+			return EFAULT;
+		}
+		is_timepage = true;
+	}
+
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
 #if OPT_A3
@@ -282,12 +300,16 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	vtop1 = vbase1 + as->as_npages1 * PAGE_SIZE;
 	vbase2 = as->as_vbase2;
 	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
-	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+	stackbase = USERSTACK - as->as_stackpages * PAGE_SIZE;
 	stacktop = USERSTACK;
+	KASSERT(TIMEPAGE_VADDR < stackbase);
 	
 
 
-	if (faultaddress >= vbase1 && faultaddress < vtop1) {
+	if (is_timepage) {
+		paddr = timepage_kvaddr() - MIPS_KSEG0;
+	}
+	else if (faultaddress >= vbase1 && faultaddress < vtop1) {
 #if OPT_A3	
 		index = (faultaddress - vbase1) / PAGE_SIZE; 
 		//kprintf ("code index %d\n", index); 
@@ -341,6 +363,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 			elo &= ~TLBLO_DIRTY; 
 		}
 #endif
+		if (is_timepage) {
+			elo &= ~TLBLO_DIRTY;
+		}
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
@@ -349,6 +374,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 #if OPT_A3
 	ehi = faultaddress;
 	elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
+	if (is_timepage) {
+		elo &= ~TLBLO_DIRTY;
+	}
 	tlb_random(ehi, elo); 
 	splx(spl);
 	return 0; 
@@ -376,6 +404,7 @@ as_create(void)
 	as->as_pbase2 = NULL;
 	as->as_npages2 = 0;
 	as->as_stackpbase = NULL;
+	as->as_stackpages = DUMBVM_STACKPAGES;
 	as->load_complete = false; 
 
 #else
@@ -386,6 +415,7 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	as->as_stackpages = DUMBVM_STACKPAGES;
 #endif
 	return as;
 }
@@ -404,8 +434,12 @@ as_destroy(struct addrspace *as)
 	}
 	kfree (as->as_pbase2);
 
-	for (int i = 0; i < (int) DUMBVM_STACKPAGES; ++i) {
-		free_kpages(PADDR_TO_KVADDR (as->as_stackpbase[i]));
+	if (as->as_stackpbase != NULL) {
+		for (int i = 0; i < (int) as->as_stackpages; ++i) {
+			if (as->as_stackpbase[i] != 0) {
+				free_kpages(PADDR_TO_KVADDR (as->as_stackpbase[i]));
+			}
+		}
 	}
 	kfree (as->as_stackpbase); 
 #endif
@@ -462,9 +496,6 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 	(void)readable;
 	(void)writeable;
 	(void)executable;
-#if OPT_A3
-	as->as_stackpbase = kmalloc (DUMBVM_STACKPAGES * sizeof (paddr_t));
-#endif	
 	if (as->as_vbase1 == 0) {
 		as->as_vbase1 = vaddr;
 		as->as_npages1 = npages;
@@ -528,15 +559,19 @@ as_prepare_load(struct addrspace *as)
 		//kprintf ("pbase2 loaded %p %d/%d\n", (int *) as->as_pbase2[i], i+1, as->as_npages2); 
 	}
 
-	for (int i = 0; i < (int) DUMBVM_STACKPAGES; ++i) {
+	KASSERT(as->as_stackpbase == NULL);
+	as->as_stackpbase = kmalloc (as->as_stackpages * sizeof (paddr_t));
+	if (as->as_stackpbase == NULL) return ENOMEM;
+	bzero(as->as_stackpbase, as->as_stackpages * sizeof (paddr_t));
+	for (int i = 0; i < (int) as->as_stackpages; ++i) {
 		as->as_stackpbase[i] = getppages(1);
-		//kprintf ("stack loaded %p %d/%d\n", (int *)as->as_stackpbase[i], i+1, DUMBVM_STACKPAGES); 
+		//kprintf ("stack loaded %p %d/%d\n", (int *)as->as_stackpbase[i], i+1, as->as_stackpages); 
 		if ((int *) as->as_stackpbase[i] == NULL) return ENOMEM;
 	}	
 
 	as_zero_region(as->as_pbase1, as->as_npages1);
 	as_zero_region(as->as_pbase2, as->as_npages2);
-	as_zero_region(as->as_stackpbase, DUMBVM_STACKPAGES);
+	as_zero_region(as->as_stackpbase, as->as_stackpages);
 #else
 	KASSERT(as->as_pbase1 == 0);
 	KASSERT(as->as_pbase2 == 0);
@@ -552,14 +587,14 @@ as_prepare_load(struct addrspace *as)
 		return ENOMEM;
 	}
 
-	as->as_stackpbase = getppages(DUMBVM_STACKPAGES);
+	as->as_stackpbase = getppages(as->as_stackpages);
 	if (as->as_stackpbase == 0) {
 		return ENOMEM;
 	}
 	
 	as_zero_region(as->as_pbase1, as->as_npages1);
 	as_zero_region(as->as_pbase2, as->as_npages2);
-	as_zero_region(as->as_stackpbase, DUMBVM_STACKPAGES);
+	as_zero_region(as->as_stackpbase, as->as_stackpages);
 #endif
 	return 0;
 }
@@ -571,6 +606,14 @@ as_complete_load(struct addrspace *as)
 	return 0;
 }
 
+void
+as_reserve_stack(struct addrspace *as, size_t nbytes)
+{
+	KASSERT(as->as_stackpbase == 0);
+
+	as->as_stackpages = DUMBVM_STACKPAGES + DIVROUNDUP(nbytes, PAGE_SIZE);
+}
+
 int
 as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 {
@@ -580,6 +623,51 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_translate(struct addrspace *as, vaddr_t vaddr, paddr_t *ret)
+{
+	vaddr_t page, stackbase;
+	paddr_t paddr;
+	size_t index;
+
+	page = vaddr & PAGE_FRAME;
+	stackbase = USERSTACK - as->as_stackpages * PAGE_SIZE;
+
+	if (as->as_pbase1 != 0 && page >= as->as_vbase1 &&
+	    page < as->as_vbase1 + as->as_npages1 * PAGE_SIZE) {
+		index = (page - as->as_vbase1) / PAGE_SIZE;
+#if OPT_A3
+		paddr = as->as_pbase1[index];
+#else
+		paddr = as->as_pbase1 + index * PAGE_SIZE;
+#endif
+	}
+	else if (as->as_pbase2 != 0 && page >= as->as_vbase2 &&
+		 page < as->as_vbase2 + as->as_npages2 * PAGE_SIZE) {
+		index = (page - as->as_vbase2) / PAGE_SIZE;
+#if OPT_A3
+		paddr = as->as_pbase2[index];
+#else
+		paddr = as->as_pbase2 + index * PAGE_SIZE;
+#endif
+	}
+	else if (as->as_stackpbase != 0 && page >= stackbase &&
+		 page < USERSTACK) {
+		index = (page - stackbase) / PAGE_SIZE;
+#if OPT_A3
+		paddr = as->as_stackpbase[index];
+#else
+		paddr = as->as_stackpbase + index * PAGE_SIZE;
+#endif
+	}
+	else {
+		return EFAULT;
+	}
+
+	*ret = paddr + (vaddr & ~PAGE_FRAME);
+	return 0;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -595,11 +683,11 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	new->as_npages1 = old->as_npages1;
 	new->as_vbase2 = old->as_vbase2;
 	new->as_npages2 = old->as_npages2;
+	new->as_stackpages = old->as_stackpages;
 
 #if OPT_A3
 	new->as_pbase1 = kmalloc (old->as_npages1 * sizeof (paddr_t)); 
 	new->as_pbase2 = kmalloc (old->as_npages2 * sizeof (paddr_t)); 
-	new->as_stackpbase = kmalloc (DUMBVM_STACKPAGES * sizeof (paddr_t)); 
 #endif
 
 	/* (Mis)use as_prepare_load to allocate some physical memory. */
@@ -618,7 +706,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 			(const void *)PADDR_TO_KVADDR(old->as_pbase2[i]),
 			PAGE_SIZE);
 	}
-	for (int i = 0; i < (int) DUMBVM_STACKPAGES; ++i) {
+	for (int i = 0; i < (int) new->as_stackpages; ++i) {
 		memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase[i]),
 			(const void *)PADDR_TO_KVADDR(old->as_stackpbase[i]),
 			PAGE_SIZE);
@@ -639,7 +727,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 
 	memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase),
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
-		DUMBVM_STACKPAGES*PAGE_SIZE);
+		new->as_stackpages*PAGE_SIZE);
 #endif	
 	*ret = new;
 	return 0;
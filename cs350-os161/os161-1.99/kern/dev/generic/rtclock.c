@@ -68,3 +68,21 @@ gettime(time_t *secs, uint32_t *nsecs)
 	KASSERT(the_clock!=NULL);
 	the_clock->rtc_gettime(the_clock->rtc_devdata, secs, nsecs);
 }
+
+/*
+ * Current time as a single count of nanoseconds, for timing
+ * intervals. Unlike gettime() this may be called before the clock has
+ * been attached; it returns 0 until then.
+ */
+uint64_t
+getnsecs(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (the_clock == NULL) {
+		return 0;
+	}
+	the_clock->rtc_gettime(the_clock->rtc_devdata, &secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
@@ -38,6 +38,7 @@
 #include <synch.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <ktrace.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -102,6 +103,7 @@ static
 void
 lhd_iodone(struct lhd_softc *lh, int err)
 {
+	KTRACE(KT_DISKDONE, lh, err);
 	lh->lh_result = err;
 	V(lh->lh_done);
 }
@@ -247,6 +249,8 @@ lhd_io(struct device *d, struct uio *uio)
 		lhd_wreg(lh, LHD_REG_SECT, sector+i);
 
 		/* and start the operation. */
+		KTRACE(KT_DISKSTART, lh, (sector+i) |
+		       (uio->uio_rw == UIO_WRITE ? KT_DISKWRITE : 0));
 		lhd_wreg(lh, LHD_REG_STAT, statval);
 
 		/* Now wait until the interrupt handler tells us we're done. */
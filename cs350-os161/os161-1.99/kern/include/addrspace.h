@@ -38,6 +38,7 @@
 #include <vm.h>
 #include "opt-A3.h"
 struct vnode;
+struct fs;
 
 
 /* 
@@ -56,6 +57,7 @@ struct addrspace {
   paddr_t *as_pbase2;
   size_t as_npages2;
   paddr_t *as_stackpbase;
+  size_t as_stackpages;
   bool load_complete; 
 #else
   vaddr_t as_vbase1;
@@ -65,7 +67,7 @@ struct addrspace {
   paddr_t as_pbase2;
   size_t as_npages2;
   paddr_t as_stackpbase;
-
+  size_t as_stackpages;
 #endif
 
 };
@@ -101,9 +103,18 @@ struct addrspace {
  *    as_complete_load - this is called when loading from an executable
  *                is complete.
  *
+ *    as_reserve_stack - make room for NBYTES (exec arguments) at the
+ *                top of the stack, on top of the usual stack size.
+ *                Must come before as_prepare_load.
+ *
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_translate - find the physical address user address VADDR is
+ *                mapped to in AS, for code that needs to identify
+ *                memory independently of address space (futex).
+ *                Returns EFAULT if VADDR isn't mapped.
  */
 
 struct addrspace *as_create(void);
@@ -119,17 +130,73 @@ int               as_define_region(struct addrspace *as,
                                    int executable);
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
+void              as_reserve_stack(struct addrspace *as, size_t nbytes);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_translate(struct addrspace *as, vaddr_t vaddr,
+                               paddr_t *ret);
+
+
+/* Most loadable segments an executable may have */
+#define ELFIMAGE_MAXSEGS 8
+
+/* A loadable (PT_LOAD) segment */
+struct elfseg {
+	off_t es_offset;		/* Where it is in the file */
+	vaddr_t es_vaddr;		/* Where it goes in memory */
+	size_t es_memsz;		/* Size in memory */
+	size_t es_filesz;		/* Size in the file */
+	uint32_t es_flags;		/* PF_R, PF_W, PF_X */
+};
 
+/*
+ * What load_elf needs from an executable's headers, once they've been
+ * read and checked. One of these is cached on the vnode (vn_image).
+ */
+struct elfimage {
+	vaddr_t ei_entry;		/* Initial PC */
+	unsigned ei_nsegs;
+	struct elfseg ei_segs[ELFIMAGE_MAXSEGS];
+};
 
 /*
  * Functions in loadelf.c
  *    load_elf - load an ELF user program executable into the current
  *               address space. Returns the entry point (initial PC)
  *               in the space pointed to by ENTRYPOINT.
+ *
+ *    elf_getimage  - read and check the headers of the executable V
+ *                    (or find them cached) into EI, without touching
+ *                    any address space.
+ *    load_elfimage - the rest of load_elf: load V, whose headers are
+ *                    in EI, into the current address space. For exec,
+ *                    which checks the program before it gives up the
+ *                    old image.
+ *
+ *    elfcache_purge - drop the cached executables on FS (all of them
+ *                     if FS is NULL), and the references that keep
+ *                     their vnodes alive, so FS can be unmounted.
+ *
+ *    execstat_add   - charge NSECS to exec phase PHASE (EXECSTAT_*).
+ *    execstat_cache - count a hit or miss in the ELF header cache.
+ *    execstat_print - print the per-phase exec latencies.
+ *    execstat_reset - clear them.
  */
 
+#define EXECSTAT_OPEN	0	/* vfs_open of the program */
+#define EXECSTAT_PARSE	1	/* reading/checking headers, or the cache */
+#define EXECSTAT_LOAD	2	/* defining regions and loading segments */
+#define EXECSTAT_STACK	3	/* defining the stack, copying out args */
+#define EXECSTAT_NPHASES 4
+
 int load_elf(struct vnode *v, vaddr_t *entrypoint);
+int elf_getimage(struct vnode *v, struct elfimage *ei);
+int load_elfimage(struct vnode *v, const struct elfimage *ei,
+                  vaddr_t *entrypoint);
+void elfcache_purge(struct fs *fs);
+void execstat_add(unsigned phase, uint64_t nsecs);
+void execstat_cache(bool hit);
+void execstat_print(void);
+void execstat_reset(void);
 
 
 #endif /* _ADDRSPACE_H_ */
@@ -42,6 +42,7 @@
  * timed operations. (This is a fairly simpleminded interface.)
  *
  * gettime() may be used to fetch the current time of day.
+ * getnsecs() returns the same thing as a single nanosecond count.
  * getinterval() computes the time from time1 to time2.
  *
  * XXX we have struct timespec now, let's use it.
@@ -61,7 +62,18 @@ void hardclock_bootstrap(void);
 void hardclock(void);
 void timerclock(void);
 
+/*
+ * The time page, mapped read-only into every process at
+ * TIMEPAGE_VADDR (see <kern/timepage.h>) and updated by timerclock.
+ *
+ *    timepage_bootstrap - allocate and fill it in; needs the VM system.
+ *    timepage_kvaddr    - its kernel address, for the VM system to map.
+ */
+void timepage_bootstrap(void);
+vaddr_t timepage_kvaddr(void);
+
 void gettime(time_t *seconds, uint32_t *nanoseconds);
+uint64_t getnsecs(void);
 
 void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
@@ -83,5 +95,39 @@ void clocksleep(int seconds);
  */
 void clocknap(int ticks);
 
+/* Number of timer ticks (as used by clocknap and timeouts) per second. */
+unsigned clock_tickspersec(void);
+
+/*
+ * Timeouts: call a function after a given number of timer ticks.
+ *
+ * The function is called from timerclock(), in interrupt context, on
+ * whichever cpu handles the timer. It may not sleep. It runs with
+ * the timeout queue's spinlock held, so it must not call the timeout
+ * functions itself; the upside is that once timeout_cancel returns,
+ * the function is guaranteed not to be running or to run later.
+ *
+ *    timeout_init   - set up a timeout to call FUNC(ARG).
+ *    timeout_add    - arrange for it to fire TICKS ticks from now.
+ *                     It must not already be pending.
+ *    timeout_cancel - make sure it won't fire. Returns true if it was
+ *                     still pending, false if it had already fired
+ *                     (or was never added).
+ *
+ * The caller provides the struct timeout (e.g. on its stack); it must
+ * stay valid until the timeout fires or is cancelled.
+ */
+struct timeout {
+	struct timeout *to_next;	/* Next in the queue */
+	uint64_t to_when;		/* Tick to fire on */
+	void (*to_func)(void *);	/* What to call */
+	void *to_arg;			/* ...and what to pass it */
+	bool to_pending;		/* True while on the queue */
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *arg);
+void timeout_add(struct timeout *to, unsigned ticks);
+bool timeout_cancel(struct timeout *to);
+
 
 #endif /* _CLOCK_H_ */
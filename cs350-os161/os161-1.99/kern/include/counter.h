@@ -0,0 +1,43 @@
+#ifndef _COUNTER_H_
+#define _COUNTER_H_
+
+/*
+ * Per-cpu statistics counters.
+ *
+ * Each counter has a slot in every cpu's c_counters array. Bumping a
+ * counter only touches the current cpu's slot, with interrupts off
+ * for the moment it takes, so it needs no lock and causes no cache
+ * traffic between cpus. Reading a counter adds up all the cpus'
+ * slots; the result is exact if nobody's counting at the time, and
+ * close enough otherwise.
+ *
+ * Any subsystem can register counters; they all show up in the
+ * "stats" menu command.
+ *
+ *    counter_register - get the counter named NAME, creating it if
+ *                       need be. NAME should be a string constant.
+ *                       Returns a handle for the functions below.
+ *                       Registering a name again returns the same
+ *                       counter, with its count left alone; use
+ *                       counter_reset to clear it.
+ *                       Panics if all COUNTER_MAX slots are in use.
+ *    counter_inc      - add one.
+ *    counter_add      - add N.
+ *    counter_read     - get the total over all cpus.
+ *    counter_reset    - set it back to 0 on all cpus.
+ *    counter_printall - print every registered counter.
+ */
+
+#define COUNTER_MAX 64
+
+typedef unsigned counter_t;
+
+counter_t counter_register(const char *name);
+void counter_inc(counter_t ctr);
+void counter_add(counter_t ctr, uint32_t n);
+uint64_t counter_read(counter_t ctr);
+void counter_reset(counter_t ctr);
+void counter_printall(void);
+
+
+#endif /* _COUNTER_H_ */
@@ -34,6 +34,16 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+#include <counter.h>
+#include <kern/syscall.h> /* for SYS_NCALLS */
+
+struct lockstat_table;	/* from <lockstat.h> */
+struct workqueue;	/* from <workqueue.h> */
+struct kprof_buf;	/* private to kprof.c */
+struct ktrace_buf;	/* private to ktrace.c */
+
+/* Scheduler latency histogram buckets; see thread_schedlat_print. */
+#define SCHEDLAT_NBUCKETS 32
 
 
 /*
@@ -60,6 +70,19 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_idleclocks;		/* ...of which found the cpu idle */
+	bool c_intr_fromuser;		/* Current interrupt came from user mode */
+	vaddr_t c_intr_pc;		/* ...and the PC it interrupted */
+	struct lockstat_table *c_lockstat; /* Lock statistics, if enabled */
+	struct kprof_buf *c_kprof;	/* Profiler samples, if enabled */
+	struct ktrace_buf *c_ktrace;	/* Trace records, if enabled */
+	struct threadlist c_threadcache; /* Dead threads kept for reuse */
+	struct workqueue *c_workqueue;	/* Deferred work for this cpu */
+	uint64_t c_counters[COUNTER_MAX]; /* See <counter.h> */
+	uint32_t c_runlat[SCHEDLAT_NBUCKETS];  /* Ready-to-run latency, log2 ns */
+	uint32_t c_wakelat[SCHEDLAT_NBUCKETS]; /* ...for threads that slept */
+	uint32_t c_syscalls[SYS_NCALLS];   /* Calls made, by number */
+	uint64_t c_syscallns[SYS_NCALLS];  /* ...and nsecs spent in them */
 
 	/*
 	 * Accessed by other cpus.
@@ -109,6 +132,14 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Number of CPUs in the system, and the cpu structure for software
+ * cpu number N. For code that keeps per-cpu data and needs to gather
+ * it up.
+ */
+unsigned cpu_numcpus(void);
+struct cpu *cpu_get(unsigned n);
+
 /*
  * Return a string describing the CPU type.
  */
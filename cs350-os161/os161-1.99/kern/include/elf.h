@@ -193,6 +193,51 @@ typedef struct {
 #define	PF_X		0x1	/* Segment is executable */
 
 
+/*
+ * "Section Header" and symbol table entry. Program loading doesn't
+ * use these; they're here so the profiler can find the kernel's
+ * symbol table (see kprof.c).
+ *
+ * There are Ehdr.e_shnum section headers at Ehdr.e_shoff. The symbol
+ * table is the section of type SHT_SYMTAB; its names are in the
+ * string table section numbered by its sh_link.
+ */
+typedef struct {
+	uint32_t	sh_name;     /* Section name (string table offset) */
+	uint32_t	sh_type;     /* Type of section */
+	uint32_t	sh_flags;    /* Flags */
+	uint32_t	sh_addr;     /* Virtual address, if loaded */
+	uint32_t	sh_offset;   /* Location of data within file */
+	uint32_t	sh_size;     /* Size of data within file */
+	uint32_t	sh_link;     /* Associated section, by type */
+	uint32_t	sh_info;     /* More info, by type */
+	uint32_t	sh_addralign; /* Alignment */
+	uint32_t	sh_entsize;  /* Size of entries, for tables */
+} Elf32_Shdr;
+
+/* values for sh_type */
+#define	SHT_NULL	0		/* Unused */
+#define	SHT_PROGBITS	1		/* Program data */
+#define	SHT_SYMTAB	2		/* Symbol table */
+#define	SHT_STRTAB	3		/* String table */
+
+typedef struct {
+	uint32_t	st_name;     /* Name (string table offset) */
+	uint32_t	st_value;    /* Address */
+	uint32_t	st_size;     /* Size of object */
+	unsigned char	st_info;     /* Type and binding */
+	unsigned char	st_other;    /* Ignore */
+	uint16_t	st_shndx;    /* Section it's in */
+} Elf32_Sym;
+
+#define	ELF32_ST_TYPE(info)	((info) & 0xf)
+
+/* values for ELF32_ST_TYPE(st_info) */
+#define	STT_NOTYPE	0		/* Unspecified */
+#define	STT_OBJECT	1		/* Data */
+#define	STT_FUNC	2		/* Function */
+
+
 typedef Elf32_Ehdr Elf_Ehdr;
 typedef Elf32_Phdr Elf_Phdr;
 
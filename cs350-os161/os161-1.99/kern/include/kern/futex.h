@@ -0,0 +1,27 @@
+#ifndef _KERN_FUTEX_H_
+#define _KERN_FUTEX_H_
+
+/*
+ * Operations for futex(addr, op, val).
+ *
+ * A futex is an aligned int in user memory that threads can sleep
+ * on. The kernel keeps nothing about it between calls: sleepers are
+ * queued by the physical address of the word, so any mapping of the
+ * same memory names the same futex. Locks built on it only need to
+ * call into the kernel when there's a thread to put to sleep or to
+ * wake up.
+ *
+ *    FUTEX_WAIT - if *addr still equals val, sleep until a
+ *                 FUTEX_WAKE on the same word; otherwise fail at
+ *                 once with EAGAIN. The check and going to sleep
+ *                 are atomic with respect to FUTEX_WAKE. Returns 0
+ *                 on wakeup. Wakeups may be spurious; recheck.
+ *    FUTEX_WAKE - wake up at most val threads sleeping on addr, and
+ *                 return how many were woken.
+ */
+
+#define FUTEX_WAIT	0
+#define FUTEX_WAKE	1
+
+
+#endif /* _KERN_FUTEX_H_ */
@@ -69,6 +69,17 @@ struct rusage {
 	__counter_t ru_nivcsw;		/* involuntary ditto (count) */
 };
 
+/*
+ * One system call's totals, as returned by sysstat(): how often it
+ * was called and the time spent in it, over all processes and cpus.
+ */
+struct syscallstat {
+	char ss_name[16];		/* Call name, e.g. "waitpid" */
+	int ss_callno;			/* SYS_* number */
+	__u32 ss_count;			/* Calls made */
+	__u64 ss_nsecs;			/* Total time in the call (ns) */
+};
+
 /* limit codes for getrusage/setrusage */
 
 #define RLIMIT_NPROC		0	/* max procs per user (count) */
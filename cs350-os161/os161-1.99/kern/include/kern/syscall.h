@@ -86,7 +86,7 @@
 //#define SYS_sigaltstack 33
 //                              (resource tracking and usage)
 //#define SYS_wait4      34
-//#define SYS_getrusage  35
+#define SYS_getrusage    35
 //                              (resource limits)
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
@@ -196,8 +196,26 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+//                              (cpu affinity)
+#define SYS_setaffinity  121
+#define SYS_getaffinity  122
+//                              (process creation)
+#define SYS_spawn        123
+//                              (statistics)
+#define SYS_sysstat      124
+//                              (batching)
+#define SYS_sysbatch     125
+//                              (synchronization)
+#define SYS_futex        126
+//                              (threads)
+#define SYS___thread_create 127
+#define SYS_thread_exit  128
+#define SYS_thread_join  129
 
 /*CALLEND*/
 
+/* One more than the highest call number; sizes per-call tables */
+#define SYS_NCALLS       130
+
 
 #endif /* _KERN_SYSCALL_H_ */
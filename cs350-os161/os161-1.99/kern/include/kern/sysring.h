@@ -0,0 +1,49 @@
+#ifndef _KERN_SYSRING_H_
+#define _KERN_SYSRING_H_
+
+/*
+ * Batched system calls.
+ *
+ * A process puts system call requests in a ring in its own memory
+ * and hands the whole ring to the kernel with one sysbatch() call,
+ * instead of trapping once per call. The kernel runs each request
+ * in order and fills in its result, the way the call would have
+ * returned it.
+ *
+ * The ring has sr_size slots, a power of two; request number N is
+ * in slot N & (sr_size - 1). The process owns sr_head: it fills in
+ * se_callno and se_args of the next slot, then increments sr_head.
+ * The kernel owns sr_tail: sysbatch() runs requests from sr_tail up
+ * to sr_head, writing se_retval and se_errno of each, then stores
+ * the new sr_tail and returns how many it ran. A request whose slot
+ * the process hasn't reused yet can be read back once it's behind
+ * sr_tail. The head may be at most sr_size ahead of the tail.
+ *
+ * Only calls cheap enough not to need their own trap and that don't
+ * depend on the trapframe can be batched (those marked SD_BATCH in
+ * the kernel's syscall table); others complete with ENOSYS. Each
+ * takes its arguments as 32-bit words, in the order they'd have been
+ * passed to a trap: what would go in a0-a3 first, then what would go
+ * on the stack. A 64-bit argument takes an aligned pair of words.
+ */
+
+struct sysring_entry {
+	int se_callno;			/* SYS_* */
+	__u32 se_args[6];		/* Argument words */
+	int se_retval;			/* Return value, if se_errno is 0 */
+	int se_errno;			/* Error code, or 0 for success */
+};
+
+struct sysring {
+	unsigned sr_head;		/* Requests submitted (process) */
+	unsigned sr_tail;		/* Requests completed (kernel) */
+	unsigned sr_size;		/* Slots; must be a power of two */
+	struct sysring_entry sr_ents[];	/* sr_size of them */
+};
+
+/* Size of a ring with N slots, for allocating one */
+#define SYSRING_BYTES(n) \
+	(sizeof(struct sysring) + (n) * sizeof(struct sysring_entry))
+
+
+#endif /* _KERN_SYSRING_H_ */
@@ -0,0 +1,29 @@
+#ifndef _KERN_TIMEPAGE_H_
+#define _KERN_TIMEPAGE_H_
+
+/*
+ * The time page.
+ *
+ * The kernel maps one page, read-only, at TIMEPAGE_VADDR in every
+ * process and keeps the time of day in it, updated each timer tick
+ * (every 10ms). Reading it takes no system call; it's as good as
+ * __time() for anything that doesn't need finer resolution than the
+ * tick, which is what libc's time() uses it for.
+ *
+ * tp_seq is odd while the kernel is changing the time and goes up by
+ * two with each change. To read: load tp_seq, and if it's odd, try
+ * again; read the time; then check tp_seq hasn't moved, and if it
+ * has, start over. (On a multiprocessor, put a SYNC after the first
+ * load and before the second.)
+ */
+
+#define TIMEPAGE_VADDR	0x7ff00000
+
+struct timepage {
+	__u32 tp_seq;			/* Update sequence count */
+	__u32 tp_nsecs;			/* Nanoseconds... */
+	__time_t tp_secs;		/* ...and seconds, as from __time */
+};
+
+
+#endif /* _KERN_TIMEPAGE_H_ */
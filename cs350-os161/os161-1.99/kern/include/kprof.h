@@ -0,0 +1,41 @@
+#ifndef _KPROF_H_
+#define _KPROF_H_
+
+/*
+ * Sampling kernel profiler.
+ *
+ * While it's on, each hardclock() records the kernel PC it
+ * interrupted in a ring buffer belonging to the cpu; only the most
+ * recent KPROF_NSAMPLES per cpu are kept. Ticks that interrupted user
+ * code or found the cpu idle are only counted.
+ *
+ * The samples can be printed two ways: kprof_print symbolizes them
+ * itself, given the kernel image to read the symbol table from, and
+ * prints the functions with the most samples; kprof_dump prints the
+ * raw PC histogram, for the host-kprof tool to turn into a flat
+ * profile offline.
+ *
+ *    kprof_start  - allocate buffers if need be and start sampling.
+ *                   Returns an error code.
+ *    kprof_stop   - stop sampling.
+ *    kprof_reset  - throw away the samples.
+ *    kprof_sample - take a sample; called by hardclock().
+ *    kprof_print  - print the TOPN functions with the most samples,
+ *                   using the symbol table in the kernel image PATH
+ *                   (e.g. "emu0:kernel"). Returns an error code.
+ *    kprof_dump   - print the PC histogram.
+ */
+
+#define KPROF_NSAMPLES 4096	/* per cpu */
+
+extern volatile bool kprof_enabled;
+
+int kprof_start(void);
+void kprof_stop(void);
+void kprof_reset(void);
+void kprof_sample(void);
+int kprof_print(unsigned topn, const char *path);
+void kprof_dump(void);
+
+
+#endif /* _KPROF_H_ */
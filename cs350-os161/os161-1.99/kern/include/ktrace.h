@@ -0,0 +1,71 @@
+#ifndef _KTRACE_H_
+#define _KTRACE_H_
+
+/*
+ * Kernel event tracing.
+ *
+ * Tracepoints sprinkled through the kernel record timestamped events
+ * (context switches, wakeups, system calls, faults, disk I/O, lock
+ * contention) in a ring buffer belonging to the cpu they happen on.
+ * Recording takes no locks: interrupts go off for the moment it
+ * takes to fill in a slot, and nobody else writes this cpu's ring.
+ * Only the most recent KTRACE_NRECS events per cpu are kept.
+ *
+ * A tracepoint is the KTRACE macro; when its event isn't enabled it
+ * costs a load and a branch. Events are enabled by giving a mask of
+ * (1 << KT_xxx) bits to ktrace_start.
+ *
+ * The records can be dumped, merged into time order, to the console
+ * or to a file; the host-ktrace tool turns a dump into a timeline
+ * that chrome://tracing or Perfetto can display. In "mirror" mode
+ * each record is also passed to ltrace_debug, so it shows up in
+ * trace161's output interleaved with the simulator's own tracing.
+ *
+ *    ktrace_start  - allocate buffers if need be and start recording
+ *                    the events in MASK. Returns an error code.
+ *    ktrace_stop   - stop recording.
+ *    ktrace_reset  - throw away the records.
+ *    ktrace_mirror - turn ltrace_debug mirroring on or off.
+ *    ktrace_record - record an event; use KTRACE instead.
+ *    ktrace_dump   - stop recording and print the records, to the
+ *                    console if PATH is NULL or to the file PATH.
+ *                    Returns an error code.
+ */
+
+/* Event types. Keep ktrace_names in ktrace.c and host-ktrace in sync. */
+#define KT_SWITCH	0	/* arg1: next thread, arg2: old thread's new state */
+#define KT_WAKEUP	1	/* arg1: thread, arg2: cpu it goes to */
+#define KT_SYSCALL	2	/* arg1: call number */
+#define KT_SYSRET	3	/* arg1: call number, arg2: error */
+#define KT_VMFAULT	4	/* arg1: address, arg2: fault type */
+#define KT_DISKSTART	5	/* arg1: disk, arg2: sector | write flag */
+#define KT_DISKDONE	6	/* arg1: disk, arg2: error */
+#define KT_CONTEND	7	/* arg1: lock, arg2: LOCKSTAT_* kind */
+#define KT_NEVENTS	8
+
+#define KT_ALL		((1U << KT_NEVENTS) - 1)
+#define KT_DISKWRITE	0x80000000	/* in KT_DISKSTART's arg2 */
+
+#define KTRACE_NRECS	2048	/* per cpu */
+
+extern volatile uint32_t ktrace_mask;
+
+#define KTRACE(ev, a1, a2) \
+	do { \
+		if (ktrace_mask & (1U << (ev))) { \
+			ktrace_record(ev, (uint32_t)(a1), (uint32_t)(a2)); \
+		} \
+	} while (0)
+
+int ktrace_start(uint32_t mask);
+void ktrace_stop(void);
+void ktrace_reset(void);
+void ktrace_mirror(bool on);
+void ktrace_record(unsigned event, uint32_t arg1, uint32_t arg2);
+int ktrace_dump(const char *path);
+
+/* Event name for printing, or NULL if EVENT is out of range. */
+const char *ktrace_eventname(unsigned event);
+
+
+#endif /* _KTRACE_H_ */
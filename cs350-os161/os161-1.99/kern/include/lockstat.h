@@ -0,0 +1,75 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * While enabled (see the "lockstat" menu command), spinlock_acquire,
+ * lock_acquire and lock_release, P, and cv_wait report every
+ * acquisition here. Each CPU keeps its own table of counters indexed
+ * by lock address, and only ever touches its own table, so recording
+ * takes no locks; the tables are added together when printed.
+ *
+ * When disabled, the cost to the lock code is one test of
+ * lockstat_enabled.
+ */
+
+/* Kinds of lock we keep statistics for. */
+#define LOCKSTAT_SPINLOCK	0
+#define LOCKSTAT_LOCK		1
+#define LOCKSTAT_SEM		2
+#define LOCKSTAT_CV		3
+
+/* Buckets in each per-cpu table, and bytes of lock name kept. */
+#define LOCKSTAT_HASHSIZE	256
+#define LOCKSTAT_NAMELEN	20
+
+struct lockstat_entry {
+	const void *le_lock;		/* The lock; NULL if entry unused */
+	unsigned le_kind;		/* LOCKSTAT_* */
+	char le_name[LOCKSTAT_NAMELEN];	/* Copy of the lock's name */
+	vaddr_t le_caller;		/* First acquirer (spinlocks) */
+	uint32_t le_acquires;		/* Acquisitions (or waits, for CVs) */
+	uint32_t le_contended;		/* Acquisitions that had to wait */
+	uint64_t le_waittime;		/* Total ns spent spinning/sleeping */
+	uint32_t le_maxwait;		/* Longest single wait, ns */
+	uint64_t le_holdtime;		/* Total ns held */
+	uint32_t le_maxhold;		/* Longest single hold, ns */
+	uint64_t le_holdstart;		/* When this cpu took it (spinlocks) */
+};
+
+struct lockstat_table {
+	struct lockstat_entry lt_entries[LOCKSTAT_HASHSIZE];
+	unsigned lt_overflow;		/* Events dropped: table full */
+};
+
+extern volatile bool lockstat_enabled;
+
+/*
+ * Hooks for the lock code.
+ *
+ * lockstat_acquired reports an acquisition that waited WAITNS
+ * nanoseconds (CONTENDED is true if it had to wait at all).
+ * lockstat_released reports a release after holding the lock for
+ * HOLDNS nanoseconds, or, for spinlocks, pass 0 and the time is
+ * worked out from when this cpu acquired it.
+ *
+ * NAME may be NULL (for spinlocks). For spinlocks, CALLER identifies
+ * the code acquiring the lock instead.
+ */
+void lockstat_acquired(const void *lk, unsigned kind, const char *name,
+		       vaddr_t caller, uint64_t waitns, bool contended);
+void lockstat_released(const void *lk, unsigned kind, uint64_t holdns);
+
+/*
+ * Control: start collecting (allocating tables on first use; returns
+ * an error code), stop, clear all counts, and print the TOPN most
+ * contended locks.
+ */
+int lockstat_start(void);
+void lockstat_stop(void);
+void lockstat_reset(void);
+void lockstat_print(unsigned topn);
+
+
+#endif /* _LOCKSTAT_H_ */
@@ -47,11 +47,23 @@ struct vnode;
 struct semaphore;
 #endif // UW
 
-//#if OPT_A2
-struct lock *lk_PID_counter;
-int PID_counter;
-//#endif /* OPT_A2 */
+#if OPT_A2
+/*
+ * User threads: most a process can have at once, counting ones that
+ * have exited but haven't been joined yet. A thread's id is its slot
+ * in p_uthreads; the process's first thread is 0.
+ */
+#define PROC_MAXTHREADS	32
 
+#define UT_FREE		0	/* slot unused */
+#define UT_LIVE		1	/* thread running (or starting) */
+#define UT_EXITED	2	/* thread gone; ut_code waits for a join */
+
+struct uthread {
+	int ut_state;			/* UT_* */
+	int ut_code;			/* exit code, once UT_EXITED */
+};
+#endif /* OPT_A2 */
 
 /*
  * Process structure.
@@ -63,15 +75,46 @@ struct proc {
 	
 #if OPT_A2
 	int PID; 
+	struct proc *p_pidnext;		/* Hash chain in the PID table */
 
 	struct lock *lk_process_info;// protects access to its children and its exit code/status
 	struct proc *parent; 	
-	struct array *children; 
+
+	/*
+	 * Our children, live and exited-but-not-reaped, linked through
+	 * p_sibnext/p_sibprevp; those links belong to the parent's
+	 * lk_process_info. An exiting child moves itself to p_zombies
+	 * when it sets its exit_status, under both locks. Always take
+	 * a child's lock before its parent's, never the other way round.
+	 */
+	struct proc *p_children;
+	struct proc *p_zombies;
+	struct proc *p_sibnext;
+	struct proc **p_sibprevp;
 
 	int exit_code; // register v0	
 	int exit_status; // register a3, -1 means that it has not terminated 
 
-	struct cv *cv_parent_waitpid; 
+	struct cv *cv_parent_waitpid; // broadcast when one of our children exits
+
+	/*
+	 * Set while we're a vfork child running in our parent's
+	 * address space; V'd (and cleared) once we're done with it.
+	 */
+	struct semaphore *p_vforkdone;
+
+	/*
+	 * Our threads, by thread id, and how many are UT_LIVE.
+	 * p_exiting is set while one thread gets the others out of
+	 * the way (for exit or exec); they check it on their way back
+	 * to user mode and leave. Protected by lk_process_info, though
+	 * p_exiting is also read without it. cv_threads is broadcast
+	 * when a thread exits.
+	 */
+	struct uthread p_uthreads[PROC_MAXTHREADS];
+	unsigned p_nlive;
+	volatile bool p_exiting;
+	struct cv *cv_threads;
 	
 	//bool waitpid_called; 
 #endif /* OPT_A2 */
@@ -90,6 +133,22 @@ struct proc {
   struct vnode *console;                /* a vnode for the console device */
 #endif
 
+	/* For proc_destroy_async */
+	struct work p_destroywork;
+
+	/*
+	 * CPU time, in hardclocks, of threads that have left the
+	 * process (the live ones keep their own counts) and of
+	 * children that have exited. Protected by p_lock.
+	 */
+	unsigned p_utime;
+	unsigned p_stime;
+	unsigned p_cutime;
+	unsigned p_cstime;
+
+	/* Link for the list of all processes, for ps */
+	struct proc *p_allnext;
+
 	/* add more material here as needed */
 };
 
@@ -110,12 +169,63 @@ struct proc *proc_create_runprogram(const char *name);
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
+/*
+ * Destroy a process later, from a workqueue thread, so the caller
+ * (normally a thread on its way out through exit) doesn't wait for
+ * the teardown.
+ */
+void proc_destroy_async(struct proc *proc);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/*
+ * CPU time accounting, in hardclocks (HZ per second).
+ *
+ * proc_getcputime returns the time used by PROC's threads, including
+ * ones still running, and by its exited children. proc_chargeparent
+ * adds an exiting process's time (and its children's) to the
+ * children totals of PARENT.
+ */
+void proc_getcputime(struct proc *proc, unsigned *utime, unsigned *stime,
+		     unsigned *cutime, unsigned *cstime);
+void proc_chargeparent(struct proc *proc, struct proc *parent);
+
+#if OPT_A2
+/*
+ * Find a process by PID, or return NULL. The table only keeps the
+ * process from going away while it is being looked at, so the result
+ * is only safe to use if something else keeps it alive: if PARENT is
+ * not NULL, only a child of PARENT is returned, and a parent's
+ * children stay until it reaps them.
+ */
+struct proc *proc_lookup(pid_t pid, struct proc *parent);
+
+/*
+ * Multithreaded processes. Functions in thread_syscalls.c.
+ *
+ *    proc_stopthreads - make all the other threads of the current
+ *                       process leave, and wait until they have.
+ *                       Exited threads nobody joined are forgotten.
+ *                       Returns false, having done nothing, if
+ *                       another thread is already doing this; the
+ *                       caller should then proc_threadleave too.
+ *                       Threads asleep in futex, thread_join or
+ *                       waitpid are woken up to go; ones blocked
+ *                       anywhere else go once they get back.
+ *    proc_threadleave - exit the current thread because its process
+ *                       is being torn down. Does not return.
+ */
+bool proc_stopthreads(void);
+void proc_threadleave(void);
+#endif /* OPT_A2 */
+
+/* Print all processes and their threads, with cpu times. */
+void proc_printall(void);
+
 /* Fetch the address space of the current process. */
 struct addrspace *curproc_getas(void);
 
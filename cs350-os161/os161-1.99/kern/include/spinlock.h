@@ -50,19 +50,26 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * This is a ticket lock: each CPU that wants the lock takes the next
+ * number from lk_next_ticket and waits until lk_now_serving reaches
+ * it. CPUs get the lock in the order they asked for it, and waiters
+ * only read lk_now_serving, which changes once per handoff.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+	volatile spinlock_data_t lk_next_ticket; /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_now_serving; /* Ticket that holds it. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL }
 
 /*
  * Spinlock functions.
@@ -62,6 +62,18 @@ void sem_destroy(struct semaphore *);
 void P(struct semaphore *);
 void V(struct semaphore *);
 
+/*
+ * V on VSEM and then P on PSEM. Because the caller is about to block,
+ * a thread woken by the V is moved to this cpu to run in its place.
+ */
+void sem_vp(struct semaphore *vsem, struct semaphore *psem);
+
+/*
+ * P, but give up after TICKS timer ticks (see clocknap). Returns 0 if
+ * the semaphore was decremented or ETIMEDOUT if not.
+ */
+int P_timed(struct semaphore *, unsigned ticks);
+
 
 /*
  * Simple lock for mutual exclusion.
@@ -71,7 +83,14 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * Locks implement priority inheritance: while a thread is waiting for
+ * the lock, the owner runs at (at least) the waiter's priority, and if
+ * the owner is itself waiting for another lock the donation is passed
+ * along that chain too (up to LOCK_PI_MAXDEPTH locks deep).
  */
+#define LOCK_PI_MAXDEPTH 8
+
 struct lock {
         char *lk_name;
 
@@ -79,6 +98,13 @@ struct lock {
 	struct thread *lk_owner; 
 	struct wchan *lk_wchan; 
 	struct spinlock lk_spinlock; 
+
+	/* Priority inheritance */
+	struct lock *lk_nextheld;	/* Next lock held by lk_owner */
+	unsigned lk_nwaiters;		/* Threads waiting for the lock */
+	int lk_donated;			/* Highest priority among waiters */
+
+	uint64_t lk_acqtime;		/* When acquired, for lockstat */
 };
 
 struct lock *lock_create(const char *name);
@@ -139,5 +165,66 @@ void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
+/*
+ * Like cv_wait, but give up waiting after TICKS timer ticks (see
+ * clocknap). The lock is reacquired either way. Returns 0 if woken
+ * by cv_signal/cv_broadcast, or ETIMEDOUT.
+ */
+int cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks);
+
+
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, new readers block
+ * until it has been and gone. (So a thread that already holds the
+ * lock for reading must not try to take it for reading again.)
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+        char *rw_name;
+	struct wchan *rw_readwchan;	/* Readers wait here */
+	struct wchan *rw_writewchan;	/* Writers and upgraders wait here */
+	struct spinlock rw_lock;
+	volatile unsigned rw_readers;	/* Number of readers holding it */
+	volatile unsigned rw_writers_waiting;
+	struct thread *rw_writer;	/* Writer holding it, if any */
+	struct thread *rw_upgrader;	/* Reader waiting to upgrade */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock for writing (exclusively).
+ *    rwlock_release_write - Give up a write hold.
+ *    rwlock_tryupgrade    - Turn a read hold into a write hold without
+ *                   letting any other writer in between. Only one
+ *                   reader can be upgrading at a time; if another one
+ *                   already is, this fails and returns false with the
+ *                   read hold still in place, and the caller should
+ *                   release it and acquire for writing the usual way
+ *                   (and recheck whatever it read).
+ *    rwlock_downgrade     - Turn a write hold into a read hold without
+ *                   letting any other writer in between.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                   the lock for writing.
+ *
+ * All of these except rwlock_do_i_hold_write may sleep.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_tryupgrade(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
 
 #endif /* _SYNCH_H_ */
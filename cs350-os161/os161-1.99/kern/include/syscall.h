@@ -32,8 +32,10 @@
 #ifndef _SYSCALL_H_
 #define _SYSCALL_H_
 
+#include <kern/syscall.h>	/* for SYS_NCALLS */
 
 struct trapframe; /* from <machine/trapframe.h> */
+struct proc;      /* from <proc.h> */
 
 /*
  * The system call dispatcher.
@@ -41,6 +43,49 @@ struct trapframe; /* from <machine/trapframe.h> */
 
 void syscall(struct trapframe *tf);
 
+/*
+ * The dispatch table, indexed by call number; entries for calls we
+ * don't have are all zero. Each handler gets the call's arguments as
+ * sd_nargs 32-bit words, gathered by the dispatcher from a0-a3 and
+ * then the user stack, as described in syscall.c. A 64-bit argument
+ * takes an aligned pair of words, so may leave a word unused before
+ * it; sd_nargs counts that too.
+ */
+struct syscall_desc {
+	const char *sd_name;
+	unsigned sd_nargs;		/* Argument words */
+	unsigned sd_flags;		/* SD_* */
+	int (*sd_call)(struct trapframe *tf, const uint32_t *args,
+		       int32_t *retval);
+};
+
+#define SD_MAXARGS	6	/* Most argument words any call takes */
+#define SD_NORETURN	0x1	/* Never returns (_exit) */
+#define SD_BATCH	0x2	/* May be run by sysbatch (tf is NULL) */
+
+extern const struct syscall_desc syscall_table[SYS_NCALLS];
+
+/*
+ * Per-call statistics, kept per cpu in c_syscalls and c_syscallns.
+ * Functions in syscallstat.c.
+ *
+ *    syscallstat_begin - note the start of a call (in t_syscallstart).
+ *    syscallstat_end   - charge the call and the time since
+ *                        syscallstat_begin to call number CALLNO.
+ *                        Calls that don't return to the dispatcher
+ *                        (a successful execv) call this themselves.
+ *    syscallstat_charge - charge a call taking NSECS to CALLNO, for
+ *                        calls made other than through the dispatcher
+ *                        (sysbatch).
+ *    syscallstat_print - print the N calls with the most time.
+ *    syscallstat_reset - clear the statistics on all cpus.
+ */
+void syscallstat_begin(void);
+void syscallstat_end(int callno);
+void syscallstat_charge(int callno, uint64_t nsecs);
+void syscallstat_print(unsigned n);
+void syscallstat_reset(void);
+
 /*
  * Support functions.
  */
@@ -52,6 +97,9 @@ void enter_forked_process(struct trapframe *tf, unsigned long n);
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       vaddr_t entrypoint);
 
+/* Enter user mode in a new thread, calling ENTRY(ARG). Does not return. */
+void enter_new_thread(vaddr_t entrypoint, userptr_t arg, vaddr_t stackptr);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -59,6 +107,9 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_sysstat(userptr_t buf, unsigned max, int *retval);
+int sys_sysbatch(userptr_t ring, int *retval);
+int sys_futex(userptr_t uaddr, int op, int val, int *retval);
 
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
@@ -68,11 +119,23 @@ void sys__kill(int exitcode);
 #endif
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
+int sys_getrusage(int who, userptr_t usage);
+int sys_setaffinity(uint32_t mask);
+int sys_getaffinity(userptr_t mask);
 #endif // UW
 
 #if OPT_A2
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
+int sys_spawn(userptr_t prog_name, userptr_t args, pid_t *retval);
 int sys_execv(userptr_t prog_name, userptr_t args); 
+int sys___thread_create(userptr_t entry, userptr_t arg, userptr_t stack,
+			int *retval);
+void sys_thread_exit(int code);
+int sys_thread_join(int tid, userptr_t code, int *retval);
+
+/* Wake P's threads sleeping in futex waits, for proc_stopthreads. */
+void futex_wakeproc(struct proc *p);
 #endif /* OPT_A2 */
 
 #endif /* _SYSCALL_H_ */
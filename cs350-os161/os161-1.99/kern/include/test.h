@@ -57,9 +57,17 @@ int queuetest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadforkbench(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int rwtest(int, char **);
+int timedwaittest(int, char **);
+int rwbench(int, char **);
+int spinlockbench(int, char **);
+int pingpongbench(int, char **);
+int createbench(int, char **);
+int pitest(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
@@ -39,6 +39,7 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+#include <workqueue.h>
 
 struct cpu;
 
@@ -55,6 +56,24 @@ struct cpu;
 /* Macro to test if two addresses are on the same kernel stack */
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
+/* Exited threads (with their stacks) each cpu keeps for reuse */
+#define THREAD_CACHE_MAX 8
+
+
+/*
+ * Thread priorities. Larger numbers are more important. Runnable
+ * threads are kept on the run queue in order of effective priority,
+ * and round-robin among threads of equal priority.
+ */
+#define PRI_MIN		0
+#define PRI_DEFAULT	50
+#define PRI_MAX		100
+
+/*
+ * CPU affinity masks: bit N set means the thread may run on cpu N.
+ */
+#define CPUMASK_ALL	0xffffffff
+#define CPUMASK_CPU(n)	((uint32_t)1 << (n))
 
 /* States a thread can be in. */
 typedef enum {
@@ -101,6 +120,68 @@ struct thread {
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Scheduling priority.
+	 *
+	 * t_priority is the base priority. t_effpriority is what the
+	 * scheduler actually uses; it is raised above t_priority by
+	 * priority inheritance while this thread holds a lock that a
+	 * more important thread is waiting for. t_effpriority,
+	 * t_blocked_on, and the lk_donated fields of t_heldlocks are
+	 * protected by the priority-inheritance spinlock in synch.c.
+	 */
+	int t_priority;			/* Base priority */
+	int t_effpriority;		/* Priority after donations */
+	struct lock *t_blocked_on;	/* Lock we're sleeping on, if any */
+	struct lock *t_heldlocks;	/* Locks we hold, via lk_nextheld */
+
+	/*
+	 * Set by wchan_handoff when it wakes us: whoever woke us has
+	 * passed us the semaphore count or lock we were waiting for,
+	 * so we needn't (mustn't) go back and compete for it.
+	 */
+	bool t_handoff;
+
+	/* Object we're waiting for, if sleeping on a hashed wchan */
+	const void *t_wchan_key;
+
+	/* For handing this thread to a workqueue to be destroyed */
+	struct work t_reapwork;
+
+	/*
+	 * CPU time charged to this thread, in hardclocks. Only
+	 * hardclock() on the cpu the thread is running on changes
+	 * these; proc_remthread adds them to the process totals.
+	 */
+	unsigned t_utime;		/* ...while in user mode */
+	unsigned t_stime;		/* ...while in the kernel */
+
+	/*
+	 * CPUs this thread may run on. Set only by the thread itself
+	 * (thread_setaffinity) or before it first runs; honored by
+	 * thread_make_runnable and thread_consider_migration.
+	 */
+	uint32_t t_cpumask;
+
+	/*
+	 * For scheduler latency statistics: when thread_make_runnable
+	 * last queued us, and whether that was a wakeup from sleep.
+	 * Read by thread_switch on the cpu that picks us to run.
+	 */
+	uint64_t t_readytime;
+	bool t_woken;
+
+	/* When the system call we're in began, for syscall statistics */
+	uint64_t t_syscallstart;
+
+	/*
+	 * Our thread id in a user process (see struct uthread), and
+	 * the futex word we're sleeping on, if any, so that a thread
+	 * tearing down the process can wake us.
+	 */
+	int t_tid;
+	volatile const void *t_futex;
+
 	/*
 	 * Public fields
 	 */
@@ -144,6 +225,15 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread may run only on the cpus in
+ * MASK (see thread_setaffinity) instead of inheriting the caller's
+ * affinity.
+ */
+int thread_fork_affinity(const char *name, struct proc *proc, uint32_t mask,
+                         void (*func)(void *, unsigned long),
+                         void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -157,6 +247,46 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Set the base priority of the current thread. If the thread has
+ * inherited a higher priority through a lock it holds, it keeps the
+ * higher one until the lock is released. (This lives in synch.c with
+ * the rest of the priority-inheritance code.)
+ */
+void thread_setpriority(int priority);
+
+/*
+ * CPU affinity of the current thread. thread_setaffinity restricts
+ * it to the cpus in MASK (bits for nonexistent cpus are ignored) and
+ * moves it to one of them if need be; it fails with EINVAL if that
+ * leaves no cpus. thread_getaffinity returns the mask, likewise
+ * limited to cpus that exist. New threads get their parent's mask.
+ */
+int thread_setaffinity(uint32_t mask);
+uint32_t thread_getaffinity(void);
+
+/*
+ * Thread cache: report hits and misses summed over all cpus, and
+ * change how many threads each cpu keeps (at most THREAD_CACHE_MAX;
+ * 0 turns the cache off). For benchmarking.
+ */
+void thread_cache_stats(unsigned *hits, unsigned *misses);
+void thread_cache_setlimit(unsigned limit);
+
+/*
+ * Scheduler latency: how long threads sit runnable before they get
+ * a cpu, as log2 histograms kept per cpu. One covers every thread
+ * run; the other only threads that had been woken up from a wait
+ * channel. Nothing is counted (or timed) until thread_schedlat_start,
+ * and thread_schedlat_stop stops it again. thread_schedlat_print
+ * prints both, per cpu and summed; thread_schedlat_reset clears them.
+ * For benchmarking.
+ */
+void thread_schedlat_start(void);
+void thread_schedlat_stop(void);
+void thread_schedlat_print(void);
+void thread_schedlat_reset(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -30,9 +30,11 @@
 #ifndef _VNODE_H_
 #define _VNODE_H_
 
+#include <spinlock.h>
 
 struct uio;
 struct stat;
+struct elfimage;
 
 /*
  * A struct vnode is an abstract representation of a file.
@@ -50,6 +52,14 @@ struct stat;
  * vn_opencount is managed using VOP_INCOPEN and VOP_DECOPEN by
  * vfs_open() and vfs_close(). Code above the VFS layer should not
  * need to worry about it.
+ *
+ * vn_image is the parsed headers of the executable this file holds,
+ * kept by load_elf so repeat execs needn't read them again. load_elf
+ * also holds a reference to the last few such vnodes, so the image
+ * outlives the vfs_close at the end of an exec. Every VOP_WRITE and
+ * VOP_TRUNCATE throws it away before it starts, and bumps vn_imagegen
+ * both before and after; load_elf only caches what it read if no
+ * write was going on and the count didn't move.
  */
 struct vnode {
 	int vn_refcount;                /* Reference count */
@@ -60,6 +70,11 @@ struct vnode {
 	void *vn_data;                  /* Filesystem-specific data */
 
 	const struct vnode_ops *vn_ops; /* Functions on this vnode */
+
+	struct spinlock vn_imagelock;   /* Protects the three below */
+	struct elfimage *vn_image;      /* Cached executable, or NULL */
+	unsigned vn_imagegen;           /* Count of writes and truncates */
+	unsigned vn_imagewriters;       /* Writes and truncates under way */
 };
 
 /*
@@ -248,14 +263,14 @@ struct vnode_ops {
 #define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
-#define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
+#define VOP_WRITE(vn, uio)              vnode_write(vn, uio)
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_TRYSEEK(vn, pos)            (__VOP(vn, tryseek)(vn, pos))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
-#define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
+#define VOP_TRUNCATE(vn, pos)           vnode_truncate(vn, pos)
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
@@ -274,6 +289,13 @@ struct vnode_ops {
  */
 void vnode_check(struct vnode *, const char *op);
 
+/*
+ * VOP_WRITE and VOP_TRUNCATE: drop the cached executable image, then
+ * do the operation.
+ */
+int vnode_write(struct vnode *, struct uio *);
+int vnode_truncate(struct vnode *, off_t pos);
+
 /*
  * Reference count manipulation (handled above filesystem level)
  */
@@ -81,5 +81,52 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Wake up at most N threads sleeping on a wait channel, and return
+ * how many there were. Like wchan_wakeone, the queue should not
+ * already be locked.
+ */
+unsigned wchan_wakesome(struct wchan *wc, unsigned n);
+
+/*
+ * Wake up one thread and mark it (t_handoff) as having been handed
+ * the resource it was waiting for. Returns the thread woken, or NULL
+ * if nobody was sleeping. The caller should hold the resource's own
+ * lock, so the sleeper can't look at it before the handoff is done.
+ *
+ * If HERE is true, the thread is made runnable on the current cpu
+ * rather than on the cpu it last ran on. This is meant for when the
+ * current thread is about to sleep, so the woken thread takes over
+ * its cpu instead of having to wake another one up.
+ */
+struct thread *wchan_handoff(struct wchan *wc, bool here);
+
+/*
+ * Wake up one particular thread, if it is sleeping on the channel.
+ * Returns true if it was. The channel must be locked, and is still
+ * locked on return. (For timed waits; see cv_timedwait.)
+ */
+bool wchan_wakethread(struct wchan *wc, struct thread *target);
+
+/*
+ * Get a wait channel for the object at KEY without creating one.
+ * Nothing is allocated: sleepers go on a queue in a global hash
+ * table, keyed by object address with a spinlock per bucket, and
+ * wakeups pick out the threads waiting for KEY. The result works
+ * with all the functions above; wchan_destroy on it does nothing.
+ * KEY must be 4-byte aligned, and nobody may be sleeping on it when
+ * the object goes away.
+ *
+ * Objects that hash to the same bucket share its lock, so code must
+ * never lock one hashed channel while holding another from the same
+ * table. Channels that are held locked while others get locked
+ * (cv_wait holds the cv's across lock_release) should pass OUTER,
+ * which uses a second table; lock those before any inner ones.
+ *
+ * Threads sleeping on hashed channels show the bucket's name
+ * rather than the object's.
+ */
+struct wchan *wchan_hashed(const void *key, bool outer);
+
 
 #endif /* _WCHAN_H_ */
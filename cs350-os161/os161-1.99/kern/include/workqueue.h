@@ -0,0 +1,53 @@
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Deferred work.
+ *
+ * Each CPU has a workqueue and a kernel thread that runs the items
+ * put on it, one at a time, in order. This is for getting work that
+ * may block, or just takes a while, out of paths that shouldn't wait
+ * for it: thread_switch, exit, interrupt handlers.
+ *
+ * The caller provides the struct work (normally embedded in whatever
+ * the work is about) and it must stay valid until the function has
+ * been called. A work item can be queued again once its function has
+ * started running.
+ *
+ *    work_init      - set up a work item to call FUNC(DATA1, DATA2).
+ *    work_enqueue   - put it on the current cpu's queue. May be called
+ *                     from an interrupt handler. Returns false (and
+ *                     does nothing) if the item is already queued.
+ *                     (The check is made under the current cpu's
+ *                     queue lock only, so an item shouldn't be queued
+ *                     from two cpus at once.)
+ *
+ *    workqueue_bootstrap - call once during startup, after all cpus
+ *                     exist, to start the worker threads. Items may be
+ *                     queued before this; they wait until it's done.
+ *    workqueue_printstats - print queue depth and latency figures.
+ */
+
+struct work {
+	struct work *w_next;		/* Next in the queue */
+	void (*w_func)(void *, unsigned long);	/* What to call */
+	void *w_data1;			/* ...and what to pass it */
+	unsigned long w_data2;
+	uint64_t w_queuedat;		/* getnsecs() when queued */
+	bool w_pending;			/* True while on a queue */
+};
+
+struct workqueue;			/* Opaque; one per cpu */
+
+void work_init(struct work *w, void (*func)(void *, unsigned long),
+	       void *data1, unsigned long data2);
+bool work_enqueue(struct work *w);
+
+/* Used by cpu_create. */
+struct workqueue *workqueue_create(unsigned cpunum);
+
+void workqueue_bootstrap(void);
+void workqueue_printstats(void);
+
+
+#endif /* _WORKQUEUE_H_ */
@@ -38,8 +38,8 @@
  * things they point to. Rearrange this (and/or change it to be a
  * regular lock) as needed.
  *
- * Unless you're implementing multithreaded user processes, the only
- * process that will have more than one thread is the kernel process.
+ * User processes can have more than one thread too; the thread
+ * system calls and the teardown of the extras are in thread_syscalls.c.
  */
 
 #include <types.h>
@@ -50,6 +50,10 @@
 #include <vfs.h>
 #include <synch.h>
 #include <kern/fcntl.h>  
+#include <cpu.h>
+#include <clock.h>
+#include <limits.h>
+#include <kern/errno.h>
 #include "synch.h"
 #include "opt-A2.h"
 /*
@@ -70,6 +74,127 @@ static struct semaphore *proc_count_mutex;
 struct semaphore *no_proc_sem;   
 #endif  // UW
 
+/*
+ * List of all processes, for ps. proc_all_lock is a sleep lock so
+ * the list can be printed while holding it.
+ */
+static struct proc *proc_all;
+static struct lock *proc_all_lock;
+
+static void proc_destroy_work(void *data1, unsigned long data2);
+
+#if OPT_A2
+/*
+ * PID table. A bitmap says which PIDs are in use; allocation searches
+ * it a word at a time from a hint that moves past each PID handed
+ * out, so a PID isn't reused until the others have come round. A hash
+ * chained through p_pidnext maps PIDs to processes. With PID_MAX
+ * fixed, both are plain arrays, protected by pid_lock.
+ *
+ * PID 0 is never used and the kernel gets 1; user processes get
+ * PID_MIN through PID_MAX.
+ */
+#define PID_NWORDS	((PID_MAX + 32) / 32)
+#define PID_HASHSIZE	256
+
+static uint32_t pid_bitmap[PID_NWORDS];
+static pid_t pid_hint = 1;
+static struct proc *pid_hash[PID_HASHSIZE];
+static struct spinlock pid_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Claim a free PID, or return 0 if there are none.
+ */
+static
+pid_t
+pid_alloc(void)
+{
+	uint32_t free;
+	unsigned i, word, bit;
+	pid_t pid;
+
+	spinlock_acquire(&pid_lock);
+	/* Look at the hint's word twice: above the hint, then below it */
+	for (i=0; i<=PID_NWORDS; i++) {
+		word = (pid_hint / 32 + i) % PID_NWORDS;
+		free = ~pid_bitmap[word];
+		if (i == 0) {
+			free &= ~0U << (pid_hint % 32);
+		}
+		if (free == 0) {
+			continue;
+		}
+		for (bit = 0; (free & (1U << bit)) == 0; bit++) {
+			/* nothing */
+		}
+		pid_bitmap[word] |= 1U << bit;
+		pid = word * 32 + bit;
+		pid_hint = pid < PID_MAX ? pid + 1 : PID_MIN;
+		spinlock_release(&pid_lock);
+		return pid;
+	}
+	spinlock_release(&pid_lock);
+	return 0;
+}
+
+/*
+ * Enter a process in the table under the PID it was given.
+ */
+static
+void
+pid_register(struct proc *proc)
+{
+	unsigned h = proc->PID % PID_HASHSIZE;
+
+	spinlock_acquire(&pid_lock);
+	proc->p_pidnext = pid_hash[h];
+	pid_hash[h] = proc;
+	spinlock_release(&pid_lock);
+}
+
+/*
+ * Take a process out of the table and free its PID.
+ */
+static
+void
+pid_release(struct proc *proc)
+{
+	struct proc **pp;
+	pid_t pid = proc->PID;
+
+	spinlock_acquire(&pid_lock);
+	for (pp = &pid_hash[pid % PID_HASHSIZE]; *pp != proc;
+	     pp = &(*pp)->p_pidnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = proc->p_pidnext;
+	KASSERT(pid_bitmap[pid / 32] & (1U << (pid % 32)));
+	pid_bitmap[pid / 32] &= ~(1U << (pid % 32));
+	spinlock_release(&pid_lock);
+}
+
+struct proc *
+proc_lookup(pid_t pid, struct proc *parent)
+{
+	struct proc *proc;
+
+	if (pid <= 0 || pid > PID_MAX) {
+		return NULL;
+	}
+	spinlock_acquire(&pid_lock);
+	for (proc = pid_hash[pid % PID_HASHSIZE]; proc != NULL;
+	     proc = proc->p_pidnext) {
+		if (proc->PID == pid) {
+			break;
+		}
+	}
+	if (proc != NULL && parent != NULL && proc->parent != parent) {
+		proc = NULL;
+	}
+	spinlock_release(&pid_lock);
+	return proc;
+}
+#endif /* OPT_A2 */
 
 
 /*
@@ -92,17 +217,28 @@ proc_create(const char *name)
 	}
 	
 #if OPT_A2
-	lock_acquire(lk_PID_counter);
-	proc->PID = PID_counter; 
-	++PID_counter; 
-	lock_release(lk_PID_counter); 
+	proc->PID = pid_alloc();
+	if (proc->PID == 0) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
 	proc->parent = NULL; 
 	proc->lk_process_info = lock_create("process_children"); 
-	lock_acquire(proc->lk_process_info); 
-	proc->children = array_create();
+	proc->p_children = NULL;
+	proc->p_zombies = NULL;
+	proc->p_sibnext = NULL;
+	proc->p_sibprevp = NULL;
 	proc->exit_status = -1; // has not terminated 	
-	lock_release(proc->lk_process_info); 
+	proc->p_vforkdone = NULL;
 	proc->cv_parent_waitpid = cv_create("process_parent_waitpid"); 
+
+	/* Every process starts out with the one thread that makes it */
+	bzero(proc->p_uthreads, sizeof(proc->p_uthreads));
+	proc->p_uthreads[0].ut_state = UT_LIVE;
+	proc->p_nlive = 1;
+	proc->p_exiting = false;
+	proc->cv_threads = cv_create("process_threads");
 #endif /* OPT_A2 */
 
 	threadarray_init(&proc->p_threads);
@@ -118,6 +254,23 @@ proc_create(const char *name)
 	proc->console = NULL;
 #endif // UW
 
+	work_init(&proc->p_destroywork, proc_destroy_work, proc, 0);
+
+	proc->p_utime = 0;
+	proc->p_stime = 0;
+	proc->p_cutime = 0;
+	proc->p_cstime = 0;
+
+	lock_acquire(proc_all_lock);
+	proc->p_allnext = proc_all;
+	proc_all = proc;
+	lock_release(proc_all_lock);
+
+#if OPT_A2
+	/* Only now that it's all set up can it be found */
+	pid_register(proc);
+#endif
+
 	return proc;
 }
 
@@ -127,6 +280,8 @@ proc_create(const char *name)
 void
 proc_destroy(struct proc *proc)
 {
+	struct proc **pp;
+
 	/*
          * note: some parts of the process structure, such as the address space,
          *  are destroyed in sys_exit, before we get here
@@ -139,6 +294,17 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc != NULL);
 	KASSERT(proc != kproc);
 
+	lock_acquire(proc_all_lock);
+	for (pp = &proc_all; *pp != proc; pp = &(*pp)->p_allnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = proc->p_allnext;
+	lock_release(proc_all_lock);
+
+#if OPT_A2
+	pid_release(proc);
+#endif
+
 	/*
 	 * We don't take p_lock in here because we must have the only
 	 * reference to this structure. (Otherwise it would be
@@ -174,8 +340,9 @@ proc_destroy(struct proc *proc)
 #if OPT_A2
 	lock_destroy(proc->lk_process_info); 
 	cv_destroy(proc->cv_parent_waitpid); 	
-	array_setsize(proc->children, 0); 
-	array_destroy(proc->children); 
+	cv_destroy(proc->cv_threads);
+	KASSERT(proc->p_children == NULL);
+	KASSERT(proc->p_zombies == NULL);
 #endif /* OPT_A2 */
 #ifdef UW
 	if (proc->console) {
@@ -206,17 +373,42 @@ proc_destroy(struct proc *proc)
 
 }
 
+/*
+ * Workqueue function for proc_destroy_async.
+ */
+static
+void
+proc_destroy_work(void *data1, unsigned long data2)
+{
+	(void)data2;
+	proc_destroy(data1);
+}
+
+void
+proc_destroy_async(struct proc *proc)
+{
+	KASSERT(proc != NULL);
+	KASSERT(proc != kproc);
+
+	work_enqueue(&proc->p_destroywork);
+}
+
 /*
  * Create the process structure for the kernel.
  */
 void
 proc_bootstrap(void)
 {
+  proc_all_lock = lock_create("proc_all");
+  if (proc_all_lock == NULL) {
+    panic("could not create proc_all lock\n");
+  }
 #if OPT_A2
-  lk_PID_counter = lock_create("PID_counter"); 
-  lock_acquire(lk_PID_counter); 
-  PID_counter = 1; 
-  lock_release(lk_PID_counter); 
+  /* PID 0 is never handed out, nor any past PID_MAX */
+  pid_bitmap[0] = 1;
+  for (pid_t pid = PID_MAX + 1; pid < PID_NWORDS * 32; pid++) {
+    pid_bitmap[pid / 32] |= 1U << (pid % 32);
+  }
 #endif /* OPT_A2 */
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
@@ -338,6 +530,8 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			proc->p_utime += t->t_utime;
+			proc->p_stime += t->t_stime;
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
 			return;
@@ -348,10 +542,125 @@ proc_remthread(struct thread *t)
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 }
 
+void
+proc_getcputime(struct proc *proc, unsigned *utime, unsigned *stime,
+		unsigned *cutime, unsigned *cstime)
+{
+	struct thread *t;
+	unsigned i, num, u, s;
+
+	spinlock_acquire(&proc->p_lock);
+	u = proc->p_utime;
+	s = proc->p_stime;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		u += t->t_utime;
+		s += t->t_stime;
+	}
+	if (utime != NULL) {
+		*utime = u;
+	}
+	if (stime != NULL) {
+		*stime = s;
+	}
+	if (cutime != NULL) {
+		*cutime = proc->p_cutime;
+	}
+	if (cstime != NULL) {
+		*cstime = proc->p_cstime;
+	}
+	spinlock_release(&proc->p_lock);
+}
+
+void
+proc_chargeparent(struct proc *proc, struct proc *parent)
+{
+	unsigned u, s, cu, cs;
+
+	/* Don't hold both p_locks at once; there's no order for them */
+	proc_getcputime(proc, &u, &s, &cu, &cs);
+
+	spinlock_acquire(&parent->p_lock);
+	parent->p_cutime += u + cu;
+	parent->p_cstime += s + cs;
+	spinlock_release(&parent->p_lock);
+}
+
+/*
+ * Print hardclocks as milliseconds.
+ */
+static
+unsigned
+proc_clockstoms(unsigned clocks)
+{
+	return (unsigned)((uint64_t)clocks * 1000 / HZ);
+}
+
+void
+proc_printall(void)
+{
+	struct proc *proc;
+	struct thread *t;
+	struct cpu *c;
+	char name[16];
+	const char *wchan;
+	unsigned i, num, u, s, cu, cs;
+	int pid;
+
+	kprintf("%5s %-16s %10s %10s %10s %10s\n", "pid", "name",
+		"user(ms)", "sys(ms)", "cuser(ms)", "csys(ms)");
+
+	lock_acquire(proc_all_lock);
+	for (proc = proc_all; proc != NULL; proc = proc->p_allnext) {
+		proc_getcputime(proc, &u, &s, &cu, &cs);
+#if OPT_A2
+		pid = proc->PID;
+#else
+		pid = 0;
+#endif
+		kprintf("%5d %-16s %10u %10u %10u %10u\n", pid, proc->p_name,
+			proc_clockstoms(u), proc_clockstoms(s),
+			proc_clockstoms(cu), proc_clockstoms(cs));
+
+		/*
+		 * Threads can come and go while we print, and we
+		 * can't print under p_lock; copy out one at a time.
+		 */
+		for (i=0; ; i++) {
+			spinlock_acquire(&proc->p_lock);
+			num = threadarray_num(&proc->p_threads);
+			if (i >= num) {
+				spinlock_release(&proc->p_lock);
+				break;
+			}
+			t = threadarray_get(&proc->p_threads, i);
+			snprintf(name, sizeof(name), "%s", t->t_name);
+			wchan = t->t_state == S_SLEEP ? t->t_wchan_name :
+				t->t_state == S_RUN ? "(running)" : "(ready)";
+			u = t->t_utime;
+			s = t->t_stime;
+			spinlock_release(&proc->p_lock);
+
+			kprintf("      %-16s %10u %10u  %s\n", name,
+				proc_clockstoms(u), proc_clockstoms(s), wchan);
+		}
+	}
+	lock_release(proc_all_lock);
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		kprintf("cpu%u: %u ms idle of %u\n", i,
+			proc_clockstoms(c->c_idleclocks),
+			proc_clockstoms(c->c_hardclocks));
+	}
+}
+
 /*
- * Fetch the address space of the current process. Caution: it isn't
- * refcounted. If you implement multithreaded processes, make sure to
- * set up a refcount scheme or some other method to make this safe.
+ * Fetch the address space of the current process. It isn't
+ * refcounted; it's safe because exit and exec, the only things that
+ * replace it, get the process's other threads out first
+ * (proc_stopthreads).
  */
 struct addrspace *
 curproc_getas(void)
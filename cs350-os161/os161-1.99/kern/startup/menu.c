@@ -42,6 +42,12 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <workqueue.h>
+#include <counter.h>
+#include <kprof.h>
+#include <ktrace.h>
+#include <addrspace.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -412,6 +418,288 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing all the registered statistics counters.
+ */
+static
+int
+cmd_stats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	counter_printall();
+
+	return 0;
+}
+
+/*
+ * Command for listing processes and threads with their cpu times.
+ */
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	proc_printall();
+
+	return 0;
+}
+
+/*
+ * Command for scheduler latency histograms.
+ *    schedlat on|off   start or stop keeping them
+ *    schedlat          print them
+ *    schedlat reset    clear them
+ */
+static
+int
+cmd_schedlat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		thread_schedlat_start();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		thread_schedlat_stop();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		thread_schedlat_reset();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: schedlat [on|off|reset]\n");
+		return EINVAL;
+	}
+
+	thread_schedlat_print();
+
+	return 0;
+}
+
+/*
+ * Command for exec latency statistics.
+ *    execstat          print them
+ *    execstat reset    clear them
+ */
+static
+int
+cmd_execstat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		execstat_reset();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: execstat [reset]\n");
+		return EINVAL;
+	}
+
+	execstat_print();
+
+	return 0;
+}
+
+/*
+ * Command for system call statistics.
+ *    sysstat           print the 10 calls taking the most time
+ *    sysstat N         print the top N
+ *    sysstat reset     clear them
+ */
+static
+int
+cmd_sysstat(int nargs, char **args)
+{
+	unsigned n = 10;
+
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		syscallstat_reset();
+		return 0;
+	}
+	if (nargs == 2) {
+		n = atoi(args[1]);
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: sysstat [N | reset]\n");
+		return EINVAL;
+	}
+
+	syscallstat_print(n);
+
+	return 0;
+}
+
+/*
+ * Command for printing workqueue statistics.
+ */
+static
+int
+cmd_wqstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	workqueue_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for lock contention statistics.
+ *    lockstat on|off|reset
+ *    lockstat [N]          print the N (default 10) most contended locks
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int result;
+
+	if (nargs > 2) {
+		kprintf("Usage: lockstat [on|off|reset|count]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 1) {
+		lockstat_print(10);
+	}
+	else if (!strcmp(args[1], "on")) {
+		result = lockstat_start();
+		if (result) {
+			return result;
+		}
+	}
+	else if (!strcmp(args[1], "off")) {
+		lockstat_stop();
+	}
+	else if (!strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else {
+		lockstat_print(atoi(args[1]));
+	}
+
+	return 0;
+}
+
+/*
+ * Command for the sampling profiler.
+ *    kprof on|off|reset
+ *    kprof dump            print the raw PC histogram for host-kprof
+ *    kprof [N [KERNEL]]    print the N (default 20) busiest functions,
+ *                          with symbols from the image KERNEL
+ *                          (default emu0:kernel)
+ */
+static
+int
+cmd_kprof(int nargs, char **args)
+{
+	const char *path = "emu0:kernel";
+	unsigned topn = 20;
+	int result;
+
+	if (nargs > 3) {
+		kprintf("Usage: kprof [on|off|reset|dump|count [kernel]]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		return kprof_start();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		kprof_stop();
+		return 0;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		kprof_reset();
+		return 0;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "dump")) {
+		kprof_dump();
+		return 0;
+	}
+
+	if (nargs > 1) {
+		topn = atoi(args[1]);
+	}
+	if (nargs > 2) {
+		path = args[2];
+	}
+	result = kprof_print(topn, path);
+	if (result) {
+		kprintf("kprof: %s: %s (try kprof dump and host-kprof)\n",
+			path, strerror(result));
+	}
+	return 0;
+}
+
+/*
+ * Command for event tracing.
+ *    ktrace on [EVENT...]  record the named events (default all)
+ *    ktrace off|reset
+ *    ktrace mirror on|off  also send each record to trace161
+ *    ktrace dump [FILE]    stop and print the records for host-ktrace,
+ *                          to the console or to FILE
+ */
+static
+int
+cmd_ktrace(int nargs, char **args)
+{
+	uint32_t mask;
+	unsigned ev;
+	int i, result;
+
+	if (nargs >= 2 && !strcmp(args[1], "on")) {
+		mask = nargs == 2 ? KT_ALL : 0;
+		for (i=2; i<nargs; i++) {
+			for (ev=0; ev<KT_NEVENTS; ev++) {
+				if (!strcmp(args[i], ktrace_eventname(ev))) {
+					break;
+				}
+			}
+			if (ev == KT_NEVENTS) {
+				kprintf("ktrace: unknown event %s; events are",
+					args[i]);
+				for (ev=0; ev<KT_NEVENTS; ev++) {
+					kprintf(" %s", ktrace_eventname(ev));
+				}
+				kprintf("\n");
+				return EINVAL;
+			}
+			mask |= 1U << ev;
+		}
+		return ktrace_start(mask);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		ktrace_stop();
+		return 0;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		ktrace_reset();
+		return 0;
+	}
+	else if (nargs == 3 && !strcmp(args[1], "mirror") &&
+		 (!strcmp(args[2], "on") || !strcmp(args[2], "off"))) {
+		ktrace_mirror(!strcmp(args[2], "on"));
+		return 0;
+	}
+	else if ((nargs == 2 || nargs == 3) && !strcmp(args[1], "dump")) {
+		result = ktrace_dump(nargs == 3 ? args[2] : NULL);
+		if (result) {
+			kprintf("ktrace: %s: %s\n",
+				nargs == 3 ? args[2] : "dump", strerror(result));
+		}
+		return 0;
+	}
+
+	kprintf("Usage: ktrace on [event...] | off | reset | "
+		"mirror on|off | dump [file]\n");
+	return EINVAL;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -476,12 +764,20 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tfb] Thread fork benchmark         ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Rwlock test                   ",
+	"[sy5] Timed wait test               ",
+	"[rwb] Rwlock benchmark              ",
+	"[slb] Spinlock benchmark            ",
+	"[ppb] Ping-pong benchmark           ",
+	"[scb] Synch create benchmark        ",
+	"[pi]  Priority inversion test       ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -522,6 +818,15 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[lockstat] Lock contention stats    ",
+	"[kprof] Kernel profiler             ",
+	"[ktrace] Kernel event tracing       ",
+	"[wq] Workqueue stats                ",
+	"[stats] Statistics counters         ",
+	"[ps] Processes and cpu times        ",
+	"[schedlat] Scheduler latency        ",
+	"[execstat] Exec latency             ",
+	"[sysstat] System call counts/times  ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -579,6 +884,15 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "lockstat",	cmd_lockstat },
+	{ "kprof",	cmd_kprof },
+	{ "ktrace",	cmd_ktrace },
+	{ "wq",		cmd_wqstats },
+	{ "stats",	cmd_stats },
+	{ "ps",		cmd_ps },
+	{ "schedlat",	cmd_schedlat },
+	{ "execstat",	cmd_execstat },
+	{ "sysstat",	cmd_sysstat },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -591,11 +905,19 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tfb",	threadforkbench },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	rwtest },
+	{ "sy5",	timedwaittest },
+	{ "rwb",	rwbench },
+	{ "slb",	spinlockbench },
+	{ "ppb",	pingpongbench },
+	{ "scb",	createbench },
+	{ "pi",		pitest },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
@@ -0,0 +1,129 @@
+/*
+ * futex(): sleep on, and wake up threads sleeping on, a word of user
+ * memory. The operations are described in <kern/futex.h>.
+ */
+
+#include "opt-A2.h"
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/futex.h>
+#include <lib.h>
+#include <machine/membar.h>
+#include <addrspace.h>
+#include <current.h>
+#include <proc.h>
+#include <thread.h>
+#include <vm.h>
+#include <wchan.h>
+#include <syscall.h>
+
+/*
+ * Find the word UADDR refers to, by its kernel address. That's what
+ * sleepers are keyed by in the hashed wait channels, so the same
+ * physical word is the same futex whichever process maps it where.
+ * Kernel objects are never in user pages, so it can't collide with
+ * the kernel's own hashed channels either.
+ */
+static
+int
+futex_lookup(userptr_t uaddr, volatile int **ret)
+{
+	struct addrspace *as;
+	paddr_t paddr;
+	int result;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	as = curproc_getas();
+	if (as == NULL) {
+		return EFAULT;
+	}
+	result = as_translate(as, (vaddr_t)uaddr, &paddr);
+	if (result) {
+		return result;
+	}
+	*ret = (volatile int *)PADDR_TO_KVADDR(paddr);
+	return 0;
+}
+
+int
+sys_futex(userptr_t uaddr, int op, int val, int *retval)
+{
+	volatile int *word;
+	struct wchan *wc;
+	int result;
+
+	if (op != FUTEX_WAIT && op != FUTEX_WAKE) {
+		return EINVAL;
+	}
+	result = futex_lookup(uaddr, &word);
+	if (result) {
+		return result;
+	}
+	wc = wchan_hashed((const void *)word, false);
+
+	if (op == FUTEX_WAKE) {
+		*retval = val > 0 ? wchan_wakesome(wc, val) : 0;
+		return 0;
+	}
+
+	/*
+	 * Check the word with the channel locked: a waker changes the
+	 * word before calling FUTEX_WAKE, which needs the same lock, so
+	 * either we see the change or we're asleep when the wake comes.
+	 *
+	 * Likewise with p_exiting: proc_stopthreads sets it and then
+	 * looks at t_futex, and we set t_futex and then look at it, so
+	 * either we see it or it finds us and wakes us.
+	 */
+	wchan_lock(wc);
+	curthread->t_futex = word;
+#if OPT_A2
+	membar_any_any();
+	if (curproc->p_exiting) {
+		curthread->t_futex = NULL;
+		wchan_unlock(wc);
+		return EINTR;
+	}
+#endif
+	if (*word != val) {
+		curthread->t_futex = NULL;
+		wchan_unlock(wc);
+		return EAGAIN;
+	}
+	wchan_sleep(wc);
+	curthread->t_futex = NULL;
+	*retval = 0;
+	return 0;
+}
+
+#if OPT_A2
+/*
+ * Wake every thread of P that's sleeping in FUTEX_WAIT. Threads can
+ * come and go while we look, and we can't wake anyone under p_lock;
+ * take the threads one at a time.
+ */
+void
+futex_wakeproc(struct proc *p)
+{
+	volatile const void *word;
+	struct thread *t;
+	unsigned i;
+
+	for (i=0; ; i++) {
+		spinlock_acquire(&p->p_lock);
+		if (i >= threadarray_num(&p->p_threads)) {
+			spinlock_release(&p->p_lock);
+			break;
+		}
+		t = threadarray_get(&p->p_threads, i);
+		word = t->t_futex;
+		spinlock_release(&p->p_lock);
+
+		if (word != NULL) {
+			wchan_wakeall(wchan_hashed((const void *)word, false));
+		}
+	}
+}
+#endif /* OPT_A2 */
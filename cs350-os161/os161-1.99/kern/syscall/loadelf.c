@@ -31,6 +31,10 @@
 /*
  * Code to load an ELF-format executable into the current address space.
  *
+ * The headers are parsed once per executable and the result cached
+ * on its vnode; later execs of the same file skip straight to loading
+ * the segments. A write or truncate of the file throws the cache away.
+ *
  * It makes the following address space calls:
  *    - first, as_define_region once for each segment of the program;
  *    - then, as_prepare_load;
@@ -53,6 +57,8 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <spinlock.h>
+#include <clock.h>
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
@@ -146,21 +152,19 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
- *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Read the executable header and program headers and check them.
+ * Fills in EI with the entry point and the loadable segments.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+elf_parse(struct vnode *v, struct elfimage *ei)
 {
 	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
+	struct elfseg *es;
 	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
-
-	as = curproc_getas();
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -203,12 +207,12 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	}
 
 	/*
-	 * Go through the list of segments and set up the address space.
+	 * Go through the list of segments and remember the loadable
+	 * ones.
 	 *
 	 * Ordinarily there will be one code segment, one read-only
 	 * data segment, and one data/bss segment, but there might
-	 * conceivably be more. You don't need to support such files
-	 * if it's unduly awkward to do so.
+	 * conceivably be more, up to ELFIMAGE_MAXSEGS.
 	 *
 	 * Note that the expression eh.e_phoff + i*eh.e_phentsize is 
 	 * mandated by the ELF standard - we use sizeof(ph) to load,
@@ -217,6 +221,8 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * to find where the phdr starts.
 	 */
 
+	ei->ei_entry = eh.e_entry;
+	ei->ei_nsegs = 0;
 	for (i=0; i<eh.e_phnum; i++) {
 		off_t offset = eh.e_phoff + i*eh.e_phentsize;
 		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
@@ -243,54 +249,214 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
-		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
-		if (result) {
-			return result;
+		if (ei->ei_nsegs == ELFIMAGE_MAXSEGS) {
+			kprintf("loadelf: more than %d segments\n",
+				ELFIMAGE_MAXSEGS);
+			return ENOEXEC;
 		}
+		es = &ei->ei_segs[ei->ei_nsegs++];
+		es->es_offset = ph.p_offset;
+		es->es_vaddr = ph.p_vaddr;
+		es->es_memsz = ph.p_memsz;
+		es->es_filesz = ph.p_filesz;
+		es->es_flags = ph.p_flags;
 	}
 
-	result = as_prepare_load(as);
+	return 0;
+}
+
+/*
+ * The vnodes with cached images. Each entry holds a reference to its
+ * vnode; otherwise the vfs_close at the end of every exec would drop
+ * the last one, the vnode would be reclaimed, and the image with it.
+ * Only ELFCACHE_SIZE are kept, replaced round robin, and one pushed
+ * out loses its image along with the reference. elfcache_purge lets
+ * go of them so a filesystem can be unmounted.
+ */
+#define ELFCACHE_SIZE 8
+
+static struct spinlock elfcache_lock = SPINLOCK_INITIALIZER;
+static struct vnode *elfcache[ELFCACHE_SIZE];
+static unsigned elfcache_next;
+
+/*
+ * Drop V's cached image and the cache's reference to V.
+ */
+static
+void
+elfcache_release(struct vnode *v)
+{
+	struct elfimage *ei;
+
+	spinlock_acquire(&v->vn_imagelock);
+	ei = v->vn_image;
+	v->vn_image = NULL;
+	spinlock_release(&v->vn_imagelock);
+
+	kfree(ei);
+	VOP_DECREF(v);
+}
+
+/*
+ * V now has a cached image; keep a reference to it, if we don't
+ * already, pushing out the oldest entry if need be.
+ */
+static
+void
+elfcache_add(struct vnode *v)
+{
+	struct vnode *old;
+	unsigned i;
+
+	/* Not under the spinlock; it takes the vfs big lock */
+	VOP_INCREF(v);
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (elfcache[i] == v) {
+			spinlock_release(&elfcache_lock);
+			VOP_DECREF(v);
+			return;
+		}
+	}
+	old = elfcache[elfcache_next];
+	elfcache[elfcache_next] = v;
+	elfcache_next = (elfcache_next + 1) % ELFCACHE_SIZE;
+	spinlock_release(&elfcache_lock);
+
+	if (old != NULL) {
+		elfcache_release(old);
+	}
+}
+
+void
+elfcache_purge(struct fs *fs)
+{
+	struct vnode *v;
+	unsigned i;
+
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		spinlock_acquire(&elfcache_lock);
+		v = elfcache[i];
+		if (v != NULL && (fs == NULL || v->vn_fs == fs)) {
+			elfcache[i] = NULL;
+		}
+		else {
+			v = NULL;
+		}
+		spinlock_release(&elfcache_lock);
+
+		if (v != NULL) {
+			elfcache_release(v);
+		}
+	}
+}
+
+/*
+ * Get the parsed headers of the executable V into EI: from the copy
+ * cached on the vnode if there is one, otherwise by reading them and
+ * then caching them. If the file is written or truncated while we're
+ * reading it, vn_imagegen moves (or vn_imagewriters is nonzero) and
+ * what we read isn't cached.
+ */
+int
+elf_getimage(struct vnode *v, struct elfimage *ei)
+{
+	struct elfimage *copy;
+	uint64_t start;
+	unsigned gen;
+	int result;
+
+	start = getnsecs();
+	spinlock_acquire(&v->vn_imagelock);
+	if (v->vn_image != NULL) {
+		*ei = *v->vn_image;
+		spinlock_release(&v->vn_imagelock);
+		execstat_cache(true);
+		execstat_add(EXECSTAT_PARSE, getnsecs() - start);
+		return 0;
+	}
+	gen = v->vn_imagegen;
+	spinlock_release(&v->vn_imagelock);
+	execstat_cache(false);
+
+	result = elf_parse(v, ei);
 	if (result) {
 		return result;
 	}
+	execstat_add(EXECSTAT_PARSE, getnsecs() - start);
+
+	/* Failing to cache it doesn't fail the exec */
+	copy = kmalloc(sizeof(*copy));
+	if (copy == NULL) {
+		return 0;
+	}
+	*copy = *ei;
+
+	spinlock_acquire(&v->vn_imagelock);
+	if (v->vn_image == NULL && v->vn_imagegen == gen &&
+	    v->vn_imagewriters == 0) {
+		v->vn_image = copy;
+		copy = NULL;
+	}
+	spinlock_release(&v->vn_imagelock);
+
+	if (copy == NULL) {
+		elfcache_add(v);
+	}
+	kfree(copy);
+	return 0;
+}
+
+/*
+ * Load the ELF executable V, whose headers elf_getimage put in EI,
+ * into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elfimage(struct vnode *v, const struct elfimage *ei,
+	      vaddr_t *entrypoint)
+{
+	const struct elfseg *es;
+	struct addrspace *as;
+	uint64_t start;
+	unsigned i;
+	int result;
+
+	as = curproc_getas();
+	start = getnsecs();
 
 	/*
-	 * Now actually load each segment.
+	 * Set up the address space.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
+	for (i=0; i<ei->ei_nsegs; i++) {
+		es = &ei->ei_segs[i];
+		result = as_define_region(as,
+					  es->es_vaddr, es->es_memsz,
+					  es->es_flags & PF_R,
+					  es->es_flags & PF_W,
+					  es->es_flags & PF_X);
 		if (result) {
 			return result;
 		}
+	}
 
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
+	result = as_prepare_load(as);
+	if (result) {
+		return result;
+	}
 
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n", 
-				ph.p_type);
-			return ENOEXEC;
-		}
+	/*
+	 * Now actually load each segment.
+	 */
 
-		result = load_segment(as, v, ph.p_offset, ph.p_vaddr, 
-				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
+	for (i=0; i<ei->ei_nsegs; i++) {
+		es = &ei->ei_segs[i];
+		result = load_segment(as, v, es->es_offset, es->es_vaddr, 
+				      es->es_memsz, es->es_filesz,
+				      es->es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -301,12 +467,115 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
-	*entrypoint = eh.e_entry;
+	*entrypoint = ei->ei_entry;
 
 #if OPT_A3
 	as->load_complete = true; 
 	
 	as_activate(); 
 #endif
+	execstat_add(EXECSTAT_LOAD, getnsecs() - start);
 	return 0;
 }
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct elfimage ei;
+	int result;
+
+	result = elf_getimage(v, &ei);
+	if (result) {
+		return result;
+	}
+	return load_elfimage(v, &ei, entrypoint);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Exec latency statistics.
+
+static const char *const execstat_names[EXECSTAT_NPHASES] = {
+	"open",
+	"parse",
+	"load",
+	"stack",
+};
+
+static struct spinlock execstat_lock = SPINLOCK_INITIALIZER;
+static uint64_t execstat_total[EXECSTAT_NPHASES];	/* nsecs */
+static uint64_t execstat_max[EXECSTAT_NPHASES];
+static unsigned execstat_count[EXECSTAT_NPHASES];
+static unsigned execstat_hits, execstat_misses;
+
+void
+execstat_add(unsigned phase, uint64_t nsecs)
+{
+	KASSERT(phase < EXECSTAT_NPHASES);
+
+	spinlock_acquire(&execstat_lock);
+	execstat_total[phase] += nsecs;
+	if (nsecs > execstat_max[phase]) {
+		execstat_max[phase] = nsecs;
+	}
+	execstat_count[phase]++;
+	spinlock_release(&execstat_lock);
+}
+
+void
+execstat_cache(bool hit)
+{
+	spinlock_acquire(&execstat_lock);
+	if (hit) {
+		execstat_hits++;
+	}
+	else {
+		execstat_misses++;
+	}
+	spinlock_release(&execstat_lock);
+}
+
+void
+execstat_print(void)
+{
+	uint64_t total[EXECSTAT_NPHASES], max[EXECSTAT_NPHASES];
+	unsigned count[EXECSTAT_NPHASES], hits, misses, i;
+
+	/* Snapshot, so as not to print with a spinlock held */
+	spinlock_acquire(&execstat_lock);
+	for (i=0; i<EXECSTAT_NPHASES; i++) {
+		total[i] = execstat_total[i];
+		max[i] = execstat_max[i];
+		count[i] = execstat_count[i];
+	}
+	hits = execstat_hits;
+	misses = execstat_misses;
+	spinlock_release(&execstat_lock);
+
+	kprintf("Exec latency (usecs):\n");
+	kprintf("%-6s %9s %12s %10s %10s\n", "phase", "count", "total",
+		"avg", "max");
+	for (i=0; i<EXECSTAT_NPHASES; i++) {
+		kprintf("%-6s %9u %12llu %10llu %10llu\n", execstat_names[i],
+			count[i], total[i] / 1000,
+			count[i] ? total[i] / count[i] / 1000 : 0ULL,
+			max[i] / 1000);
+	}
+	kprintf("Header cache: %u hits, %u misses\n", hits, misses);
+}
+
+void
+execstat_reset(void)
+{
+	spinlock_acquire(&execstat_lock);
+	bzero(execstat_total, sizeof(execstat_total));
+	bzero(execstat_max, sizeof(execstat_max));
+	bzero(execstat_count, sizeof(execstat_count));
+	execstat_hits = execstat_misses = 0;
+	spinlock_release(&execstat_lock);
+}
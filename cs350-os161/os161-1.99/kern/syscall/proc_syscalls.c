@@ -4,6 +4,8 @@
 #include <kern/errno.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <lib.h>
 #include <syscall.h>
 #include <current.h>
@@ -11,96 +13,140 @@
 #include <thread.h>
 #include <addrspace.h>
 #include <copyinout.h>
+#include <clock.h>
 
 #if OPT_A2
 #include "vfs.h"
 #include "../include/kern/fcntl.h" // O_RDONLY
-#include "../include/kern/limits.h" // PATH_MAX
+#include "../include/kern/limits.h" // PATH_MAX, ARG_MAX
 #include "copyinout.h"
 //#include 
 #endif /* OPT_A2 */
 
-// copied directly from sys__exit
-void sys__kill (int exitcode) {
-  //kprintf ("kill called!"); 
-  struct addrspace *as;
-  struct proc *p = curproc;
-  lock_acquire(curproc->lk_process_info);
+#if OPT_A2
+/*
+ * Put a process on one of its parent's child lists, or take it off.
+ * The parent's lk_process_info must be held.
+ */
+static
+void
+child_link(struct proc **list, struct proc *child)
+{
+  child->p_sibnext = *list;
+  if (*list != NULL) {
+	  (*list)->p_sibprevp = &child->p_sibnext;
+  }
+  child->p_sibprevp = list;
+  *list = child;
+}
 
-  curproc->exit_status = __WSIGNALED; // modification: changed exit_status
-  curproc->exit_code = exitcode;
+static
+void
+child_unlink(struct proc *child)
+{
+  *child->p_sibprevp = child->p_sibnext;
+  if (child->p_sibnext != NULL) {
+	  child->p_sibnext->p_sibprevp = child->p_sibprevp;
+  }
+  child->p_sibnext = NULL;
+  child->p_sibprevp = NULL;
+}
 
-  int num = array_num(curproc->children);
+/*
+ * Cut the children in LIST loose when their parent exits. Those
+ * that have already exited are ours to destroy; the rest will destroy
+ * themselves. Called without the parent's lock, per the lock order.
+ */
+static
+void
+orphan_children(struct proc *list)
+{
   struct proc *curChild;
-  for (int i = 0; i < num; ++i) {
-	curChild = array_get(curproc->children, i); 
+  bool zombie;
+
+  while (list != NULL) {
+	curChild = list;
+	list = curChild->p_sibnext;
 	lock_acquire(curChild->lk_process_info);
 	curChild->parent = NULL;
-	if(curChild->exit_status != -1) {
-		lock_release(curChild->lk_process_info); 
-		proc_destroy(curChild); 
-	}
-	else {
-		lock_release(curChild->lk_process_info); 
+	curChild->p_sibnext = NULL;
+	curChild->p_sibprevp = NULL;
+	zombie = curChild->exit_status != -1;
+	lock_release(curChild->lk_process_info); 
+	if (zombie) {
+		proc_destroy_async(curChild); 
 	}
   }
-	
-  lock_release(curproc->lk_process_info); 
-  cv_signal (curproc->cv_parent_waitpid, curproc->lk_process_info); // wake up parent
- KASSERT(curproc->p_addrspace != NULL);
-  as_deactivate();
-  as = curproc_setas(NULL);
- 
-  as_destroy(as);
-  
- proc_remthread(curthread);
-
-  if (p->parent == NULL) {
-	  proc_destroy(p);
-  }
-  thread_exit();
 }
 
+/*
+ * If P is a vfork child still running in its parent's address space,
+ * it has just stopped using it, by exiting or exec'ing: let the parent
+ * go. Returns true if the address space was borrowed, in which case
+ * it isn't the caller's to destroy.
+ */
+static
+bool
+vfork_release(struct proc *p)
+{
+  struct semaphore *done = p->p_vforkdone;
 
+  if (done == NULL) {
+	  return false;
+  }
+  p->p_vforkdone = NULL;
+  V(done);
+  return true;
+}
 
-
-void sys__exit(int exitcode) {
+/*
+ * The process side of _exit and of being killed. Our exit status is
+ * only posted once this thread is out of the process: whoever sees it
+ * (the parent in waitpid, or the parent on its own way out) may
+ * destroy the process on the spot.
+ */
+static
+void
+proc_exit(int exitstatus, int exitcode)
+{
   struct addrspace *as;
   struct proc *p = curproc;
-  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
-#if OPT_A2
-  lock_acquire(curproc->lk_process_info);
+  struct proc *parent, *children, *zombies, *curChild;
 
-  // set exit status and code
-  curproc->exit_status = __WEXITED;
-  curproc->exit_code = exitcode;
+  // the other threads go first; if one of them is already taking
+  // the process down, its exit status is the one that counts
+  if (!proc_stopthreads()) {
+	  proc_threadleave();
+  }
 
-  // delete dead children and notify living children of parent's death
-  int num = array_num(curproc->children);
-  struct proc *curChild;
-  for (int i = 0; i < num; ++i) {
-	curChild = array_get(curproc->children, i); 
-	lock_acquire(curChild->lk_process_info);
-	curChild->parent = NULL;
-        // delete zombie processes	
-	if(curChild->exit_status != -1) {
-		lock_release(curChild->lk_process_info); 
-		//kprintf ("deleting dead children with PID %d\n", curChild->PID); 
-		proc_destroy(curChild); 
-	}
-	else {
-		lock_release(curChild->lk_process_info); 
-	}
+  lock_acquire(p->lk_process_info);
+
+  // our cpu time goes to the parent; it can't go away while we hold
+  // our lock, since it needs our lock to orphan us
+  if (p->parent != NULL) {
+	  proc_chargeparent(p, p->parent);
   }
-	
-  lock_release(curproc->lk_process_info); 
-  cv_signal (curproc->cv_parent_waitpid, curproc->lk_process_info); // wake up parent
-#else
-  /* for now, just include this to keep the compiler from complaining about
-     an unused variable */
-  (void)exitcode;
-#endif /* OPT_A2 */
-  KASSERT(curproc->p_addrspace != NULL);
+  p->exit_code = exitcode;
+
+  // take the children off our lists; a child that's off its
+  // parent's lists leaves its p_sibnext alone (see below)
+  children = p->p_children;
+  zombies = p->p_zombies;
+  p->p_children = NULL;
+  p->p_zombies = NULL;
+  for (curChild = children; curChild != NULL; curChild = curChild->p_sibnext) {
+	  curChild->p_sibprevp = NULL;
+  }
+  for (curChild = zombies; curChild != NULL; curChild = curChild->p_sibnext) {
+	  curChild->p_sibprevp = NULL;
+  }
+  lock_release(p->lk_process_info); 
+
+  // delete dead children and notify living children of parent's death
+  orphan_children(zombies);
+  orphan_children(children);
+
+  KASSERT(p->p_addrspace != NULL);
   as_deactivate();
   /*
    * clear p_addrspace before calling as_destroy. Otherwise if
@@ -110,23 +156,69 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
- 
-  as_destroy(as);
+  if (!vfork_release(p)) {
+	  as_destroy(as);
+  }
+
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
-  
- proc_remthread(curthread);
+  proc_remthread(curthread);
+
+  // now tell the parent, or clean up ourselves if there isn't one
+  lock_acquire(p->lk_process_info);
+  parent = p->parent;
+  if (parent != NULL) {
+	  lock_acquire(parent->lk_process_info);
+	  p->exit_status = exitstatus;
+	  // unless the parent is exiting too and has taken us off already
+	  if (p->p_sibprevp != NULL) {
+		  child_unlink(p);
+		  child_link(&parent->p_zombies, p);
+	  }
+	  cv_broadcast(parent->cv_parent_waitpid, parent->lk_process_info); // wake up parent
+	  lock_release(parent->lk_process_info);
+  }
+  else {
+	  p->exit_status = exitstatus;
+  }
+  lock_release(p->lk_process_info);
 
   /* if this is the last user process in the system, proc_destroy()
      will wake up the kernel menu thread */
-#if OPT_A2 // do not destroy the process if it has a parent
-  if (p->parent == NULL) {
-	//kprintf ("destroying proc with no parent, PID %d\n", p->PID); 
-	  proc_destroy(p);
+  if (parent == NULL) {
+	  proc_destroy_async(p);
   }
+}
+#endif /* OPT_A2 */
+
+void sys__kill (int exitcode) {
+#if OPT_A2
+  proc_exit(__WSIGNALED, exitcode);
+  thread_exit();
 #else
-  proc_destroy(p);
-#endif 
+  sys__exit(exitcode);
+#endif /* OPT_A2 */
+}
+
+
+void sys__exit(int exitcode) {
+  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+#if OPT_A2
+  proc_exit(__WEXITED, exitcode);
+#else
+  struct addrspace *as;
+  struct proc *p = curproc;
+  /* for now, just include this to keep the compiler from complaining about
+     an unused variable */
+  (void)exitcode;
+
+  KASSERT(curproc->p_addrspace != NULL);
+  as_deactivate();
+  as = curproc_setas(NULL);
+  as_destroy(as);
+  proc_remthread(curthread);
+  proc_destroy_async(p);
+#endif /* OPT_A2 */
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
   panic("return from thread_exit in sys_exit\n");
@@ -147,7 +239,64 @@ sys_getpid(pid_t *retval)
   return(0);
 }
 
-/* stub handler for waitpid() system call                */
+/*
+ * Convert hardclocks to a timeval for getrusage.
+ */
+static
+void
+clockstotimeval(unsigned clocks, struct timeval *tv)
+{
+  tv->tv_sec = clocks / HZ;
+  tv->tv_usec = (clocks % HZ) * (1000000 / HZ);
+}
+
+/* handler for getrusage() system call; only the times are filled in */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+  struct rusage ru;
+  unsigned utime, stime, cutime, cstime;
+
+  proc_getcputime(curproc, &utime, &stime, &cutime, &cstime);
+
+  bzero(&ru, sizeof(ru));
+  switch (who) {
+  case RUSAGE_SELF:
+    clockstotimeval(utime, &ru.ru_utime);
+    clockstotimeval(stime, &ru.ru_stime);
+    break;
+  case RUSAGE_CHILDREN:
+    clockstotimeval(cutime, &ru.ru_utime);
+    clockstotimeval(cstime, &ru.ru_stime);
+    break;
+  default:
+    return EINVAL;
+  }
+
+  return copyout(&ru, usage, sizeof(ru));
+}
+
+/*
+ * handlers for setaffinity() and getaffinity(): these apply to the
+ * calling thread, and children inherit the setting through fork
+ */
+int
+sys_setaffinity(uint32_t mask)
+{
+  return thread_setaffinity(mask);
+}
+
+int
+sys_getaffinity(userptr_t mask)
+{
+  uint32_t kmask;
+
+  kmask = thread_getaffinity();
+  return copyout(&kmask, mask, sizeof(kmask));
+}
+
+/* handler for waitpid() system call; pid may be WAIT_ANY, and
+   options may be WNOHANG */
 
 int
 sys_waitpid(pid_t pid,
@@ -155,44 +304,100 @@ sys_waitpid(pid_t pid,
 	    int options,
 	    pid_t *retval)
 {
-	 if (options != 0) {
-    		return(EINVAL);
-   	 }
 	 int exitstatus;
   	 int result;
 
-
 #if OPT_A2
-	lock_acquire(curproc->lk_process_info);
-	// check if called process is child process
-	int children_count = array_num(curproc->children);
-	bool found = false;
-        struct proc *curChild = NULL; 	
-	for (int i = 0; i < children_count; ++i) {
-		curChild = curproc->children->v[i];
-		if(curChild->PID == pid) {
-	 		found = true;
-			break; 	
+	struct proc *p = curproc;
+	struct proc *curChild;
+
+	if ((options & ~WNOHANG) != 0) {
+		return EINVAL;
+	}
+	// there are no process groups, so no other magic PIDs
+	if (pid <= 0 && pid != WAIT_ANY) {
+		return EINVAL;
+	}
+
+	lock_acquire(p->lk_process_info);
+	while (1) {
+		// another thread is taking the process down
+		if (p->p_exiting) {
+			lock_release(p->lk_process_info);
+			return EINTR;
 		}
+		if (pid == WAIT_ANY) {
+			curChild = p->p_zombies;
+			if (curChild == NULL && p->p_children == NULL) {
+				lock_release(p->lk_process_info);
+				return ECHILD;
+			}
+		}
+		else {
+			// only we (this thread or another of ours) can reap
+			// or orphan it, so it stays put while we hold our lock
+			curChild = proc_lookup(pid, p);
+			if (curChild == NULL) {
+				lock_release(p->lk_process_info);
+				return ECHILD;
+			}
+			// off our lists: another of our threads is reaping it
+			if (curChild->exit_status == -1 ||
+			    curChild->p_sibprevp == NULL) {
+				curChild = NULL;
+			}
+		}
+		if (curChild != NULL) {
+			break;
+		}
+		if (options & WNOHANG) {
+			lock_release(p->lk_process_info);
+			*retval = 0;
+			return 0;
+		}
+		cv_wait(p->cv_parent_waitpid, p->lk_process_info);
 	}
-        if (!found) {
-		lock_release(curproc->lk_process_info); 
-		return ECHILD; 
+	// its exit code was set before it went on the zombie list; one
+	// killed by a fault (sys__kill) has the signal as its code
+	if (curChild->exit_status == __WSIGNALED) {
+		exitstatus = _MKWAIT_SIG(curChild->exit_code);
 	}
-	lock_release(curproc->lk_process_info);
-	lock_acquire(curChild->lk_process_info); 	
-	while (curChild->exit_status == -1) { 
-		cv_wait (curChild->cv_parent_waitpid, curChild->lk_process_info);  
+	else {
+		exitstatus = _MKWAIT_EXIT(curChild->exit_code);
+	}
+	// claim it before letting go of the lock, so no other thread of
+	// ours can pick it too
+	child_unlink(curChild);
+	lock_release(p->lk_process_info);
+
+	// if the status can't be handed over, leave the child for next time
+	result = copyout((void *)&exitstatus,status,sizeof(int));
+	if (result) {
+		lock_acquire(p->lk_process_info);
+		child_link(&p->p_zombies, curChild);
+		cv_broadcast(p->cv_parent_waitpid, p->lk_process_info);
+		lock_release(p->lk_process_info);
+		return result;
 	}
-//	kprintf ("exit code: %d exit status: %d \n", curChild->exit_code, curChild->exit_status); 
-	exitstatus = _MKWAIT_EXIT(curChild->exit_code);
-  //     kprintf ("combined status %d\n", exitstatus); 	
+	*retval = curChild->PID;
+
+	// fully delete child here after waitpid has been called, which
+	// frees its PID for reuse; taking its lock waits until it is done
+	// with it on its way out
+	lock_acquire(curChild->lk_process_info);
 	lock_release(curChild->lk_process_info);
-   	
-	// fully delete child here after waitpid has been called
-	// not needed because parent will delete all its dead children when parent exits
-	// proc_destroy(curChild); 	
+	proc_destroy(curChild); 	
+
+	// anyone waiting for it by PID will now find it gone
+	lock_acquire(p->lk_process_info);
+	cv_broadcast(p->cv_parent_waitpid, p->lk_process_info);
+	lock_release(p->lk_process_info);
+	return 0;
 #else
+	 if (options != 0) {
+    		return(EINVAL);
+   	 }
+
   /* this is just a stub implementation that always reports an
      exit status of 0, regardless of the actual exit status of
      the specified process.   
@@ -205,49 +410,49 @@ sys_waitpid(pid_t pid,
 
   /* for now, just pretend the exitstatus is 0 */
   exitstatus = 0;
-#endif /* OPT_A2 */
   result = copyout((void *)&exitstatus,status,sizeof(int));
   if (result) {
     return(result);
   }
   *retval = pid;
   return(0);
+#endif /* OPT_A2 */
 }
 
 #if OPT_A2 
 #include "mips/trapframe.h" // to add definition of trapframe in
 
-// tf is the trapframe passed in from the system call dispatcher
-int sys_fork (struct trapframe *tf, pid_t *retval){
+/*
+ * fork and vfork. For vfork (SHARE), the child borrows our address
+ * space instead of getting a copy, and we sleep until it is done with
+ * it, which it says through vfork_release when it execs or exits.
+ */
+static int fork_common (struct trapframe *tf, bool share, pid_t *retval){
 	struct proc *child = proc_create_runprogram(curproc->p_name); 
 	// proc_create_runprogram will also add PID, and initialize children
 	if (child == NULL) {
 		return ENOMEM; 
 	}
-	// add parent for child
-	child->parent = curproc; 
-	if(child->children==NULL) {
-		lock_release(child->lk_process_info); 
-	       return ENOMEM; // not enough memory to create dynamic array to store children 
-	}
 	int status; // stores all return values
-	
-	// add child to parent	
-	lock_acquire(curproc->lk_process_info); 
-	array_add(curproc->children, child, (unsigned *)&status);
-	lock_release(curproc->lk_process_info); 	
 
-	if(status < 0) {
-		return ENOMEM; 
-	}
-
-	// copy address space
+	// copy address space, or share it
 	struct addrspace *child_as; 
-	status = as_copy(curproc->p_addrspace, &child_as); 
-	if (status != 0) {
-		proc_destroy(child); 
-		as_destroy(child_as); 
-		return ENOMEM; 
+	struct semaphore *vforkdone = NULL;
+	if (share) {
+		vforkdone = sem_create("vfork", 0);
+		if (vforkdone == NULL) {
+			proc_destroy(child); 
+			return ENOMEM; 
+		}
+		child_as = curproc->p_addrspace;
+		child->p_vforkdone = vforkdone;
+	}
+	else {
+		status = as_copy(curproc->p_addrspace, &child_as); 
+		if (status != 0) {
+			proc_destroy(child); 
+			return ENOMEM; 
+		}
 	}
 	// safely attach to child->p_addrspace
 	spinlock_acquire(&child->p_lock); 
@@ -257,129 +462,205 @@ int sys_fork (struct trapframe *tf, pid_t *retval){
 	// place parent's stack frame in the heap
 	struct trapframe *tf_backup = kmalloc(sizeof(struct trapframe)); 	
 	if (tf_backup == NULL) {
-		proc_destroy(child); 
-		as_destroy(child_as); 
-		return ENOMEM; 
+		status = ENOMEM;
+		goto fail;
 	}	
 	*tf_backup = *(struct trapframe *)tf; // copy values
 
+	// add parent for child, and child to parent
+	child->parent = curproc; 
+	lock_acquire(curproc->lk_process_info); 
+	child_link(&curproc->p_children, child);
+	lock_release(curproc->lk_process_info); 	
+
 	// create child's thread
 	void (*f_ptr)(void * data1, unsigned long data2) = (void *)&enter_forked_process; 
 	status = thread_fork (child->p_name, child, f_ptr, tf_backup, 0);
 	if (status) { // if an error occurs -> status != 0
-		proc_destroy(child);
-		as_destroy(child_as); 
+		lock_acquire(curproc->lk_process_info); 
+		child_unlink(child);
+		lock_release(curproc->lk_process_info); 	
 		kfree (tf_backup); 
-		return status; // return the error returned by thread_fork
+		goto fail; // return the error returned by thread_fork
 	}	
 	*retval = child->PID;
+	if (share) {
+		P(vforkdone);
+		sem_destroy(vforkdone);
+	}
 	return 0;
+
+ fail:
+	proc_destroy(child);
+	if (share) {
+		sem_destroy(vforkdone);
+	}
+	else {
+		as_destroy(child_as); 
+	}
+	return status;
 }
 
-const size_t MAX_ARGS_SIZE = 128; 
-
-// may return an error message
-static int load_stack(struct addrspace *as, char ** kargs, int args_count, vaddr_t stackptr, userptr_t *initial_ptr) {
-	int total_len = 0; 
-	for (int i = 0; i < args_count; ++i) {
-		total_len += strlen(kargs[i]) + 1;
-	} // determine length of all args
-
-	total_len += (args_count+1) * (sizeof (char*)); // determine length of all args
-	int padding = ROUNDUP (total_len, 8) - total_len; 
-        userptr_t curStackptr = (userptr_t)stackptr - padding;
-	// array to store the address of the args
-	vaddr_t * args_loc = kmalloc ((args_count + 1) * sizeof(char *)); // add NULL at the end
-        if (args_loc == NULL) {
-		return ENOMEM; 
+// tf is the trapframe passed in from the system call dispatcher
+int sys_fork (struct trapframe *tf, pid_t *retval){
+	return fork_common(tf, false, retval);
+}
+
+int sys_vfork (struct trapframe *tf, pid_t *retval){
+	return fork_common(tf, true, retval);
+}
+
+/*
+ * Exec arguments. The program name and the argument strings are
+ * copied into one buffer, with the arguments laid out exactly as they
+ * will sit at the top of the new user stack: the argv array, then the
+ * strings. Until the stack address is known the argv entries hold
+ * offsets into the buffer; execargs_copyout turns them into user
+ * pointers and copies the lot out in one go.
+ *
+ * The buffers are ARG_MAX + PATH_MAX bytes, too big to allocate for
+ * every exec, so the last one used is kept for the next. Only one:
+ * they're 17 pages each, and execs rarely overlap.
+ */
+#define EXECBUF_SIZE	(__ARG_MAX + __PATH_MAX)
+#define EXECBUF_KEEP	1
+
+struct execargs {
+	char *ea_buf;			/* argv array, then the strings */
+	char *ea_path;			/* program name, past ARG_MAX */
+	int ea_argc;
+	size_t ea_len;			/* bytes of ea_buf in use */
+};
+
+static char *execbuf_free[EXECBUF_KEEP];
+static unsigned execbuf_nfree;
+static struct spinlock execbuf_lock = SPINLOCK_INITIALIZER;
+
+static int execargs_init(struct execargs *ea) {
+	ea->ea_buf = NULL;
+	spinlock_acquire(&execbuf_lock);
+	if (execbuf_nfree > 0) {
+		ea->ea_buf = execbuf_free[--execbuf_nfree];
 	}
-        size_t copylen; 
-	int arg_len, status; 
-	// copy chars into the stack
-	for (int i = 0; i < args_count; ++i) {
-		arg_len = strlen(kargs[i]) + 1; 
-	        
-		curStackptr -= arg_len; // update stack pointer
-		status = copyoutstr(kargs[i], curStackptr, arg_len, &copylen);	
-		if (status) {
-			kfree (args_loc); 
-			return status; 
-		}
-		KASSERT((int)copylen == (int)arg_len); 	
-		// save loc in args_loc
-		args_loc[i] = (vaddr_t) curStackptr; 
-	}
-	args_loc[args_count] = (vaddr_t) NULL; 
-	for (int i = args_count; i >= 0; i--) {
-		curStackptr -= 4; 
-		status = copyout((void *)&args_loc[i], curStackptr, 4);
-		if (status) {
-			kfree (args_loc); 
-			return status; 
+	spinlock_release(&execbuf_lock);
+	if (ea->ea_buf == NULL) {
+		ea->ea_buf = kmalloc(EXECBUF_SIZE);
+		if (ea->ea_buf == NULL) {
+			return ENOMEM;
 		}
 	}
-	*initial_ptr = curStackptr;
-	//kfree (args_loc); // newly removed from A2b
-	(void)as; 
-	return 0; 
+	ea->ea_path = ea->ea_buf + __ARG_MAX;
+	ea->ea_argc = 0;
+	ea->ea_len = 0;
+	return 0;
 }
 
-int
-sys_execv(userptr_t in_prog_name, userptr_t in_args)
-{
-	char ** args = (char **) in_args; 
-	char * prog_name = (char *) in_prog_name; 
-	// copy program name
-	char * kprog_name = kmalloc(__PATH_MAX * sizeof(char)); 
-	if (kprog_name == NULL) {
-		return ENOMEM; 
+static void execargs_cleanup(struct execargs *ea) {
+	spinlock_acquire(&execbuf_lock);
+	if (execbuf_nfree < EXECBUF_KEEP) {
+		execbuf_free[execbuf_nfree++] = ea->ea_buf;
+		ea->ea_buf = NULL;
 	}
-	size_t prog_name_size; 
-	int status = copyinstr((const_userptr_t)prog_name, kprog_name, __PATH_MAX, &prog_name_size); 
-	if (status) {
-		kfree (kprog_name); 
-		return status; 
-	}	
-	// copy args
-	int args_counter = 0;
-	while (args[args_counter] != NULL) {
-		++args_counter; 
+	spinlock_release(&execbuf_lock);
+	kfree(ea->ea_buf);
+}
+
+// copy in the program name and arguments for execv and spawn; all
+// user memory is read with copyin/copyinstr
+static int execargs_copyin(struct execargs *ea, userptr_t in_prog_name,
+			   userptr_t in_args) {
+	uint32_t *argv = (uint32_t *)ea->ea_buf;
+	size_t pos, len;
+	int argc, result;
+
+	result = copyinstr((const_userptr_t)in_prog_name, ea->ea_path, __PATH_MAX, &len); 
+	if (result) {
+		return result; 
 	}
-	
-	
-	char ** kargs = kmalloc ((args_counter+1) * sizeof(char*));
-	if (kargs == NULL) {
-		kfree (kprog_name); 
-		return ENOMEM; 
+
+	// the user's argv array first, so we know where the strings go
+	for (argc = 0; ; argc++) {
+		if ((argc + 1) * sizeof(uint32_t) > __ARG_MAX) {
+			return E2BIG;
+		}
+		result = copyin((const_userptr_t)(in_args + argc * sizeof(uint32_t)),
+				&argv[argc], sizeof(uint32_t));
+		if (result) {
+			return result;
+		}
+		if (argv[argc] == 0) {
+			break;
+		}
 	}
-        for (int i = 0; i < args_counter; i++) {
-	      	kargs[i] = kmalloc (MAX_ARGS_SIZE * sizeof (char)); // allocate memory for current argument
-		status = copyinstr ((const_userptr_t) args[i], kargs[i], MAX_ARGS_SIZE, &prog_name_size);   
-		if (status) {
-			kfree (kprog_name); 
-			kfree (kargs); 
-			return status;
-		}	
+
+	// then each string, replacing its user pointer with its offset
+	pos = (argc + 1) * sizeof(uint32_t);
+	for (int i = 0; i < argc; ++i) {
+		result = copyinstr((const_userptr_t)argv[i], ea->ea_buf + pos,
+				   __ARG_MAX - pos, &len);
+		if (result == ENAMETOOLONG) {
+			return E2BIG;
+		}
+		if (result) {
+			return result;
+		}
+		argv[i] = pos;
+		pos += len; // len includes the terminator
 	}
-        kargs[args_counter] = NULL; // manually set null terminator
-	
-	// checks if the args have been correctly copied 
-	/*for (int i = 0; i <= args_counter; ++i) {
-		kprintf ("%s and %s\n", args[i], kargs[i]); 
-	}*/
-	
+	ea->ea_argc = argc;
+	ea->ea_len = pos;
+	return 0;
+}
+
+// put the arguments at the top of the user stack, moving STACKPTR
+// down past them, and return where argv is
+static int execargs_copyout(struct execargs *ea, vaddr_t *stackptr, userptr_t *uargv) {
+	uint32_t *argv = (uint32_t *)ea->ea_buf;
+	size_t len = ROUNDUP(ea->ea_len, 8); // keep the stack 8-aligned
+	vaddr_t base = *stackptr - len;
+	int result;
+
+	for (int i = 0; i < ea->ea_argc; ++i) {
+		argv[i] += base;
+	}
+	// don't hand out stale bytes from an earlier exec
+	bzero(ea->ea_buf + ea->ea_len, len - ea->ea_len);
+	result = copyout(ea->ea_buf, (userptr_t)base, len);
+	if (result) {
+		return result;
+	}
+	*stackptr = base;
+	*uargv = (userptr_t)base;
+	return 0;
+}
 
+// load a program into a new address space for the current process,
+// and set up its stack; on success the old address space is gone.
+// For execv (STOPTHREADS), the process's other threads are stopped
+// once the program has been opened and checked, just before the old
+// address space goes; an exec that fails before then leaves them be
+static int exec_load(struct execargs *ea, bool stopthreads,
+		     vaddr_t * entrypoint, vaddr_t * stackptr,
+		     userptr_t * uargv) {
 	// copied directly from runprogram
         struct addrspace *as;
         struct vnode *v;
-        vaddr_t entrypoint, stackptr;
+        struct elfimage ei;
+        uint64_t start;
         int result;
 
         /* Open the file. */
-        result = vfs_open(kprog_name,O_RDONLY, 0, &v); // correct program name here
+        start = getnsecs();
+        result = vfs_open(ea->ea_path, O_RDONLY, 0, &v); // correct program name here
         if (result) {
-		kfree (kprog_name); 
-		kfree (kargs); 
+                return result;
+        }
+        execstat_add(EXECSTAT_OPEN, getnsecs() - start);
+
+        /* Check that it's something we can run. */
+        result = elf_getimage(v, &ei);
+        if (result) {
+                vfs_close(v);
                 return result;
         }
 
@@ -389,17 +670,30 @@ sys_execv(userptr_t in_prog_name, userptr_t in_args)
                 vfs_close(v);
                 return ENOMEM;
 	}
+	/* Leave room on the stack for the arguments; see execargs_copyout */
+	as_reserve_stack(as, ROUNDUP(ea->ea_len, 8));
+
+	// the new image starts out with only this thread; if another
+	// thread is already taking the process down, just go
+	if (stopthreads && !proc_stopthreads()) {
+		as_destroy(as);
+		vfs_close(v);
+		execargs_cleanup(ea);
+		proc_threadleave();
+	}
+
 	/* Switch to it and activate it. */
 	struct addrspace *prev_as = curproc_setas(as);
 	as_activate();
-	as_destroy(prev_as); 
+	// a vfork child hands the address space back rather than destroying it
+	if (prev_as != NULL && !vfork_release(curproc)) {
+		as_destroy(prev_as); 
+	}
 
         /* Load the executable. */
-        result = load_elf(v, &entrypoint);
+        result = load_elfimage(v, &ei, entrypoint);
         if (result) {
                 /* p_addrspace will go away when curproc is destroyed */
-                kfree (kprog_name); 
-		kfree(kargs); 
 		vfs_close(v);
                 return result;
         }
@@ -408,32 +702,157 @@ sys_execv(userptr_t in_prog_name, userptr_t in_args)
         vfs_close(v);
 
         /* Define the user stack in the address space */
-        result = as_define_stack(as, &stackptr);
+        start = getnsecs();
+        result = as_define_stack(as, stackptr);
        if (result) {
                 /* p_addrspace will go away when curproc is destroyed */
-	        kfree(kprog_name); 
-		kfree(kargs); 
                 return result;
         }
-        userptr_t start_loc; 
-       	load_stack(as, kargs, args_counter, stackptr, &start_loc); 
-		
-	kfree (kprog_name);
-	for (int i = 0; i < args_counter; ++i) {
-		kfree (kargs[i]); 
-	}
-	kfree (kargs);
+	result = execargs_copyout(ea, stackptr, uargv);
+	execstat_add(EXECSTAT_STACK, getnsecs() - start);
+	return result;
+	// end of copy from runprogram
+}
+
+int
+sys_execv(userptr_t in_prog_name, userptr_t in_args)
+{
+	struct execargs ea;
+        vaddr_t entrypoint, stackptr;
+        userptr_t uargv; 
+	int argc;
+        int result;
+
+	result = execargs_init(&ea);
+	if (result) {
+		return result;
+	}
+	result = execargs_copyin(&ea, in_prog_name, in_args);
+	if (result == 0) {
+		result = exec_load(&ea, true, &entrypoint, &stackptr, &uargv);
+	}
+	argc = ea.ea_argc;
+	execargs_cleanup(&ea);
+	if (result) {
+		return result;
+	}
+
+	/* We won't be going back through the dispatcher */
+	syscallstat_end(SYS_execv);
 	
 	/* Warp to user mode. */
-        enter_new_process(args_counter, start_loc,
-                          (vaddr_t) start_loc, entrypoint);
+        enter_new_process(argc, uargv, stackptr, entrypoint);
 
         /* enter_new_process does not return. */
         panic("enter_new_process returned\n");
         return EINVAL;
-	// end of copy from runprogram
 }
 
+/*
+ * What spawn hands the new process's thread, and what that thread
+ * reports back. It lives on the parent's stack, so the child must not
+ * touch it after V'ing si_done.
+ */
+struct spawn_info {
+	struct execargs *si_args;
+	struct semaphore *si_done;
+	int si_result;
+};
+
+// first function of a spawned process: load the program, tell the
+// parent how it went, and go
+static void spawn_entry(void * data1, unsigned long data2) {
+	struct spawn_info *si = data1;
+	struct addrspace *as;
+        vaddr_t entrypoint, stackptr;
+        userptr_t uargv; 
+	int argc = si->si_args->ea_argc;
+	int result;
+
+	(void)data2;
+	result = exec_load(si->si_args, false, &entrypoint, &stackptr, &uargv);
+	si->si_result = result;
+	if (result) {
+		// leave the process empty for the parent to destroy
+		as_deactivate();
+		as = curproc_setas(NULL);
+		if (as != NULL) {
+			as_destroy(as);
+		}
+		proc_remthread(curthread);
+		V(si->si_done);
+		thread_exit();
+	}
+	V(si->si_done);
+
+	/* Warp to user mode. */
+        enter_new_process(argc, uargv, stackptr, entrypoint);
+
+        /* enter_new_process does not return. */
+        panic("enter_new_process returned\n");
+}
+
+/*
+ * spawn: create a child running the program, in one call. Unlike
+ * fork and execv, nothing of ours is copied or thrown away; the child
+ * starts out with only its new image. Errors loading the program are
+ * reported to us and no child is left behind.
+ */
+int
+sys_spawn(userptr_t in_prog_name, userptr_t in_args, pid_t *retval)
+{
+	struct execargs ea;
+	struct spawn_info si;
+	struct proc *child;
+	int result;
+
+	result = execargs_init(&ea);
+	if (result) {
+		return result;
+	}
+	result = execargs_copyin(&ea, in_prog_name, in_args);
+	if (result) {
+		goto out;
+	}
+	si.si_args = &ea;
+	si.si_done = sem_create("spawn", 0);
+	if (si.si_done == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+	// vfs_open in the child eats the path, so name the process first
+	child = proc_create_runprogram(ea.ea_path);
+	if (child == NULL) {
+		result = ENOMEM;
+		goto out_sem;
+	}
+
+	// add parent for child, and child to parent
+	child->parent = curproc; 
+	lock_acquire(curproc->lk_process_info); 
+	child_link(&curproc->p_children, child);
+	lock_release(curproc->lk_process_info); 	
+
+	result = thread_fork(child->p_name, child, spawn_entry, &si, 0);
+	if (result == 0) {
+		P(si.si_done);
+		result = si.si_result;
+	}
+	if (result) {
+		lock_acquire(curproc->lk_process_info); 
+		child_unlink(child);
+		lock_release(curproc->lk_process_info); 	
+		proc_destroy(child);
+		goto out_sem;
+	}
+	*retval = child->PID;
+
+ out_sem:
+	sem_destroy(si.si_done);
+ out:
+	execargs_cleanup(&ea);
+	return result;
+}
 
 #endif /* OPT_A2 */
 
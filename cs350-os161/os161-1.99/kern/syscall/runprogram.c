@@ -44,6 +44,7 @@
 #include <vfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <clock.h>
 #include "opt-A2.h"
 
 /*
@@ -63,13 +64,16 @@ runprogram(char *progname)
 	struct addrspace *as;
 	struct vnode *v;
 	vaddr_t entrypoint, stackptr;
+	uint64_t start;
 	int result;
 
 	/* Open the file. */
+	start = getnsecs();
 	result = vfs_open(progname, O_RDONLY, 0, &v);
 	if (result) {
 		return result;
 	}
+	execstat_add(EXECSTAT_OPEN, getnsecs() - start);
 
 	/* We should be a new process. */
 	KASSERT(curproc_getas() == NULL);
@@ -97,6 +101,7 @@ runprogram(char *progname)
 	vfs_close(v);
 
 	/* Define the user stack in the address space */
+	start = getnsecs();
 	result = as_define_stack(as, &stackptr);
 	if (result) {
 		/* p_addrspace will go away when curproc is destroyed */
@@ -142,11 +147,14 @@ runprogram(char *progname)
                 }
         }
 	kfree (args_loc);	
+	execstat_add(EXECSTAT_STACK, getnsecs() - start);
 	
 	enter_new_process(args_count, curStackptr,
 			  (vaddr_t)curStackptr, entrypoint);
 
 #else
+	execstat_add(EXECSTAT_STACK, getnsecs() - start);
+
 	/* Warp to user mode. */
 	enter_new_process(0 /*argc*/, NULL /*userspace addr of argv*/,
 			  stackptr, entrypoint);
@@ -0,0 +1,122 @@
+/*
+ * sysbatch(): run a ring of system call requests in one trap.
+ * The ring's layout is described in <kern/sysring.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <kern/sysring.h>
+#include <lib.h>
+#include <clock.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <ktrace.h>
+
+/*
+ * Requests copied in and out at a time. ents[] is on the kernel
+ * stack, under whatever the calls themselves need, so keep it small
+ * (4 requests are 144 bytes).
+ */
+#define SYSBATCH_CHUNK 4
+
+/*
+ * Run one request, as the dispatcher would have, and fill in its
+ * result.
+ */
+static
+void
+sysbatch_run(struct sysring_entry *se)
+{
+	const struct syscall_desc *sd;
+	uint64_t start;
+	int32_t retval;
+	int callno, err;
+
+	callno = se->se_callno;
+	if (callno < 0 || callno >= SYS_NCALLS ||
+	    syscall_table[callno].sd_call == NULL ||
+	    !(syscall_table[callno].sd_flags & SD_BATCH)) {
+		se->se_retval = -1;
+		se->se_errno = ENOSYS;
+		return;
+	}
+	sd = &syscall_table[callno];
+	KASSERT(sd->sd_nargs <= SD_MAXARGS);
+
+	KTRACE(KT_SYSCALL, callno, 0);
+	start = getnsecs();
+	retval = 0;
+	err = sd->sd_call(NULL, se->se_args, &retval);
+	syscallstat_charge(callno, getnsecs() - start);
+	KTRACE(KT_SYSRET, callno, err);
+
+	se->se_retval = err ? -1 : retval;
+	se->se_errno = err;
+}
+
+/*
+ * Run the requests from sr_tail to sr_head, a chunk at a time, and
+ * advance sr_tail past them. If a chunk can't be copied in, stop
+ * there; the requests run so far still count. (If a chunk's results
+ * can't be copied out, it has run but sr_tail stays behind it. The
+ * ring has to be bad for either to happen.)
+ */
+int
+sys_sysbatch(userptr_t uring, int *retval)
+{
+	struct sysring ring;
+	struct sysring_entry ents[SYSBATCH_CHUNK];
+	struct sysring *ur = (struct sysring *)uring;
+	userptr_t uents;
+	unsigned mask, slot, tail, n, i, done;
+	int result;
+
+	result = copyin(uring, &ring, sizeof(ring));
+	if (result) {
+		return result;
+	}
+	if (ring.sr_size == 0 || (ring.sr_size & (ring.sr_size - 1)) != 0 ||
+	    ring.sr_head - ring.sr_tail > ring.sr_size) {
+		return EINVAL;
+	}
+	mask = ring.sr_size - 1;
+
+	tail = ring.sr_tail;
+	done = 0;
+	while (tail != ring.sr_head) {
+		/* As many as fit in ents without wrapping the ring */
+		slot = tail & mask;
+		n = ring.sr_head - tail;
+		if (n > ring.sr_size - slot) {
+			n = ring.sr_size - slot;
+		}
+		if (n > SYSBATCH_CHUNK) {
+			n = SYSBATCH_CHUNK;
+		}
+
+		uents = (userptr_t)&ur->sr_ents[slot];
+		result = copyin(uents, ents, n * sizeof(ents[0]));
+		if (result) {
+			break;
+		}
+		for (i=0; i<n; i++) {
+			sysbatch_run(&ents[i]);
+		}
+		result = copyout(ents, uents, n * sizeof(ents[0]));
+		if (result) {
+			break;
+		}
+		tail += n;
+		done += n;
+	}
+
+	if (done > 0) {
+		result = copyout(&tail, (userptr_t)&ur->sr_tail, sizeof(tail));
+	}
+	if (result) {
+		return result;
+	}
+	*retval = done;
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Per-system-call statistics: how often each call is made and how
+ * long it takes. The dispatcher (syscall() in the arch code) brackets
+ * every call with syscallstat_begin and syscallstat_end; the counts
+ * and times are kept per cpu in c_syscalls and c_syscallns, like
+ * c_counters, so recording them takes no lock.
+ *
+ * The totals can be read with the "sysstat" menu command or, from
+ * user level, the sysstat() system call.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <clock.h>
+#include <current.h>
+#include <thread.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+void
+syscallstat_begin(void)
+{
+	curthread->t_syscallstart = getnsecs();
+}
+
+void
+syscallstat_charge(int callno, uint64_t nsecs)
+{
+	int spl;
+
+	KASSERT(callno >= 0 && callno < SYS_NCALLS);
+
+	/* Stay on this cpu while we update its slots */
+	spl = splhigh();
+	curcpu->c_syscalls[callno]++;
+	curcpu->c_syscallns[callno] += nsecs;
+	splx(spl);
+}
+
+void
+syscallstat_end(int callno)
+{
+	syscallstat_charge(callno, getnsecs() - curthread->t_syscallstart);
+}
+
+/*
+ * Add up the cpus' slots into STATS, one entry for each call that has
+ * been made, sorted most time first. Returns the number of entries.
+ * As with counter_read, calls in progress may make the totals slightly
+ * inconsistent.
+ */
+static
+unsigned
+syscallstat_gather(struct syscallstat *stats)
+{
+	struct syscallstat tmp;
+	struct cpu *c;
+	unsigned i, j, n;
+	int callno;
+
+	n = 0;
+	for (callno=0; callno<SYS_NCALLS; callno++) {
+		if (syscall_table[callno].sd_name == NULL) {
+			continue;
+		}
+		bzero(&stats[n], sizeof(stats[n]));
+		strcpy(stats[n].ss_name, syscall_table[callno].sd_name);
+		stats[n].ss_callno = callno;
+		for (i=0; i<cpu_numcpus(); i++) {
+			c = cpu_get(i);
+			stats[n].ss_count += c->c_syscalls[callno];
+			stats[n].ss_nsecs += c->c_syscallns[callno];
+		}
+		if (stats[n].ss_count > 0) {
+			n++;
+		}
+	}
+
+	/* Insertion sort; there are only a few dozen */
+	for (i=1; i<n; i++) {
+		tmp = stats[i];
+		for (j=i; j>0 && stats[j-1].ss_nsecs < tmp.ss_nsecs; j--) {
+			stats[j] = stats[j-1];
+		}
+		stats[j] = tmp;
+	}
+	return n;
+}
+
+/*
+ * Print the N calls with the most total time.
+ */
+void
+syscallstat_print(unsigned n)
+{
+	struct syscallstat *stats;
+	uint64_t total;
+	unsigned i, num;
+
+	stats = kmalloc(SYS_NCALLS * sizeof(*stats));
+	if (stats == NULL) {
+		kprintf("sysstat: Out of memory\n");
+		return;
+	}
+	num = syscallstat_gather(stats);
+
+	total = 0;
+	for (i=0; i<num; i++) {
+		total += stats[i].ss_nsecs;
+	}
+	if (n > num) {
+		n = num;
+	}
+
+	kprintf("%-12s %10s %12s %10s %6s\n", "call", "count",
+		"total usecs", "avg usecs", "%time");
+	for (i=0; i<n; i++) {
+		kprintf("%-12s %10u %12llu %10llu %6u\n", stats[i].ss_name,
+			stats[i].ss_count, stats[i].ss_nsecs / 1000,
+			stats[i].ss_nsecs / stats[i].ss_count / 1000,
+			(unsigned)(total ? stats[i].ss_nsecs * 100 / total : 0));
+	}
+	if (n < num) {
+		kprintf("(%u more)\n", num - n);
+	}
+	kfree(stats);
+}
+
+/*
+ * Clear the statistics. Like counter_reset, a call finishing at the
+ * time on another cpu may leave a stray count.
+ */
+void
+syscallstat_reset(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		bzero(c->c_syscalls, sizeof(c->c_syscalls));
+		bzero(c->c_syscallns, sizeof(c->c_syscallns));
+	}
+}
+
+/*
+ * sysstat(): copy out up to MAX entries, most time first, and return
+ * how many there were.
+ */
+int
+sys_sysstat(userptr_t buf, unsigned max, int *retval)
+{
+	struct syscallstat *stats;
+	unsigned num;
+	int result;
+
+	stats = kmalloc(SYS_NCALLS * sizeof(*stats));
+	if (stats == NULL) {
+		return ENOMEM;
+	}
+	num = syscallstat_gather(stats);
+	if (num > max) {
+		num = max;
+	}
+
+	result = copyout(stats, buf, num * sizeof(*stats));
+	kfree(stats);
+	if (result) {
+		return result;
+	}
+	*retval = num;
+	return 0;
+}
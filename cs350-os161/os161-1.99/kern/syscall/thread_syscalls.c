@@ -0,0 +1,258 @@
+/*
+ * Threads in user processes: __thread_create, thread_exit and
+ * thread_join, and getting the other threads out of the way when a
+ * process exits or execs.
+ *
+ * Each thread of a process has a slot in p_uthreads, and its id is
+ * the slot number (kept in t_tid). A slot is taken from
+ * __thread_create until the thread has exited and been joined. When
+ * the last live thread exits, the process does, with that thread's
+ * exit code. When any thread calls _exit, or is killed by a fault,
+ * the whole process goes: proc_exit calls proc_stopthreads first.
+ */
+
+#include "opt-A2.h"
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <machine/membar.h>
+#include <copyinout.h>
+#include <current.h>
+#include <proc.h>
+#include <thread.h>
+#include <synch.h>
+#include <syscall.h>
+
+#if OPT_A2
+
+/* What __thread_create hands the new thread */
+struct uthread_start {
+	vaddr_t us_entry;
+	userptr_t us_arg;
+	vaddr_t us_stack;
+};
+
+/*
+ * Mark the current thread gone, with exit code CODE, and exit.
+ * lk_process_info must be held; it's released.
+ *
+ * We leave the process before saying we're gone: as soon as p_nlive
+ * drops and the lock is released, a thread in proc_stopthreads can
+ * finish exiting and the parent can destroy P. Leaving first also
+ * puts our cpu time in the process before proc_chargeparent reads it.
+ */
+static
+void
+uthread_depart(struct proc *p, int code)
+{
+	struct uthread *ut = &p->p_uthreads[curthread->t_tid];
+
+	KASSERT(lock_do_i_hold(p->lk_process_info));
+	KASSERT(ut->ut_state == UT_LIVE);
+	KASSERT(p->p_nlive > 1);
+
+	proc_remthread(curthread);
+
+	ut->ut_state = UT_EXITED;
+	ut->ut_code = code;
+	p->p_nlive--;
+	cv_broadcast(p->cv_threads, p->lk_process_info);
+	lock_release(p->lk_process_info);
+
+	/* P may be gone now */
+	thread_exit();
+}
+
+void
+proc_threadleave(void)
+{
+	struct proc *p = curproc;
+
+	lock_acquire(p->lk_process_info);
+	KASSERT(p->p_exiting);
+	uthread_depart(p, 0);
+}
+
+bool
+proc_stopthreads(void)
+{
+	struct proc *p = curproc;
+	unsigned i;
+
+	lock_acquire(p->lk_process_info);
+	if (p->p_exiting) {
+		lock_release(p->lk_process_info);
+		return false;
+	}
+	if (p->p_nlive > 1) {
+		p->p_exiting = true;
+		/* Pairs with the one in futex; see sys_futex */
+		membar_any_any();
+		lock_release(p->lk_process_info);
+
+		futex_wakeproc(p);
+
+		lock_acquire(p->lk_process_info);
+		cv_broadcast(p->cv_threads, p->lk_process_info);
+		cv_broadcast(p->cv_parent_waitpid, p->lk_process_info);
+		while (p->p_nlive > 1) {
+			cv_wait(p->cv_threads, p->lk_process_info);
+		}
+		p->p_exiting = false;
+	}
+
+	/* Now we're alone; forget the ones nobody joined */
+	for (i=0; i<PROC_MAXTHREADS; i++) {
+		if (i != (unsigned)curthread->t_tid) {
+			p->p_uthreads[i].ut_state = UT_FREE;
+		}
+	}
+	lock_release(p->lk_process_info);
+	return true;
+}
+
+/*
+ * First function of a new user thread.
+ */
+static
+void
+uthread_entry(void *data1, unsigned long tid)
+{
+	struct uthread_start *us = data1;
+	struct uthread_start start = *us;
+
+	kfree(us);
+	curthread->t_tid = tid;
+
+	/* Don't start if the process went away while we were created */
+	if (curproc->p_exiting) {
+		proc_threadleave();
+	}
+
+	enter_new_thread(start.us_entry, start.us_arg, start.us_stack);
+	panic("enter_new_thread returned\n");
+}
+
+/*
+ * Start a thread in the current process, calling ENTRY(ARG) on the
+ * user stack STACK, and return its id. The stack pointer must be
+ * 8-aligned; the caller leaves room above it for ENTRY's argument
+ * save area, as for any call.
+ */
+int
+sys___thread_create(userptr_t entry, userptr_t arg, userptr_t stack,
+		    int *retval)
+{
+	struct proc *p = curproc;
+	struct uthread_start *us;
+	unsigned tid;
+	int result;
+
+	if ((vaddr_t)stack % 8 != 0) {
+		return EINVAL;
+	}
+	us = kmalloc(sizeof(*us));
+	if (us == NULL) {
+		return ENOMEM;
+	}
+	us->us_entry = (vaddr_t)entry;
+	us->us_arg = arg;
+	us->us_stack = (vaddr_t)stack;
+
+	lock_acquire(p->lk_process_info);
+	if (p->p_exiting) {
+		/* We'll be leaving on the way out of the kernel */
+		lock_release(p->lk_process_info);
+		kfree(us);
+		return EINTR;
+	}
+	for (tid=0; tid<PROC_MAXTHREADS; tid++) {
+		if (p->p_uthreads[tid].ut_state == UT_FREE) {
+			break;
+		}
+	}
+	if (tid == PROC_MAXTHREADS) {
+		lock_release(p->lk_process_info);
+		kfree(us);
+		return EAGAIN;
+	}
+	p->p_uthreads[tid].ut_state = UT_LIVE;
+	p->p_nlive++;
+	lock_release(p->lk_process_info);
+
+	result = thread_fork(p->p_name, p, uthread_entry, us, tid);
+	if (result) {
+		lock_acquire(p->lk_process_info);
+		p->p_uthreads[tid].ut_state = UT_FREE;
+		p->p_nlive--;
+		cv_broadcast(p->cv_threads, p->lk_process_info);
+		lock_release(p->lk_process_info);
+		kfree(us);
+		return result;
+	}
+	*retval = tid;
+	return 0;
+}
+
+/*
+ * Exit the current thread. If it's the last one, the process exits.
+ */
+void
+sys_thread_exit(int code)
+{
+	struct proc *p = curproc;
+
+	lock_acquire(p->lk_process_info);
+	if (p->p_nlive == 1) {
+		lock_release(p->lk_process_info);
+		sys__exit(code);
+	}
+	uthread_depart(p, code);
+}
+
+/*
+ * Wait for thread TID of the current process to exit, and hand back
+ * its exit code. Each thread can be joined once.
+ */
+int
+sys_thread_join(int tid, userptr_t code, int *retval)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+	int result;
+
+	if (tid < 0 || tid >= PROC_MAXTHREADS) {
+		return ESRCH;
+	}
+	if (tid == curthread->t_tid) {
+		return EINVAL;
+	}
+	ut = &p->p_uthreads[tid];
+
+	lock_acquire(p->lk_process_info);
+	while (ut->ut_state == UT_LIVE && !p->p_exiting) {
+		cv_wait(p->cv_threads, p->lk_process_info);
+	}
+	if (p->p_exiting) {
+		lock_release(p->lk_process_info);
+		return EINTR;
+	}
+	if (ut->ut_state != UT_EXITED) {
+		lock_release(p->lk_process_info);
+		return ESRCH;
+	}
+	/* If the code can't be handed over, leave it for next time */
+	result = 0;
+	if (code != NULL) {
+		result = copyout(&ut->ut_code, code, sizeof(ut->ut_code));
+	}
+	if (result == 0) {
+		ut->ut_state = UT_FREE;
+	}
+	lock_release(p->lk_process_info);
+
+	*retval = 0;
+	return result;
+}
+
+#endif /* OPT_A2 */
@@ -0,0 +1,197 @@
+/*
+ * Priority inversion demonstration.
+ *
+ * A low-priority thread takes a lock and then does a long stretch of
+ * work while holding it. A high-priority thread then blocks on the
+ * lock, while a crowd of medium-priority threads compete for the CPU.
+ *
+ * Without priority inheritance the medium threads always run ahead of
+ * the low-priority lock holder, so the high-priority thread ends up
+ * waiting for all of them. With priority inheritance the holder runs
+ * at the high thread's priority until it releases the lock, and the
+ * high thread gets in before the medium threads are done.
+ *
+ * That only holds if they all share a cpu, so the test threads are
+ * all pinned to cpu 0. The menu thread may be on cpu 0 too, so it
+ * runs above all of them while it forks them; otherwise the medium
+ * threads would starve it before it got to forking the high one.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <test.h>
+
+#define NAME_LEN      (30)
+
+#define PI_LOW        (PRI_DEFAULT - 10)
+#define PI_MEDIUM     (PRI_DEFAULT + 10)
+#define PI_HIGH       (PRI_DEFAULT + 20)
+
+#define NMEDIUM       (8)
+#define NMEDIUMLOOPS  (200)
+#define NLOWLOOPS     (50)
+#define NSPINS        (5000)
+
+#define PI_CPUMASK    CPUMASK_CPU(0)
+
+static struct lock *pilock = NULL;
+static struct semaphore *pisem = NULL;
+static struct semaphore *donesem = NULL;
+
+static struct spinlock medium_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned medium_done;
+static volatile unsigned medium_done_at_acquire;
+static volatile int low_maxpriority;
+
+static
+void
+spin(void)
+{
+	volatile int i;
+
+	for (i=0; i<NSPINS; i++);
+}
+
+static
+void
+low_thread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PI_LOW);
+	lock_acquire(pilock);
+	V(pisem);
+
+	low_maxpriority = curthread->t_effpriority;
+	for (i=0; i<NLOWLOOPS; i++) {
+		spin();
+		if (curthread->t_effpriority > low_maxpriority) {
+			low_maxpriority = curthread->t_effpriority;
+		}
+		thread_yield();
+	}
+
+	lock_release(pilock);
+	KASSERT(curthread->t_effpriority == PI_LOW);
+	V(donesem);
+	thread_exit();
+}
+
+static
+void
+medium_thread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PI_MEDIUM);
+	for (i=0; i<NMEDIUMLOOPS; i++) {
+		spin();
+		thread_yield();
+	}
+	spinlock_acquire(&medium_lock);
+	medium_done++;
+	spinlock_release(&medium_lock);
+	V(donesem);
+	thread_exit();
+}
+
+static
+void
+high_thread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(PI_HIGH);
+	lock_acquire(pilock);
+	spinlock_acquire(&medium_lock);
+	medium_done_at_acquire = medium_done;
+	spinlock_release(&medium_lock);
+	lock_release(pilock);
+	V(donesem);
+	thread_exit();
+}
+
+int
+pitest(int nargs, char **args)
+{
+	int i, result, mypriority;
+	char name[NAME_LEN];
+
+	(void)nargs;
+	(void)args;
+
+	pilock = lock_create("pilock");
+	pisem = sem_create("pisem", 0);
+	donesem = sem_create("donesem", 0);
+	if (pilock == NULL || pisem == NULL || donesem == NULL) {
+		panic("pitest: out of memory\n");
+	}
+	medium_done = 0;
+
+	kprintf("Starting priority inversion test...\n");
+
+	mypriority = curthread->t_priority;
+	thread_setpriority(PI_HIGH + 1);
+
+	result = thread_fork_affinity("pi_low", NULL, PI_CPUMASK,
+				      low_thread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+	/* Wait until the low thread holds the lock */
+	P(pisem);
+
+	for (i=0; i<NMEDIUM; i++) {
+		snprintf(name, NAME_LEN, "pi_medium %d", i);
+		result = thread_fork_affinity(name, NULL, PI_CPUMASK,
+					      medium_thread, NULL, i);
+		if (result) {
+			panic("pitest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	result = thread_fork_affinity("pi_high", NULL, PI_CPUMASK,
+				      high_thread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	thread_setpriority(mypriority);
+
+	for (i=0; i<NMEDIUM+2; i++) {
+		P(donesem);
+	}
+
+	kprintf("low thread ran at priority up to %d (base %d, high %d)\n",
+		low_maxpriority, PI_LOW, PI_HIGH);
+	kprintf("%u of %d medium threads finished before the high thread "
+		"got the lock\n", medium_done_at_acquire, NMEDIUM);
+	if (low_maxpriority == PI_HIGH && medium_done_at_acquire == 0) {
+		kprintf("TEST SUCCEEDED\n");
+	}
+	else {
+		kprintf("TEST FAILED\n");
+	}
+
+	lock_destroy(pilock);
+	pilock = NULL;
+	sem_destroy(pisem);
+	pisem = NULL;
+	sem_destroy(donesem);
+	donesem = NULL;
+	kprintf("pitest done.\n");
+
+	return 0;
+}
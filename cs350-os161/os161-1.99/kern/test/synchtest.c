@@ -32,11 +32,16 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
 #include <synch.h>
+#include <spinlock.h>
 #include <test.h>
+#include <lamebus/ltimer.h>
+
+#include "opt-hashwchan.h"
 
 #define NSEMLOOPS     63
 #define NLOCKLOOPS    120
@@ -347,3 +352,766 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock test and benchmark.
+
+#define NRWLOOPS      200
+#define RWBENCHLOOPS  2000
+#define RWWRITEPCT    10	/* percentage of operations that write */
+
+static struct rwlock *testrw;
+static struct lock *rwbenchlock;
+static volatile unsigned rwreaders;
+static volatile unsigned rwmaxreaders;
+static volatile unsigned rwupgrades;
+static struct spinlock rwcount_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Check the testvals are consistent; they're only ever changed under
+ * the write lock.
+ */
+static
+bool
+rwcheck(void)
+{
+	unsigned long v1 = testval1;
+
+	return testval2 == v1*v1 && testval3 == v1%3;
+}
+
+static
+void
+rwwrite(unsigned long num)
+{
+	testval1 = num;
+	testval2 = num*num;
+	testval3 = num%3;
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (random() % 100 < RWWRITEPCT) {
+			rwlock_acquire_write(testrw);
+			rwwrite(num);
+			for (j=0; j<100; j++);
+			if (!rwcheck() || testval1 != num) {
+				kprintf("thread %lu: writer saw a mismatch\n",
+					num);
+				kprintf("Test failed\n");
+			}
+			if (i % 2) {
+				/* downgrade and keep reading */
+				rwlock_downgrade(testrw);
+				if (testval1 != num) {
+					kprintf("thread %lu: lost our write "
+						"across downgrade\n", num);
+					kprintf("Test failed\n");
+				}
+				rwlock_release_read(testrw);
+			}
+			else {
+				rwlock_release_write(testrw);
+			}
+			continue;
+		}
+
+		rwlock_acquire_read(testrw);
+		spinlock_acquire(&rwcount_lock);
+		rwreaders++;
+		if (rwreaders > rwmaxreaders) {
+			rwmaxreaders = rwreaders;
+		}
+		spinlock_release(&rwcount_lock);
+
+		for (j=0; j<100; j++);
+		if (!rwcheck()) {
+			kprintf("thread %lu: reader saw a mismatch\n", num);
+			kprintf("Test failed\n");
+		}
+
+		spinlock_acquire(&rwcount_lock);
+		rwreaders--;
+		spinlock_release(&rwcount_lock);
+
+		if (i % 50 == 0) {
+			/* occasionally turn the read into a write */
+			if (rwlock_tryupgrade(testrw)) {
+				rwwrite(num);
+				rwupgrades++;
+				rwlock_release_write(testrw);
+			}
+			else {
+				rwlock_release_read(testrw);
+			}
+		}
+		else {
+			rwlock_release_read(testrw);
+		}
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	rwreaders = rwmaxreaders = rwupgrades = 0;
+	rwwrite(0);
+
+	kprintf("Starting rwlock test...\n");
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("synchtest", NULL, rwtestthread,
+				     NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("Up to %u readers held the lock at once; %u upgrades.\n",
+		rwmaxreaders, rwupgrades);
+	KASSERT(rwcheck());
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Rwlock test done.\n");
+
+	return 0;
+}
+
+/*
+ * Throughput benchmark: NTHREADS threads doing a RWWRITEPCT/rest
+ * mix of write and read critical sections, first under a plain lock
+ * and then under an rwlock. Run it with several CPUs (sys161.conf
+ * cpus=4) to see readers overlap.
+ */
+static
+void
+rwbenchthread(void *junk, unsigned long use_rwlock)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+
+	for (i=0; i<RWBENCHLOOPS; i++) {
+		if (i % 100 < RWWRITEPCT) {
+			if (use_rwlock) {
+				rwlock_acquire_write(testrw);
+			}
+			else {
+				lock_acquire(rwbenchlock);
+			}
+			rwwrite(i);
+			for (j=0; j<200; j++);
+			if (use_rwlock) {
+				rwlock_release_write(testrw);
+			}
+			else {
+				lock_release(rwbenchlock);
+			}
+		}
+		else {
+			if (use_rwlock) {
+				rwlock_acquire_read(testrw);
+			}
+			else {
+				lock_acquire(rwbenchlock);
+			}
+			for (j=0; j<200; j++);
+			(void)rwcheck();
+			if (use_rwlock) {
+				rwlock_release_read(testrw);
+			}
+			else {
+				lock_release(rwbenchlock);
+			}
+		}
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+rwbenchrun(const char *what, unsigned long use_rwlock)
+{
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+	uint64_t usecs, ops;
+	int i, result;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwbench", NULL, rwbenchthread,
+				     NULL, use_rwlock);
+		if (result) {
+			panic("rwbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+	usecs = (uint64_t)secs * 1000000 + nsecs / 1000;
+	ops = (uint64_t)NTHREADS * RWBENCHLOOPS;
+	kprintf("%-7s: %llu ops in %lu.%09lu seconds, %llu ops/sec\n",
+		what, (unsigned long long)ops, (unsigned long)secs,
+		(unsigned long)nsecs,
+		(unsigned long long)(usecs ? ops * 1000000 / usecs : 0));
+}
+
+int
+rwbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("rwbench");
+	rwbenchlock = lock_create("rwbench");
+	if (testrw == NULL || rwbenchlock == NULL) {
+		panic("rwbench: out of memory\n");
+	}
+	rwwrite(0);
+
+	kprintf("Starting rwlock benchmark (%d threads, %d%% writes)...\n",
+		NTHREADS, RWWRITEPCT);
+	rwbenchrun("lock", 0);
+	rwbenchrun("rwlock", 1);
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+	lock_destroy(rwbenchlock);
+	rwbenchlock = NULL;
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Rwlock benchmark done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Spinlock benchmark.
+
+#define SPINBENCHLOOPS  2000
+
+static struct spinlock benchspin = SPINLOCK_INITIALIZER;
+static volatile unsigned long spincounter;
+static volatile uint32_t spinmaxwait;
+
+/*
+ * Hammer one spinlock from NTHREADS threads (spread over however many
+ * CPUs there are; sys161.conf cpus=4 for the interesting case) and
+ * keep track of the longest anyone had to wait for it.
+ */
+static
+void
+spinbenchthread(void *junk, unsigned long num)
+{
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+	int i;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<SPINBENCHLOOPS; i++) {
+		gettime(&secs1, &nsecs1);
+		spinlock_acquire(&benchspin);
+		gettime(&secs2, &nsecs2);
+		getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+		if (secs > 0) {
+			nsecs = 0xffffffff;
+		}
+		if (nsecs > spinmaxwait) {
+			spinmaxwait = nsecs;
+		}
+		spincounter++;
+		for (j=0; j<20; j++);
+		spinlock_release(&benchspin);
+
+		/* let the others in */
+		for (j=0; j<20; j++);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+spinlockbench(int nargs, char **args)
+{
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+	uint64_t usecs;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	spincounter = 0;
+	spinmaxwait = 0;
+
+	kprintf("Starting spinlock benchmark (%d threads)...\n", NTHREADS);
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("spinbench", NULL, spinbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("spinlockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+	usecs = (uint64_t)secs * 1000000 + nsecs / 1000;
+	kprintf("%lu acquisitions in %lu.%09lu seconds, %llu per second\n",
+		spincounter, (unsigned long)secs, (unsigned long)nsecs,
+		(unsigned long long)(usecs ?
+			(uint64_t)spincounter * 1000000 / usecs : 0));
+	kprintf("Longest wait: %u ns\n", spinmaxwait);
+	KASSERT(spincounter == (unsigned long)NTHREADS * SPINBENCHLOOPS);
+
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Spinlock benchmark done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Ping-pong benchmark.
+
+#define PINGPONGS  1000
+
+static struct semaphore *pingsem;
+static struct semaphore *pongsem;
+
+/*
+ * V the first semaphore and P the second, either separately or
+ * (USEVP) with sem_vp, which lets the other thread run on our cpu.
+ */
+static
+void
+pingpong_swap(struct semaphore *v, struct semaphore *p, bool usevp)
+{
+	if (usevp) {
+		sem_vp(v, p);
+	}
+	else {
+		V(v);
+		P(p);
+	}
+}
+
+static
+void
+pongthread(void *junk, unsigned long usevp)
+{
+	int i;
+
+	(void)junk;
+
+	P(pingsem);
+	for (i=0; i<PINGPONGS-1; i++) {
+		pingpong_swap(pongsem, pingsem, usevp);
+	}
+	V(pongsem);
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+pingpongrun(bool usevp)
+{
+	uint64_t start, total;
+	int i, result;
+
+	result = thread_fork("pong", NULL, pongthread, NULL, usevp);
+	if (result) {
+		panic("pingpongbench: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+
+	start = getnsecs();
+	for (i=0; i<PINGPONGS; i++) {
+		pingpong_swap(pingsem, pongsem, usevp);
+	}
+	total = getnsecs() - start;
+	P(donesem);
+
+	kprintf("%s: %llu ns per round trip\n",
+		usevp ? "sem_vp" : "V + P ",
+		(unsigned long long)(total / PINGPONGS));
+}
+
+/*
+ * Bounce control back and forth between two threads through a pair
+ * of semaphores and time the round trips.
+ */
+int
+pingpongbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	pingsem = sem_create("ping", 0);
+	pongsem = sem_create("pong", 0);
+	if (pingsem == NULL || pongsem == NULL) {
+		panic("pingpongbench: sem_create failed\n");
+	}
+
+	kprintf("Starting ping-pong benchmark (%d round trips)...\n",
+		PINGPONGS);
+	pingpongrun(false);
+	pingpongrun(true);
+
+	sem_destroy(pingsem);
+	sem_destroy(pongsem);
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Ping-pong benchmark done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timed wait test.
+
+#define TIMEDSLACK    5		/* Ticks late a timed-out wait may be */
+#define TIMEDSIGNAL   2		/* Ticks before the helper wakes us */
+#define TIMEDLONG     100	/* Timeout that should never expire */
+
+static struct semaphore *timedsem;
+static struct cv *timedcv;
+static volatile bool timedloadstop;
+static volatile bool timedcond;
+static bool timedfailed;
+
+/*
+ * Keep the cpus busy so the timed-out threads have to compete to get
+ * back on one.
+ */
+static
+void
+timedloadthread(void *junk, unsigned long num)
+{
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	while (!timedloadstop) {
+		for (j=0; j<1000; j++);
+		thread_yield();
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+/*
+ * Wake up the main thread, either by V on timedsem or by cv_signal,
+ * after a short nap.
+ */
+static
+void
+timedwakethread(void *junk, unsigned long usecv)
+{
+	(void)junk;
+
+	clocknap(TIMEDSIGNAL);
+	if (usecv) {
+		lock_acquire(testlock);
+		timedcond = true;
+		cv_signal(timedcv, testlock);
+		lock_release(testlock);
+	}
+	else {
+		V(timedsem);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+/*
+ * Check how long a wait of TICKS ticks took, given that it returned
+ * RESULT and should have returned EXPECT.
+ */
+static
+void
+timedcheck(const char *what, unsigned ticks, uint64_t start,
+	   int result, int expect)
+{
+	uint64_t elapsed, min, max;
+
+	elapsed = (getnsecs() - start) / 1000;
+	if (expect == ETIMEDOUT) {
+		min = (uint64_t)ticks * LT_GRANULARITY;
+		max = (uint64_t)(ticks + TIMEDSLACK) * LT_GRANULARITY;
+	}
+	else {
+		min = 0;
+		max = (uint64_t)ticks * LT_GRANULARITY;
+	}
+
+	kprintf("%-12s %3u ticks: %s after %llu us", what, ticks,
+		result == ETIMEDOUT ? "timed out" : "woken",
+		(unsigned long long)elapsed);
+	if (result != expect || elapsed < min || elapsed > max) {
+		kprintf("  ** expected %s in %llu-%llu us",
+			expect == ETIMEDOUT ? "timeout" : "wakeup",
+			(unsigned long long)min, (unsigned long long)max);
+		timedfailed = true;
+	}
+	kprintf("\n");
+}
+
+static
+void
+timedfork(const char *name, void (*func)(void *, unsigned long),
+	  unsigned long arg)
+{
+	int result;
+
+	result = thread_fork(name, NULL, func, NULL, arg);
+	if (result) {
+		panic("timedwaittest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+}
+
+int
+timedwaittest(int nargs, char **args)
+{
+	static const unsigned tickcounts[] = { 1, 5, 20 };
+	uint64_t start;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	timedsem = sem_create("timedsem", 0);
+	timedcv = cv_create("timedcv");
+	if (timedsem == NULL || timedcv == NULL) {
+		panic("timedwaittest: out of memory\n");
+	}
+	timedloadstop = false;
+	timedfailed = false;
+
+	kprintf("Starting timed wait test (%d load threads)...\n", NTHREADS);
+	for (i=0; i<NTHREADS; i++) {
+		timedfork("timedload", timedloadthread, 0);
+	}
+
+	/* Nobody wakes us: these should all time out on time */
+	for (i=0; i<sizeof(tickcounts)/sizeof(tickcounts[0]); i++) {
+		start = getnsecs();
+		result = P_timed(timedsem, tickcounts[i]);
+		timedcheck("P_timed", tickcounts[i], start,
+			   result, ETIMEDOUT);
+
+		lock_acquire(testlock);
+		start = getnsecs();
+		result = cv_timedwait(timedcv, testlock, tickcounts[i]);
+		lock_release(testlock);
+		timedcheck("cv_timedwait", tickcounts[i], start,
+			   result, ETIMEDOUT);
+	}
+
+	/* Now get woken up well before the timeout */
+	timedfork("timedwake", timedwakethread, 0);
+	start = getnsecs();
+	result = P_timed(timedsem, TIMEDLONG);
+	timedcheck("P_timed", TIMEDLONG, start, result, 0);
+
+	timedcond = false;
+	lock_acquire(testlock);
+	timedfork("timedwake", timedwakethread, 1);
+	start = getnsecs();
+	result = 0;
+	while (!timedcond && result == 0) {
+		result = cv_timedwait(timedcv, testlock, TIMEDLONG);
+	}
+	lock_release(testlock);
+	timedcheck("cv_timedwait", TIMEDLONG, start, result, 0);
+
+	timedloadstop = true;
+	for (i=0; i<NTHREADS+2; i++) {
+		P(donesem);
+	}
+
+	sem_destroy(timedsem);
+	cv_destroy(timedcv);
+	kprintf("%s\n", timedfailed ? "TEST FAILED" : "TEST SUCCEEDED");
+	kprintf("Timed wait test done.\n");
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Synch object creation benchmark.
+
+#define NCREATE 500
+
+/*
+ * Create and destroy NCREATE of one kind of synch object; report
+ * the time per create and destroy and the heap bytes per object.
+ */
+static
+void
+createbenchrun(const char *what, void **objs,
+	       void *(*create)(const char *), void (*destroy)(void *))
+{
+	uint64_t t1, t2, t3;
+	size_t used1, used2;
+	int i;
+
+	used1 = kheap_getused();
+	t1 = getnsecs();
+	for (i=0; i<NCREATE; i++) {
+		objs[i] = create(what);
+		if (objs[i] == NULL) {
+			panic("createbench: %s: out of memory\n", what);
+		}
+	}
+	t2 = getnsecs();
+	used2 = kheap_getused();
+	for (i=NCREATE-1; i>=0; i--) {
+		destroy(objs[i]);
+	}
+	t3 = getnsecs();
+
+	kprintf("%-5s: create %5llu ns, destroy %5llu ns, %4u bytes each\n",
+		what, (unsigned long long)((t2 - t1) / NCREATE),
+		(unsigned long long)((t3 - t2) / NCREATE),
+		(unsigned)((used2 - used1) / NCREATE));
+}
+
+/* Wrappers so createbenchrun can treat all kinds alike */
+static
+void *
+cb_semcreate(const char *name)
+{
+	return sem_create(name, 0);
+}
+
+static
+void
+cb_semdestroy(void *sem)
+{
+	sem_destroy(sem);
+}
+
+static
+void *
+cb_lockcreate(const char *name)
+{
+	return lock_create(name);
+}
+
+static
+void
+cb_lockdestroy(void *lock)
+{
+	lock_destroy(lock);
+}
+
+static
+void *
+cb_cvcreate(const char *name)
+{
+	return cv_create(name);
+}
+
+static
+void
+cb_cvdestroy(void *cv)
+{
+	cv_destroy(cv);
+}
+
+int
+createbench(int nargs, char **args)
+{
+	void **objs;
+
+	(void)nargs;
+	(void)args;
+
+	objs = kmalloc(NCREATE * sizeof(*objs));
+	if (objs == NULL) {
+		panic("createbench: out of memory\n");
+	}
+
+#if OPT_HASHWCHAN
+	kprintf("Synch object benchmark (hashed wait channels):\n");
+#else
+	kprintf("Synch object benchmark (one wait channel each):\n");
+#endif
+	createbenchrun("sem", objs, cb_semcreate, cb_semdestroy);
+	createbenchrun("lock", objs, cb_lockcreate, cb_lockdestroy);
+	createbenchrun("cv", objs, cb_cvcreate, cb_cvdestroy);
+
+	kfree(objs);
+	return 0;
+}
@@ -34,9 +34,11 @@
 #include <lib.h>
 #include <thread.h>
 #include <synch.h>
+#include <clock.h>
 #include <test.h>
 
 #define NTHREADS  8
+#define NFORKS    500
 
 static struct semaphore *tsem = NULL;
 
@@ -144,3 +146,62 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Fork latency benchmark: fork and reap NFORKS trivial threads, first
+ * with the thread cache turned off and then with it on, and report
+ * the average time per thread_fork and the cache hit rate.
+ */
+
+static
+void
+emptythread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+static
+void
+forkbenchrun(const char *what)
+{
+	uint64_t start, forktime;
+	unsigned hits, misses;
+	int i, result;
+
+	forktime = 0;
+	for (i=0; i<NFORKS; i++) {
+		start = getnsecs();
+		result = thread_fork("forkbench", NULL, emptythread, NULL, i);
+		forktime += getnsecs() - start;
+		if (result) {
+			panic("forkbench: thread_fork failed %s)\n",
+			      strerror(result));
+		}
+		P(tsem);
+	}
+
+	thread_cache_stats(&hits, &misses);
+	kprintf("%s: %llu ns per fork, cache %u hits / %u misses\n",
+		what, (unsigned long long)(forktime / NFORKS), hits, misses);
+}
+
+int
+threadforkbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	init_sem();
+	kprintf("Starting thread fork benchmark...\n");
+
+	thread_cache_setlimit(0);
+	forkbenchrun("cache off");
+	thread_cache_setlimit(THREAD_CACHE_MAX);
+	forkbenchrun("cache on ");
+
+	kprintf("Thread fork benchmark done.\n");
+	return 0;
+}
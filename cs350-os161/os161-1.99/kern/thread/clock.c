@@ -28,13 +28,18 @@
  */
 
 #include <types.h>
+#include <kern/timepage.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
+#include <kprof.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
+#include <vm.h>
+#include <machine/membar.h>
 
 /*
  * Time handling.
@@ -73,6 +78,20 @@ static struct wchan *minibolt;
  */
 static int minicount;
 
+/*
+ * Timeout queue, sorted by firing time, and the tick count it runs
+ * on. Both are protected by timeout_lock.
+ */
+static struct spinlock timeout_lock = SPINLOCK_INITIALIZER;
+static struct timeout *timeout_queue;
+static uint64_t timerticks;
+
+/*
+ * The time page (see <kern/timepage.h>). Only timerclock changes it
+ * once it's set up, and that runs on one cpu, so it needs no lock.
+ */
+static volatile struct timepage *timepage;
+
 /*
  * Setup.
  */
@@ -92,6 +111,55 @@ hardclock_bootstrap(void)
 	KASSERT(minicount > 0);
 }
 
+/*
+ * Put the current time in the time page, bracketed by bumps of the
+ * sequence count so readers can tell if they raced with us.
+ */
+static
+void
+timepage_update(volatile struct timepage *tp)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	tp->tp_seq++;
+	membar_store_store();
+	tp->tp_secs = secs;
+	tp->tp_nsecs = nsecs;
+	membar_store_store();
+	tp->tp_seq++;
+}
+
+/*
+ * Set up the time page. Needs the VM system.
+ */
+void
+timepage_bootstrap(void)
+{
+	volatile struct timepage *tp;
+	vaddr_t va;
+
+	va = alloc_kpages(1);
+	if (va == 0) {
+		panic("Couldn't allocate the time page\n");
+	}
+	bzero((void *)va, PAGE_SIZE);
+	tp = (volatile struct timepage *)va;
+
+	/* Fill it in before timerclock can see it */
+	timepage_update(tp);
+	membar_store_store();
+	timepage = tp;
+}
+
+vaddr_t
+timepage_kvaddr(void)
+{
+	KASSERT(timepage != NULL);
+	return (vaddr_t)timepage;
+}
+
 /*
  * This is called once every every LT_GRANULARITY usec, on one processor,
  * by the timer code.
@@ -99,6 +167,24 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
+	struct timeout *to;
+
+	if (timepage != NULL) {
+		timepage_update(timepage);
+	}
+
+	/* Run timeouts that are due */
+	spinlock_acquire(&timeout_lock);
+	timerticks++;
+	while (timeout_queue != NULL && timeout_queue->to_when <= timerticks) {
+		to = timeout_queue;
+		timeout_queue = to->to_next;
+		to->to_next = NULL;
+		to->to_pending = false;
+		to->to_func(to->to_arg);
+	}
+	spinlock_release(&timeout_lock);
+
 	/* Broadcast on minibolt */
 	wchan_wakeall(minibolt);
 	/* Broadcast on lbolt if a second has elapsed */
@@ -116,10 +202,24 @@ void
 hardclock(void)
 {
 	/*
-	 * Collect statistics here as desired.
+	 * Charge the tick to whoever it interrupted. When the cpu is
+	 * idle curthread is whatever thread last switched out, which
+	 * isn't using the cpu, so count it separately.
 	 */
-
 	curcpu->c_hardclocks++;
+	if (curcpu->c_isidle) {
+		curcpu->c_idleclocks++;
+	}
+	else if (curcpu->c_intr_fromuser) {
+		curthread->t_utime++;
+	}
+	else {
+		curthread->t_stime++;
+	}
+	if (kprof_enabled) {
+		kprof_sample();
+	}
+
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
@@ -129,6 +229,68 @@ hardclock(void)
 	thread_yield();
 }
 
+unsigned
+clock_tickspersec(void)
+{
+	return MINI_PER_SECOND;
+}
+
+/*
+ * Timeouts.
+ */
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *arg)
+{
+	to->to_next = NULL;
+	to->to_when = 0;
+	to->to_func = func;
+	to->to_arg = arg;
+	to->to_pending = false;
+}
+
+void
+timeout_add(struct timeout *to, unsigned ticks)
+{
+	struct timeout **tp;
+
+	spinlock_acquire(&timeout_lock);
+	KASSERT(!to->to_pending);
+
+	/* Round up: the tick we're in is already partly over */
+	to->to_when = timerticks + ticks + 1;
+	for (tp = &timeout_queue; *tp != NULL; tp = &(*tp)->to_next) {
+		if ((*tp)->to_when > to->to_when) {
+			break;
+		}
+	}
+	to->to_next = *tp;
+	*tp = to;
+	to->to_pending = true;
+
+	spinlock_release(&timeout_lock);
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	struct timeout **tp;
+	bool wasqueued;
+
+	spinlock_acquire(&timeout_lock);
+	wasqueued = to->to_pending;
+	if (wasqueued) {
+		for (tp = &timeout_queue; *tp != to; tp = &(*tp)->to_next) {
+			KASSERT(*tp != NULL);
+		}
+		*tp = to->to_next;
+		to->to_next = NULL;
+		to->to_pending = false;
+	}
+	spinlock_release(&timeout_lock);
+
+	return wasqueued;
+}
+
 /*
  * Suspend execution for n seconds.
  */
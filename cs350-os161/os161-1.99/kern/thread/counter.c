@@ -0,0 +1,100 @@
+/*
+ * Per-cpu statistics counters.
+ * The interface is described in counter.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <current.h>
+#include <counter.h>
+
+/* Names of the registered counters; slot N is counter N. */
+static const char *counter_names[COUNTER_MAX];
+static unsigned counter_num;
+static struct spinlock counter_lock = SPINLOCK_INITIALIZER;
+
+counter_t
+counter_register(const char *name)
+{
+	counter_t ctr;
+
+	spinlock_acquire(&counter_lock);
+	for (ctr=0; ctr<counter_num; ctr++) {
+		if (!strcmp(counter_names[ctr], name)) {
+			spinlock_release(&counter_lock);
+			return ctr;
+		}
+	}
+	if (counter_num == COUNTER_MAX) {
+		panic("counter_register: too many counters (adding %s)\n",
+		      name);
+	}
+	ctr = counter_num++;
+	counter_names[ctr] = name;
+	spinlock_release(&counter_lock);
+
+	/* Slots start out zero (see cpu_create); but be sure */
+	counter_reset(ctr);
+	return ctr;
+}
+
+void
+counter_add(counter_t ctr, uint32_t n)
+{
+	int spl;
+
+	KASSERT(ctr < counter_num);
+
+	/* No lock; just make sure we stay on this cpu and aren't
+	   interrupted by someone counting the same thing */
+	spl = splhigh();
+	curcpu->c_counters[ctr] += n;
+	splx(spl);
+}
+
+void
+counter_inc(counter_t ctr)
+{
+	counter_add(ctr, 1);
+}
+
+uint64_t
+counter_read(counter_t ctr)
+{
+	uint64_t total;
+	unsigned i;
+
+	KASSERT(ctr < counter_num);
+
+	total = 0;
+	for (i=0; i<cpu_numcpus(); i++) {
+		total += cpu_get(i)->c_counters[ctr];
+	}
+	return total;
+}
+
+void
+counter_reset(counter_t ctr)
+{
+	unsigned i;
+
+	KASSERT(ctr < counter_num);
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		cpu_get(i)->c_counters[ctr] = 0;
+	}
+}
+
+void
+counter_printall(void)
+{
+	counter_t ctr;
+
+	for (ctr=0; ctr<counter_num; ctr++) {
+		kprintf("%-30s %12llu\n", counter_names[ctr],
+			(unsigned long long)counter_read(ctr));
+	}
+}
@@ -0,0 +1,543 @@
+/*
+ * Sampling kernel profiler.
+ * The interface is described in kprof.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <elf.h>
+#include <kprof.h>
+
+volatile bool kprof_enabled = false;
+
+/* Per-cpu sample buffer; hung off c_kprof. */
+struct kprof_buf {
+	vaddr_t kb_pcs[KPROF_NSAMPLES];	/* Ring of sampled PCs */
+	unsigned kb_next;		/* Slot for the next one */
+	unsigned kb_count;		/* Kernel samples taken, ever */
+	unsigned kb_user;		/* Ticks that were in user mode */
+	unsigned kb_idle;		/* Ticks that found the cpu idle */
+};
+
+/* Histogram of PCs, gathered from all cpus for printing. */
+#define KPROF_HASHSIZE 4096
+
+struct kprof_bucket {
+	vaddr_t kb_pc;
+	unsigned kb_hits;
+};
+
+struct kprof_hist {
+	struct kprof_bucket kh_buckets[KPROF_HASHSIZE];
+	unsigned kh_samples;		/* Samples in the buckets */
+	unsigned kh_overflow;		/* Samples that didn't fit */
+	unsigned kh_lost;		/* Samples overwritten in the rings */
+	unsigned kh_user;
+	unsigned kh_idle;
+};
+
+/* Function symbols from the kernel image, sorted by address. */
+struct kprof_sym {
+	vaddr_t ks_addr;
+	vaddr_t ks_end;
+	const char *ks_name;		/* Points into kprof_strtab */
+};
+
+static struct kprof_sym *kprof_syms;
+static unsigned kprof_nsyms;
+static char *kprof_strtab;
+static char *kprof_sympath;		/* Image they were loaded from */
+
+void
+kprof_sample(void)
+{
+	struct kprof_buf *kb;
+
+	/* Called from hardclock, so interrupts are already off */
+	kb = curcpu->c_kprof;
+	if (kb == NULL) {
+		return;
+	}
+
+	if (curcpu->c_isidle) {
+		kb->kb_idle++;
+	}
+	else if (curcpu->c_intr_fromuser) {
+		kb->kb_user++;
+	}
+	else {
+		kb->kb_pcs[kb->kb_next] = curcpu->c_intr_pc;
+		kb->kb_next = (kb->kb_next + 1) % KPROF_NSAMPLES;
+		kb->kb_count++;
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Control.
+
+/*
+ * Allocate buffers for any cpus that don't have one yet, and turn
+ * sampling on. As with lockstat, buffers are never freed.
+ */
+int
+kprof_start(void)
+{
+	struct kprof_buf *kb;
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		if (c->c_kprof != NULL) {
+			continue;
+		}
+		kb = kmalloc(sizeof(*kb));
+		if (kb == NULL) {
+			return ENOMEM;
+		}
+		bzero(kb, sizeof(*kb));
+		c->c_kprof = kb;
+	}
+	kprof_enabled = true;
+	return 0;
+}
+
+void
+kprof_stop(void)
+{
+	kprof_enabled = false;
+}
+
+/*
+ * Throw away the samples. Stop sampling first for a clean reset;
+ * otherwise a cpu sampling at the time may leave a stray count.
+ */
+void
+kprof_reset(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		if (c->c_kprof != NULL) {
+			bzero(c->c_kprof, sizeof(*c->c_kprof));
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Gathering samples.
+
+static
+void
+kprof_hist_add(struct kprof_hist *kh, vaddr_t pc)
+{
+	struct kprof_bucket *kb;
+	unsigned i, h;
+
+	/* Instructions are 4-byte aligned */
+	h = (pc >> 2) % KPROF_HASHSIZE;
+	for (i=0; i<KPROF_HASHSIZE; i++) {
+		kb = &kh->kh_buckets[(h + i) % KPROF_HASHSIZE];
+		if (kb->kb_hits == 0) {
+			kb->kb_pc = pc;
+		}
+		if (kb->kb_pc == pc) {
+			kb->kb_hits++;
+			kh->kh_samples++;
+			return;
+		}
+	}
+	kh->kh_overflow++;
+}
+
+/*
+ * Collect the samples from all cpus into a histogram. Returns NULL
+ * if out of memory.
+ */
+static
+struct kprof_hist *
+kprof_hist_gather(void)
+{
+	struct kprof_hist *kh;
+	struct kprof_buf *kb;
+	unsigned i, j, n;
+
+	kh = kmalloc(sizeof(*kh));
+	if (kh == NULL) {
+		return NULL;
+	}
+	bzero(kh, sizeof(*kh));
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		kb = cpu_get(i)->c_kprof;
+		if (kb == NULL) {
+			continue;
+		}
+		n = kb->kb_count < KPROF_NSAMPLES ?
+			kb->kb_count : KPROF_NSAMPLES;
+		for (j=0; j<n; j++) {
+			kprof_hist_add(kh, kb->kb_pcs[j]);
+		}
+		kh->kh_lost += kb->kb_count - n;
+		kh->kh_user += kb->kb_user;
+		kh->kh_idle += kb->kb_idle;
+	}
+	return kh;
+}
+
+static
+void
+kprof_hist_summary(struct kprof_hist *kh)
+{
+	kprintf("kprof: %u kernel samples, %u user, %u idle",
+		kh->kh_samples, kh->kh_user, kh->kh_idle);
+	if (kh->kh_lost > 0) {
+		kprintf(", %u older ones overwritten", kh->kh_lost);
+	}
+	if (kh->kh_overflow > 0) {
+		kprintf(", %u not tallied (table full)", kh->kh_overflow);
+	}
+	kprintf("\n");
+}
+
+/*
+ * Print the raw histogram, one "pc count" line per distinct PC,
+ * between markers host-kprof looks for.
+ */
+void
+kprof_dump(void)
+{
+	struct kprof_hist *kh;
+	struct kprof_bucket *kb;
+	unsigned i;
+
+	kh = kprof_hist_gather();
+	if (kh == NULL) {
+		kprintf("kprof: Out of memory\n");
+		return;
+	}
+
+	kprintf("kprof-begin\n");
+	for (i=0; i<KPROF_HASHSIZE; i++) {
+		kb = &kh->kh_buckets[i];
+		if (kb->kb_hits > 0) {
+			kprintf("0x%08x %u\n", kb->kb_pc, kb->kb_hits);
+		}
+	}
+	kprintf("kprof-end\n");
+	kprof_hist_summary(kh);
+
+	kfree(kh);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Symbols.
+
+/*
+ * Read LEN bytes at offset OFFSET of file V into BUF.
+ */
+static
+int
+kprof_read(struct vnode *v, off_t offset, void *buf, size_t len)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	uio_kinit(&iov, &ku, buf, len, offset, UIO_READ);
+	result = VOP_READ(v, &ku);
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		return ENOEXEC;
+	}
+	return 0;
+}
+
+static
+void
+kprof_freesyms(void)
+{
+	if (kprof_syms != NULL) {
+		kfree(kprof_syms);
+		kfree(kprof_strtab);
+		kfree(kprof_sympath);
+	}
+	kprof_syms = NULL;
+	kprof_strtab = NULL;
+	kprof_sympath = NULL;
+	kprof_nsyms = 0;
+}
+
+/*
+ * Load the function symbols from the kernel image PATH, unless
+ * that's where the ones we have came from.
+ */
+static
+int
+kprof_loadsyms(const char *path)
+{
+	struct vnode *v;
+	Elf32_Ehdr eh;
+	Elf32_Shdr *shdrs = NULL;
+	Elf32_Sym *esyms = NULL;
+	struct kprof_sym *syms = NULL, tmp;
+	char *strtab = NULL, *pathcopy;
+	const Elf32_Shdr *symsh, *strsh;
+	unsigned i, j, nesyms, nsyms;
+	int result;
+
+	if (kprof_sympath != NULL && !strcmp(kprof_sympath, path)) {
+		return 0;
+	}
+
+	/* vfs_open destroys the string it's passed */
+	pathcopy = kstrdup(path);
+	if (pathcopy == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_open(pathcopy, O_RDONLY, 0, &v);
+	kfree(pathcopy);
+	if (result) {
+		return result;
+	}
+
+	result = kprof_read(v, 0, &eh, sizeof(eh));
+	if (result) {
+		goto fail;
+	}
+	if (eh.e_ident[EI_MAG0] != ELFMAG0 ||
+	    eh.e_ident[EI_MAG1] != ELFMAG1 ||
+	    eh.e_ident[EI_MAG2] != ELFMAG2 ||
+	    eh.e_ident[EI_MAG3] != ELFMAG3 ||
+	    eh.e_ident[EI_CLASS] != ELFCLASS32 ||
+	    eh.e_shentsize != sizeof(Elf32_Shdr)) {
+		result = ENOEXEC;
+		goto fail;
+	}
+
+	shdrs = kmalloc(eh.e_shnum * sizeof(Elf32_Shdr));
+	if (shdrs == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+	result = kprof_read(v, eh.e_shoff, shdrs,
+			    eh.e_shnum * sizeof(Elf32_Shdr));
+	if (result) {
+		goto fail;
+	}
+
+	symsh = NULL;
+	for (i=0; i<eh.e_shnum; i++) {
+		if (shdrs[i].sh_type == SHT_SYMTAB) {
+			symsh = &shdrs[i];
+			break;
+		}
+	}
+	if (symsh == NULL || symsh->sh_link >= eh.e_shnum) {
+		/* stripped */
+		result = ENOEXEC;
+		goto fail;
+	}
+	strsh = &shdrs[symsh->sh_link];
+
+	nesyms = symsh->sh_size / sizeof(Elf32_Sym);
+	esyms = kmalloc(nesyms * sizeof(Elf32_Sym));
+	strtab = kmalloc(strsh->sh_size + 1);
+	if (esyms == NULL || strtab == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+	result = kprof_read(v, symsh->sh_offset, esyms,
+			    nesyms * sizeof(Elf32_Sym));
+	if (result) {
+		goto fail;
+	}
+	result = kprof_read(v, strsh->sh_offset, strtab, strsh->sh_size);
+	if (result) {
+		goto fail;
+	}
+	strtab[strsh->sh_size] = 0;
+
+	nsyms = 0;
+	for (i=0; i<nesyms; i++) {
+		if (ELF32_ST_TYPE(esyms[i].st_info) == STT_FUNC &&
+		    esyms[i].st_value != 0 &&
+		    esyms[i].st_name < strsh->sh_size) {
+			nsyms++;
+		}
+	}
+	syms = kmalloc(nsyms * sizeof(*syms));
+	if (syms == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+
+	/* Insertion sort by address; there are only a few thousand */
+	nsyms = 0;
+	for (i=0; i<nesyms; i++) {
+		if (ELF32_ST_TYPE(esyms[i].st_info) != STT_FUNC ||
+		    esyms[i].st_value == 0 ||
+		    esyms[i].st_name >= strsh->sh_size) {
+			continue;
+		}
+		tmp.ks_addr = esyms[i].st_value;
+		tmp.ks_end = esyms[i].st_value + esyms[i].st_size;
+		tmp.ks_name = strtab + esyms[i].st_name;
+		for (j=nsyms; j>0 && syms[j-1].ks_addr > tmp.ks_addr; j--) {
+			syms[j] = syms[j-1];
+		}
+		syms[j] = tmp;
+		nsyms++;
+	}
+	/* Assembler functions often have no size; run to the next one */
+	for (i=0; i<nsyms; i++) {
+		if (syms[i].ks_end == syms[i].ks_addr && i+1 < nsyms) {
+			syms[i].ks_end = syms[i+1].ks_addr;
+		}
+	}
+
+	vfs_close(v);
+	kfree(esyms);
+	kfree(shdrs);
+
+	kprof_freesyms();
+	kprof_sympath = kstrdup(path);
+	if (kprof_sympath == NULL) {
+		kfree(syms);
+		kfree(strtab);
+		return ENOMEM;
+	}
+	kprof_syms = syms;
+	kprof_nsyms = nsyms;
+	kprof_strtab = strtab;
+	return 0;
+
+ fail:
+	vfs_close(v);
+	if (syms != NULL) {
+		kfree(syms);
+	}
+	if (strtab != NULL) {
+		kfree(strtab);
+	}
+	if (esyms != NULL) {
+		kfree(esyms);
+	}
+	if (shdrs != NULL) {
+		kfree(shdrs);
+	}
+	return result;
+}
+
+/*
+ * Find the function containing PC. Returns its index in kprof_syms,
+ * or -1.
+ */
+static
+int
+kprof_lookup(vaddr_t pc)
+{
+	unsigned lo, hi, mid;
+
+	/* Find the last symbol starting at or before PC */
+	lo = 0;
+	hi = kprof_nsyms;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (kprof_syms[mid].ks_addr <= pc) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	if (lo == 0 || pc >= kprof_syms[lo-1].ks_end) {
+		return -1;
+	}
+	return lo - 1;
+}
+
+int
+kprof_print(unsigned topn, const char *path)
+{
+	struct kprof_hist *kh;
+	struct kprof_bucket *kb;
+	unsigned *hits;
+	unsigned i, n, best, unknown;
+	int sym, result;
+
+	result = kprof_loadsyms(path);
+	if (result) {
+		return result;
+	}
+
+	kh = kprof_hist_gather();
+	if (kh == NULL) {
+		return ENOMEM;
+	}
+	hits = kmalloc(kprof_nsyms * sizeof(unsigned));
+	if (hits == NULL) {
+		kfree(kh);
+		return ENOMEM;
+	}
+	bzero(hits, kprof_nsyms * sizeof(unsigned));
+
+	unknown = 0;
+	for (i=0; i<KPROF_HASHSIZE; i++) {
+		kb = &kh->kh_buckets[i];
+		if (kb->kb_hits == 0) {
+			continue;
+		}
+		sym = kprof_lookup(kb->kb_pc);
+		if (sym < 0) {
+			unknown += kb->kb_hits;
+		}
+		else {
+			hits[sym] += kb->kb_hits;
+		}
+	}
+
+	kprof_hist_summary(kh);
+	kprintf("%8s %7s  %s\n", "samples", "%", "function");
+
+	/* Selection sort; pull out the busiest remaining function */
+	for (n=0; n<topn; n++) {
+		best = kprof_nsyms;
+		for (i=0; i<kprof_nsyms; i++) {
+			if (hits[i] > 0 &&
+			    (best == kprof_nsyms || hits[i] > hits[best])) {
+				best = i;
+			}
+		}
+		if (best == kprof_nsyms) {
+			break;
+		}
+		kprintf("%8u %4u.%u%%  %s\n", hits[best],
+			hits[best] * 100 / kh->kh_samples,
+			hits[best] * 1000 / kh->kh_samples % 10,
+			kprof_syms[best].ks_name);
+		hits[best] = 0;
+	}
+	if (unknown > 0) {
+		kprintf("%8u          (not in any function)\n", unknown);
+	}
+
+	kfree(hits);
+	kfree(kh);
+	return 0;
+}
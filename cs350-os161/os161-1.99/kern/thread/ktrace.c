@@ -0,0 +1,305 @@
+/*
+ * Kernel event tracing.
+ * The interface is described in ktrace.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <clock.h>
+#include <current.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <lamebus/ltrace.h>
+#include <ktrace.h>
+
+volatile uint32_t ktrace_mask = 0;
+static volatile bool ktrace_mirroring = false;
+
+static const char *const ktrace_names[KT_NEVENTS] = {
+	"switch",
+	"wakeup",
+	"syscall",
+	"sysret",
+	"vmfault",
+	"diskstart",
+	"diskdone",
+	"contend",
+};
+
+struct ktrace_rec {
+	uint64_t kr_time;		/* From getnsecs() */
+	uint32_t kr_thread;		/* curthread at the time */
+	uint16_t kr_event;		/* KT_* */
+	uint16_t kr_cpu;
+	uint32_t kr_arg1;
+	uint32_t kr_arg2;
+};
+
+/* Per-cpu trace buffer; hung off c_ktrace. */
+struct ktrace_buf {
+	struct ktrace_rec kb_recs[KTRACE_NRECS]; /* Ring of records */
+	unsigned kb_next;		/* Slot for the next one */
+	unsigned kb_count;		/* Records taken, ever */
+};
+
+const char *
+ktrace_eventname(unsigned event)
+{
+	if (event >= KT_NEVENTS) {
+		return NULL;
+	}
+	return ktrace_names[event];
+}
+
+void
+ktrace_record(unsigned event, uint32_t arg1, uint32_t arg2)
+{
+	struct ktrace_buf *kb;
+	struct ktrace_rec *kr;
+	int spl;
+
+	/* No lock; the ring is only written by this cpu */
+	spl = splhigh();
+	kb = curcpu->c_ktrace;
+	if (kb != NULL) {
+		kr = &kb->kb_recs[kb->kb_next];
+		kr->kr_time = getnsecs();
+		kr->kr_thread = (uint32_t)curthread;
+		kr->kr_event = event;
+		kr->kr_cpu = curcpu->c_number;
+		kr->kr_arg1 = arg1;
+		kr->kr_arg2 = arg2;
+		kb->kb_next = (kb->kb_next + 1) % KTRACE_NRECS;
+		kb->kb_count++;
+	}
+	if (ktrace_mirroring) {
+		/* 8 bits of event, 24 of the first argument */
+		ltrace_debug((event << 24) | (arg1 & 0xffffff));
+	}
+	splx(spl);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Control.
+
+/*
+ * Allocate buffers for any cpus that don't have one yet, and turn
+ * recording on. As with lockstat, buffers are never freed.
+ */
+int
+ktrace_start(uint32_t mask)
+{
+	struct ktrace_buf *kb;
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		if (c->c_ktrace != NULL) {
+			continue;
+		}
+		kb = kmalloc(sizeof(*kb));
+		if (kb == NULL) {
+			return ENOMEM;
+		}
+		bzero(kb, sizeof(*kb));
+		c->c_ktrace = kb;
+	}
+	ktrace_mask = mask & KT_ALL;
+	return 0;
+}
+
+void
+ktrace_stop(void)
+{
+	ktrace_mask = 0;
+}
+
+/*
+ * Throw away the records. Stop recording first for a clean reset;
+ * otherwise a cpu recording at the time may leave a stray record.
+ */
+void
+ktrace_reset(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		if (c->c_ktrace != NULL) {
+			bzero(c->c_ktrace, sizeof(*c->c_ktrace));
+		}
+	}
+}
+
+void
+ktrace_mirror(bool on)
+{
+	ktrace_mirroring = on;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Dumping.
+
+/* Where the dump goes: the console if ko_vn is NULL. */
+struct ktrace_out {
+	struct vnode *ko_vn;
+	off_t ko_offset;
+	int ko_result;			/* First write error */
+};
+
+static
+void
+ktrace_emit(struct ktrace_out *ko, const char *line)
+{
+	struct iovec iov;
+	struct uio ku;
+	size_t len;
+	int result;
+
+	if (ko->ko_vn == NULL) {
+		kprintf("%s", line);
+		return;
+	}
+	if (ko->ko_result) {
+		return;
+	}
+
+	len = strlen(line);
+	uio_kinit(&iov, &ku, (void *)line, len, ko->ko_offset, UIO_WRITE);
+	result = VOP_WRITE(ko->ko_vn, &ku);
+	if (result == 0 && ku.uio_resid != 0) {
+		result = ENOSPC;
+	}
+	ko->ko_result = result;
+	ko->ko_offset += len;
+}
+
+/*
+ * Merge the cpus' rings into time order and write one line per
+ * record between markers host-ktrace looks for:
+ *
+ *    nsecs cpu thread event arg1 arg2
+ */
+static
+void
+ktrace_dump_records(struct ktrace_out *ko, unsigned *pos, unsigned *left)
+{
+	struct ktrace_buf *kb;
+	struct ktrace_rec *kr, *best;
+	unsigned i, bestcpu, total, lost;
+	char line[96];
+
+	total = lost = 0;
+	for (i=0; i<cpu_numcpus(); i++) {
+		kb = cpu_get(i)->c_ktrace;
+		if (kb == NULL) {
+			left[i] = 0;
+			continue;
+		}
+		if (kb->kb_count > KTRACE_NRECS) {
+			/* Wrapped; the oldest is the one about to be reused */
+			pos[i] = kb->kb_next;
+			left[i] = KTRACE_NRECS;
+			lost += kb->kb_count - KTRACE_NRECS;
+		}
+		else {
+			pos[i] = 0;
+			left[i] = kb->kb_count;
+		}
+		total += left[i];
+	}
+
+	ktrace_emit(ko, "ktrace-begin\n");
+	while (1) {
+		best = NULL;
+		bestcpu = 0;
+		for (i=0; i<cpu_numcpus(); i++) {
+			if (left[i] == 0) {
+				continue;
+			}
+			kr = &cpu_get(i)->c_ktrace->kb_recs[pos[i]];
+			if (best == NULL || kr->kr_time < best->kr_time) {
+				best = kr;
+				bestcpu = i;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		pos[bestcpu] = (pos[bestcpu] + 1) % KTRACE_NRECS;
+		left[bestcpu]--;
+
+		snprintf(line, sizeof(line), "%llu %u 0x%08x %s 0x%08x 0x%08x\n",
+			 (unsigned long long)best->kr_time, best->kr_cpu,
+			 best->kr_thread,
+			 best->kr_event < KT_NEVENTS ?
+			 ktrace_names[best->kr_event] : "?",
+			 best->kr_arg1, best->kr_arg2);
+		ktrace_emit(ko, line);
+	}
+	ktrace_emit(ko, "ktrace-end\n");
+
+	kprintf("ktrace: %u records", total);
+	if (lost > 0) {
+		kprintf(", %u older ones overwritten", lost);
+	}
+	kprintf("\n");
+}
+
+int
+ktrace_dump(const char *path)
+{
+	struct ktrace_out ko;
+	unsigned *pos, *left;
+	char *pathcopy;
+	int result;
+
+	/* Writing the file would trace itself, and the rings mustn't move */
+	ktrace_stop();
+
+	pos = kmalloc(cpu_numcpus() * sizeof(*pos));
+	left = kmalloc(cpu_numcpus() * sizeof(*left));
+	if (pos == NULL || left == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+
+	ko.ko_vn = NULL;
+	ko.ko_offset = 0;
+	ko.ko_result = 0;
+	if (path != NULL) {
+		/* vfs_open destroys the string it's passed */
+		pathcopy = kstrdup(path);
+		if (pathcopy == NULL) {
+			result = ENOMEM;
+			goto out;
+		}
+		result = vfs_open(pathcopy, O_WRONLY|O_CREAT|O_TRUNC, 0664,
+				  &ko.ko_vn);
+		kfree(pathcopy);
+		if (result) {
+			goto out;
+		}
+	}
+
+	ktrace_dump_records(&ko, pos, left);
+
+	result = ko.ko_result;
+	if (ko.ko_vn != NULL) {
+		vfs_close(ko.ko_vn);
+	}
+ out:
+	/* kfree copes with NULL */
+	kfree(pos);
+	kfree(left);
+	return result;
+}
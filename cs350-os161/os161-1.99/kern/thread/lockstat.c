@@ -0,0 +1,336 @@
+/*
+ * Lock contention statistics.
+ * The interface is described in lockstat.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <clock.h>
+#include <current.h>
+#include <lockstat.h>
+
+volatile bool lockstat_enabled = false;
+
+static const char *const lockstat_kindnames[] = {
+	"spinlock",
+	"lock",
+	"sem",
+	"cv",
+};
+
+/*
+ * Hash a lock address to a bucket. Locks are kmalloc'd, so the low
+ * few bits carry nothing.
+ */
+static
+unsigned
+lockstat_hash(const void *lk, unsigned kind)
+{
+	uintptr_t x = (uintptr_t)lk;
+
+	return ((x >> 3) ^ (x >> 11) ^ kind) % LOCKSTAT_HASHSIZE;
+}
+
+/*
+ * Find (or make) the entry for lock LK in table LT, with linear
+ * probing. Returns NULL if the table is full.
+ */
+static
+struct lockstat_entry *
+lockstat_lookup(struct lockstat_table *lt, const void *lk, unsigned kind,
+		bool create)
+{
+	struct lockstat_entry *le;
+	unsigned i, h;
+
+	h = lockstat_hash(lk, kind);
+	for (i=0; i<LOCKSTAT_HASHSIZE; i++) {
+		le = &lt->lt_entries[(h + i) % LOCKSTAT_HASHSIZE];
+		if (le->le_lock == lk && le->le_kind == kind) {
+			return le;
+		}
+		if (le->le_lock == NULL) {
+			if (!create) {
+				return NULL;
+			}
+			le->le_lock = lk;
+			le->le_kind = kind;
+			return le;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+lockstat_setname(struct lockstat_entry *le, const char *name)
+{
+	unsigned i;
+
+	if (name == NULL) {
+		name = lockstat_kindnames[le->le_kind];
+	}
+	for (i=0; i<LOCKSTAT_NAMELEN-1 && name[i] != 0; i++) {
+		le->le_name[i] = name[i];
+	}
+	le->le_name[i] = 0;
+}
+
+void
+lockstat_acquired(const void *lk, unsigned kind, const char *name,
+		  vaddr_t caller, uint64_t waitns, bool contended)
+{
+	struct lockstat_table *lt;
+	struct lockstat_entry *le;
+	int spl;
+
+	/* Keep our own interrupt handlers out of the table */
+	spl = splhigh();
+
+	lt = curcpu->c_lockstat;
+	if (lt == NULL) {
+		splx(spl);
+		return;
+	}
+
+	le = lockstat_lookup(lt, lk, kind, true);
+	if (le == NULL) {
+		lt->lt_overflow++;
+		splx(spl);
+		return;
+	}
+	if (le->le_acquires == 0) {
+		lockstat_setname(le, name);
+		le->le_caller = caller;
+	}
+
+	le->le_acquires++;
+	if (contended) {
+		le->le_contended++;
+		le->le_waittime += waitns;
+		if (waitns > le->le_maxwait) {
+			le->le_maxwait = waitns > 0xffffffff ?
+				0xffffffff : waitns;
+		}
+	}
+	if (kind == LOCKSTAT_SPINLOCK) {
+		le->le_holdstart = getnsecs();
+	}
+
+	splx(spl);
+}
+
+void
+lockstat_released(const void *lk, unsigned kind, uint64_t holdns)
+{
+	struct lockstat_table *lt;
+	struct lockstat_entry *le;
+	int spl;
+
+	spl = splhigh();
+
+	lt = curcpu->c_lockstat;
+	if (lt == NULL) {
+		splx(spl);
+		return;
+	}
+
+	le = lockstat_lookup(lt, lk, kind, false);
+	if (le == NULL) {
+		/* not seen since we started; nothing to charge */
+		splx(spl);
+		return;
+	}
+
+	if (kind == LOCKSTAT_SPINLOCK) {
+		if (le->le_holdstart == 0) {
+			splx(spl);
+			return;
+		}
+		holdns = getnsecs() - le->le_holdstart;
+		le->le_holdstart = 0;
+	}
+	le->le_holdtime += holdns;
+	if (holdns > le->le_maxhold) {
+		le->le_maxhold = holdns > 0xffffffff ? 0xffffffff : holdns;
+	}
+
+	splx(spl);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Control and reporting.
+
+/*
+ * Allocate tables for any cpus that don't have one yet, and turn
+ * collection on. Tables are never freed; with dumbvm the space
+ * couldn't be reused anyway.
+ */
+int
+lockstat_start(void)
+{
+	struct lockstat_table *lt;
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		if (c->c_lockstat != NULL) {
+			continue;
+		}
+		lt = kmalloc(sizeof(*lt));
+		if (lt == NULL) {
+			return ENOMEM;
+		}
+		bzero(lt, sizeof(*lt));
+		c->c_lockstat = lt;
+	}
+	lockstat_enabled = true;
+	return 0;
+}
+
+void
+lockstat_stop(void)
+{
+	lockstat_enabled = false;
+}
+
+/*
+ * Clear the counts. Other cpus may be updating their tables while we
+ * do this, so counts for a lock in use right now may come out a bit
+ * off; stop collection first for an exact reset.
+ */
+void
+lockstat_reset(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		if (c->c_lockstat != NULL) {
+			bzero(c->c_lockstat, sizeof(*c->c_lockstat));
+		}
+	}
+}
+
+/*
+ * Fold the per-cpu entry LE into the summary table SUM.
+ */
+static
+void
+lockstat_merge(struct lockstat_table *sum, const struct lockstat_entry *le)
+{
+	struct lockstat_entry *se;
+
+	se = lockstat_lookup(sum, le->le_lock, le->le_kind, true);
+	if (se == NULL) {
+		sum->lt_overflow++;
+		return;
+	}
+	if (se->le_acquires == 0) {
+		memcpy(se->le_name, le->le_name, sizeof(se->le_name));
+		se->le_caller = le->le_caller;
+	}
+	se->le_acquires += le->le_acquires;
+	se->le_contended += le->le_contended;
+	se->le_waittime += le->le_waittime;
+	if (le->le_maxwait > se->le_maxwait) {
+		se->le_maxwait = le->le_maxwait;
+	}
+	se->le_holdtime += le->le_holdtime;
+	if (le->le_maxhold > se->le_maxhold) {
+		se->le_maxhold = le->le_maxhold;
+	}
+}
+
+/*
+ * Is A more contended than B? Order by contended acquisitions, then
+ * by total wait time.
+ */
+static
+bool
+lockstat_worse(const struct lockstat_entry *a, const struct lockstat_entry *b)
+{
+	if (a->le_contended != b->le_contended) {
+		return a->le_contended > b->le_contended;
+	}
+	return a->le_waittime > b->le_waittime;
+}
+
+void
+lockstat_print(unsigned topn)
+{
+	struct lockstat_table *sum;
+	struct lockstat_table *lt;
+	struct lockstat_entry *le, *best;
+	unsigned i, j, n, overflow;
+
+	sum = kmalloc(sizeof(*sum));
+	if (sum == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+	bzero(sum, sizeof(*sum));
+
+	overflow = 0;
+	for (i=0; i<cpu_numcpus(); i++) {
+		lt = cpu_get(i)->c_lockstat;
+		if (lt == NULL) {
+			continue;
+		}
+		overflow += lt->lt_overflow;
+		for (j=0; j<LOCKSTAT_HASHSIZE; j++) {
+			if (lt->lt_entries[j].le_lock != NULL) {
+				lockstat_merge(sum, &lt->lt_entries[j]);
+			}
+		}
+	}
+
+	kprintf("%-20s %-8s %10s %10s %12s %10s %12s %10s\n",
+		"name", "kind", "acquires", "contended", "wait(us)",
+		"maxwait", "hold(us)", "maxhold");
+
+	/* Selection sort; pull out the worst remaining entry each time */
+	for (n=0; n<topn; n++) {
+		best = NULL;
+		for (j=0; j<LOCKSTAT_HASHSIZE; j++) {
+			le = &sum->lt_entries[j];
+			if (le->le_lock == NULL || le->le_acquires == 0) {
+				continue;
+			}
+			if (best == NULL || lockstat_worse(le, best)) {
+				best = le;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+
+		if (best->le_kind == LOCKSTAT_SPINLOCK) {
+			kprintf("%p from 0x%08x\n", best->le_lock,
+				best->le_caller);
+		}
+		kprintf("%-20s %-8s %10u %10u %12llu %10u %12llu %10u\n",
+			best->le_name, lockstat_kindnames[best->le_kind],
+			best->le_acquires, best->le_contended,
+			(unsigned long long)(best->le_waittime / 1000),
+			best->le_maxwait / 1000,
+			(unsigned long long)(best->le_holdtime / 1000),
+			best->le_maxhold / 1000);
+
+		/* mark it printed */
+		best->le_acquires = 0;
+	}
+
+	if (overflow + sum->lt_overflow > 0) {
+		kprintf("(%u events not recorded: table full)\n",
+			overflow + sum->lt_overflow);
+	}
+
+	kfree(sum);
+}
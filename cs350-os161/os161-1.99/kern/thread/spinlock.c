@@ -36,11 +36,21 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <current.h>	/* for curcpu */
+#include <clock.h>
+#include <lockstat.h>
+#include <ktrace.h>
 
 /*
  * Spinlocks.
  */
 
+/*
+ * Backoff while waiting for a ticket, in loop iterations per CPU
+ * ahead of us in line. Waiting roughly in proportion to our place
+ * in line keeps the waiters from all rereading lk_now_serving
+ * (and fighting the holder for the bus) on every cycle.
+ */
+#define SPINLOCK_BACKOFF	16
 
 /*
  * Initialize spinlock.
@@ -48,7 +58,8 @@
 void
 spinlock_init(struct spinlock *lk)
 {
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_next_ticket, 0);
+	spinlock_data_set(&lk->lk_now_serving, 0);
 	lk->lk_holder = NULL;
 }
 
@@ -59,20 +70,25 @@ void
 spinlock_cleanup(struct spinlock *lk)
 {
 	KASSERT(lk->lk_holder == NULL);
-	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+	KASSERT(spinlock_data_get(&lk->lk_next_ticket) ==
+		spinlock_data_get(&lk->lk_now_serving));
 }
 
 /*
  * Get the lock.
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * might come back to this lock and deadlock), then take a ticket with
+ * a machine-level atomic increment and wait for our turn.
  */
 void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket, serving;
+	volatile unsigned i;
+	bool contended = false;
+	uint64_t start = 0;
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -87,27 +103,32 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
+	ticket = spinlock_data_fetchadd(&lk->lk_next_ticket);
 	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
+		serving = spinlock_data_get(&lk->lk_now_serving);
+		if (serving == ticket) {
+			break;
+		}
+		if (!contended) {
+			contended = true;
+			if (lockstat_enabled) {
+				start = getnsecs();
+			}
+			KTRACE(KT_CONTEND, lk, LOCKSTAT_SPINLOCK);
 		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
-			continue;
+		/* unsigned arithmetic copes with the counters wrapping */
+		for (i = (ticket - serving) * SPINLOCK_BACKOFF; i > 0; i--) {
+			/* nothing */
 		}
-		break;
 	}
 
 	lk->lk_holder = mycpu;
+
+	if (lockstat_enabled && mycpu != NULL) {
+		lockstat_acquired(lk, LOCKSTAT_SPINLOCK, NULL,
+				  (vaddr_t)__builtin_return_address(0),
+				  contended ? getnsecs() - start : 0, contended);
+	}
 }
 
 /*
@@ -119,10 +140,15 @@ spinlock_release(struct spinlock *lk)
 	/* this must work before curcpu initialization */
 	if (CURCPU_EXISTS()) {
 		KASSERT(lk->lk_holder == curcpu->c_self);
+		if (lockstat_enabled) {
+			lockstat_released(lk, LOCKSTAT_SPINLOCK, 0);
+		}
 	}
 
 	lk->lk_holder = NULL;
-	spinlock_data_set(&lk->lk_lock, 0);
+	/* only the holder writes lk_now_serving, so no atomic op needed */
+	spinlock_data_set(&lk->lk_now_serving,
+			  spinlock_data_get(&lk->lk_now_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -33,12 +33,18 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <clock.h>
+#include <lockstat.h>
+#include <ktrace.h>
+
+#include "opt-hashwchan.h"
 
 ////////////////////////////////////////////////////////////
 //
@@ -62,12 +68,16 @@ sem_create(const char *name, int initial_count)
                 return NULL;
         }
 
+#if OPT_HASHWCHAN
+	sem->sem_wchan = wchan_hashed(sem, false);
+#else
 	sem->sem_wchan = wchan_create(sem->sem_name);
 	if (sem->sem_wchan == NULL) {
 		kfree(sem->sem_name);
 		kfree(sem);
 		return NULL;
 	}
+#endif
 
 	spinlock_init(&sem->sem_lock);
         sem->sem_count = initial_count;
@@ -90,6 +100,10 @@ sem_destroy(struct semaphore *sem)
 void 
 P(struct semaphore *sem)
 {
+	bool contended = false;
+	bool handedoff = false;
+	uint64_t start = 0;
+
         KASSERT(sem != NULL);
 
         /*
@@ -102,51 +116,276 @@ P(struct semaphore *sem)
 
 	spinlock_acquire(&sem->sem_lock);
         while (sem->sem_count == 0) {
+		if (!contended) {
+			contended = true;
+			if (lockstat_enabled) {
+				start = getnsecs();
+			}
+			KTRACE(KT_CONTEND, sem, LOCKSTAT_SEM);
+		}
 		/*
 		 * Bridge to the wchan lock, so if someone else comes
 		 * along in V right this instant the wakeup can't go
 		 * through on the wchan until we've finished going to
 		 * sleep. Note that wchan_sleep unlocks the wchan.
 		 *
-		 * Note that we don't maintain strict FIFO ordering of
-		 * threads going through the semaphore; that is, we
-		 * might "get" it on the first try even if other
-		 * threads are waiting. Apparently according to some
-		 * textbooks semaphores must for some reason have
-		 * strict ordering. Too bad. :-)
-		 *
-		 * Exercise: how would you implement strict FIFO
-		 * ordering?
+		 * V hands its count directly to a sleeper rather than
+		 * incrementing sem_count, so once anyone is waiting
+		 * nobody can "get" the semaphore ahead of them, and a
+		 * thread that is woken never has to go back to sleep.
 		 */
 		wchan_lock(sem->sem_wchan);
 		spinlock_release(&sem->sem_lock);
                 wchan_sleep(sem->sem_wchan);
 
+		/*
+		 * Retake sem_lock even after a handoff: the thread in V
+		 * still holds it, and the semaphore mustn't be destroyed
+		 * (as the caller may do the moment we return) until
+		 * it's let go.
+		 */
 		spinlock_acquire(&sem->sem_lock);
+		if (curthread->t_handoff) {
+			curthread->t_handoff = false;
+			handedoff = true;
+			break;
+		}
         }
-        KASSERT(sem->sem_count > 0);
-        sem->sem_count--;
+	if (!handedoff) {
+		KASSERT(sem->sem_count > 0);
+		sem->sem_count--;
+	}
 	spinlock_release(&sem->sem_lock);
+
+	if (lockstat_enabled) {
+		lockstat_acquired(sem, LOCKSTAT_SEM, sem->sem_name, 0,
+				  start != 0 ? getnsecs() - start : 0,
+				  contended);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timed waits.
+//
+// A timed wait puts a timeout on the clock's timeout queue that
+// pulls the thread back off the wait channel if it's still there
+// when the time is up.
+
+struct timedwait {
+	struct wchan *tw_wchan;		/* Channel we sleep on */
+	struct thread *tw_thread;	/* Who's sleeping */
+	volatile bool tw_fired;		/* The timeout has gone off */
+	volatile bool tw_woke;		/* ...and it woke us up */
+};
+
+/*
+ * Timeout function (runs in the timer interrupt).
+ */
+static
+void
+timedwait_expire(void *data)
+{
+	struct timedwait *tw = data;
+
+	wchan_lock(tw->tw_wchan);
+	tw->tw_fired = true;
+	tw->tw_woke = wchan_wakethread(tw->tw_wchan, tw->tw_thread);
+	wchan_unlock(tw->tw_wchan);
 }
 
+static
 void
-V(struct semaphore *sem)
+timedwait_init(struct timedwait *tw, struct timeout *to, struct wchan *wc)
+{
+	tw->tw_wchan = wc;
+	tw->tw_thread = curthread;
+	tw->tw_fired = false;
+	tw->tw_woke = false;
+	timeout_init(to, timedwait_expire, tw);
+}
+
+/*
+ * Sleep on the (locked) channel unless the timeout already went off
+ * while we were getting ready, and then make sure it won't go off
+ * later. Returns true if we timed out.
+ */
+static
+bool
+timedwait_sleep(struct timedwait *tw, struct timeout *to)
+{
+	bool timedout;
+
+	if (tw->tw_fired) {
+		wchan_unlock(tw->tw_wchan);
+		timedout = true;
+	}
+	else {
+		wchan_sleep(tw->tw_wchan);
+		timeout_cancel(to);
+		timedout = tw->tw_woke;
+	}
+	return timedout;
+}
+
+int
+P_timed(struct semaphore *sem, unsigned ticks)
 {
+	struct timedwait tw;
+	struct timeout to;
+
         KASSERT(sem != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_count > 0) {
+		sem->sem_count--;
+		spinlock_release(&sem->sem_lock);
+		return 0;
+	}
 
-        sem->sem_count++;
-        KASSERT(sem->sem_count > 0);
-	wchan_wakeone(sem->sem_wchan);
+	timedwait_init(&tw, &to, sem->sem_wchan);
+	timeout_add(&to, ticks);
+	wchan_lock(sem->sem_wchan);
+	spinlock_release(&sem->sem_lock);
+	timedwait_sleep(&tw, &to);
 
+	/* Wait out the thread in V, if any (see P) */
+	spinlock_acquire(&sem->sem_lock);
 	spinlock_release(&sem->sem_lock);
+
+	/* Only a handoff from V or the timeout can wake us (see P) */
+	if (curthread->t_handoff) {
+		curthread->t_handoff = false;
+		return 0;
+	}
+	return ETIMEDOUT;
+}
+
+/*
+ * V, passing the count straight to a sleeping thread if there is one
+ * (see P). HERE is passed on to wchan_handoff.
+ */
+static
+void
+sem_release(struct semaphore *sem, bool here)
+{
+	spinlock_acquire(&sem->sem_lock);
+
+	if (wchan_handoff(sem->sem_wchan, here) == NULL) {
+		sem->sem_count++;
+		KASSERT(sem->sem_count > 0);
+	}
+
+	spinlock_release(&sem->sem_lock);
+}
+
+void
+V(struct semaphore *sem)
+{
+        KASSERT(sem != NULL);
+
+	sem_release(sem, false);
+}
+
+void
+sem_vp(struct semaphore *vsem, struct semaphore *psem)
+{
+	KASSERT(vsem != NULL);
+	KASSERT(psem != NULL);
+
+	/* We're about to block, so whoever we wake can have our cpu */
+	sem_release(vsem, true);
+	P(psem);
 }
 
 ////////////////////////////////////////////////////////////
 //
 // Lock.
 
+/*
+ * Priority inheritance.
+ *
+ * A thread that has to wait for a lock donates its effective priority
+ * to the owner, and if the owner is itself waiting for a lock, to that
+ * lock's owner, and so on, for at most LOCK_PI_MAXDEPTH links.
+ *
+ * lk_donated remembers the highest priority donated through a lock
+ * until its last waiter has gone. This lets a new owner pick up the
+ * priority of the threads still queued behind it, and lets an owner
+ * that holds several locks work out what it is still entitled to
+ * when it releases one of them.
+ *
+ * pi_lock protects t_effpriority and t_blocked_on of every thread,
+ * lk_donated of every lock, and lk_owner of any lock with waiters
+ * (so that following a chain of owners can't run into a thread that
+ * has since released the lock and gone away). It nests inside
+ * lk_spinlock.
+ */
+static struct spinlock pi_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Donate priority PRI to the owner of LOCK, and transitively to the
+ * owners of any locks they in turn are waiting for.
+ */
+static
+void
+lock_donate(struct lock *lock, int pri)
+{
+	struct thread *owner;
+	int depth;
+
+	KASSERT(spinlock_do_i_hold(&pi_lock));
+
+	for (depth = 0; lock != NULL && depth < LOCK_PI_MAXDEPTH; depth++) {
+		if (lock->lk_donated < pri) {
+			lock->lk_donated = pri;
+		}
+		owner = lock->lk_owner;
+		if (owner == NULL || owner->t_effpriority >= pri) {
+			break;
+		}
+		owner->t_effpriority = pri;
+		lock = owner->t_blocked_on;
+	}
+}
+
+/*
+ * Recompute a thread's effective priority from its base priority and
+ * the donations made through the locks it still holds.
+ */
+static
+void
+lock_pi_recompute(struct thread *t)
+{
+	struct lock *lock;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(&pi_lock));
+
+	pri = t->t_priority;
+	for (lock = t->t_heldlocks; lock != NULL; lock = lock->lk_nextheld) {
+		if (lock->lk_nwaiters > 0 && lock->lk_donated > pri) {
+			pri = lock->lk_donated;
+		}
+	}
+	t->t_effpriority = pri;
+}
+
+void
+thread_setpriority(int priority)
+{
+	KASSERT(priority >= PRI_MIN && priority <= PRI_MAX);
+
+	spinlock_acquire(&pi_lock);
+	curthread->t_priority = priority;
+	lock_pi_recompute(curthread);
+	if (curthread->t_blocked_on != NULL) {
+		lock_donate(curthread->t_blocked_on, curthread->t_effpriority);
+	}
+	spinlock_release(&pi_lock);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -160,18 +399,26 @@ lock_create(const char *name)
         lock->lk_name = kstrdup(name);
 	lock->lk_held = false; 
 	lock->lk_owner = NULL; 
+	lock->lk_nextheld = NULL;
+	lock->lk_nwaiters = 0;
+	lock->lk_donated = PRI_MIN;
+	lock->lk_acqtime = 0;
         if (lock->lk_name == NULL) {
                 kfree(lock);
                 return NULL;
         }
           
 
+#if OPT_HASHWCHAN
+	lock->lk_wchan = wchan_hashed(lock, false);
+#else
 	lock->lk_wchan = wchan_create(lock->lk_name);
 	if (lock->lk_wchan == NULL) {
 		kfree(lock->lk_name);
 		kfree(lock);
 		return NULL;
 	}
+#endif
 
 	spinlock_init(&lock->lk_spinlock);
         return lock;
@@ -190,34 +437,145 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+	bool contended = false;
+	uint64_t start = 0;
+
 	KASSERT (lock != NULL); 
 	KASSERT (!lock_do_i_hold(lock)); 
 
 	spinlock_acquire(&lock->lk_spinlock);
         while (lock->lk_held) {
+		if (!contended) {
+			contended = true;
+			if (lockstat_enabled) {
+				start = getnsecs();
+			}
+			KTRACE(KT_CONTEND, lock, LOCKSTAT_LOCK);
+		}
+		// lend our priority to the owner while we wait
+		lock->lk_nwaiters++;
+		spinlock_acquire(&pi_lock);
+		curthread->t_blocked_on = lock;
+		lock_donate(lock, curthread->t_effpriority);
+		spinlock_release(&pi_lock);
+
 		wchan_lock(lock->lk_wchan); // lock channel
 		spinlock_release(&lock->lk_spinlock);
                 wchan_sleep(lock->lk_wchan);
 		// sleep until woken up
 		spinlock_acquire(&lock->lk_spinlock);
+		lock->lk_nwaiters--;
+		if (curthread->t_handoff) {
+			// lock_release made us the owner already
+			curthread->t_handoff = false;
+			KASSERT(lock->lk_owner == curthread);
+			break;
+		}
         }
 	// own spinlock at this point
-	lock->lk_held = true; 
-	lock->lk_owner = curthread; 
+	if (lock->lk_nwaiters > 0 ||
+	    (curthread != NULL && curthread->t_blocked_on != NULL)) {
+		// others may be following lk_owner; see pi_lock
+		spinlock_acquire(&pi_lock);
+		lock->lk_held = true; 
+		lock->lk_owner = curthread; 
+		curthread->t_blocked_on = NULL;
+		if (lock->lk_nwaiters == 0) {
+			lock->lk_donated = PRI_MIN;
+		}
+		else if (lock->lk_donated > curthread->t_effpriority) {
+			// inherit from the waiters still queued
+			curthread->t_effpriority = lock->lk_donated;
+		}
+		spinlock_release(&pi_lock);
+	}
+	else {
+		lock->lk_held = true; 
+		lock->lk_owner = curthread; 
+		lock->lk_donated = PRI_MIN;
+	}
+	// (no curthread yet during proc_bootstrap)
+	if (curthread != NULL) {
+		lock->lk_nextheld = curthread->t_heldlocks;
+		curthread->t_heldlocks = lock;
+	}
+	lock->lk_acqtime = 0;
+	if (lockstat_enabled) {
+		lock->lk_acqtime = getnsecs();
+		lockstat_acquired(lock, LOCKSTAT_LOCK, lock->lk_name, 0,
+				  start != 0 ? lock->lk_acqtime - start : 0,
+				  contended);
+	}
 	spinlock_release(&lock->lk_spinlock);
 }
 
 void
 lock_release(struct lock *lock)
 {
+	struct lock **lp;
+	struct thread *target;
+	bool demoted = false;
+
        	KASSERT (lock != NULL);
 	KASSERT (lock_do_i_hold(lock)); 
 
 	spinlock_acquire(&lock->lk_spinlock); 
-	lock->lk_held = false; 
-	lock->lk_owner = NULL; 
-	wchan_wakeone(lock->lk_wchan); 
+	if (lockstat_enabled && lock->lk_acqtime != 0) {
+		lockstat_released(lock, LOCKSTAT_LOCK,
+				  getnsecs() - lock->lk_acqtime);
+	}
+	if (curthread == NULL) {
+		// proc_bootstrap; nobody else can be involved yet
+		lock->lk_held = false; 
+		lock->lk_owner = NULL; 
+		spinlock_release(&lock->lk_spinlock); 
+		return;
+	}
+
+	for (lp = &curthread->t_heldlocks; *lp != lock;
+	     lp = &(*lp)->lk_nextheld) {
+		KASSERT(*lp != NULL);
+	}
+	*lp = lock->lk_nextheld;
+	lock->lk_nextheld = NULL;
+
+	if (lock->lk_nwaiters > 0 ||
+	    curthread->t_effpriority != curthread->t_priority) {
+		// give back whatever was donated through this lock
+		spinlock_acquire(&pi_lock);
+		lock->lk_held = false; 
+		lock->lk_owner = NULL; 
+		lock_pi_recompute(curthread);
+		demoted = curthread->t_effpriority < lock->lk_donated;
+		spinlock_release(&pi_lock);
+	}
+	else {
+		lock->lk_held = false; 
+		lock->lk_owner = NULL; 
+	}
+
+	/*
+	 * Hand the lock straight to the thread we wake, so it doesn't
+	 * have to fight for it again (and maybe lose and sleep again)
+	 * when it runs. It does the rest of the bookkeeping itself in
+	 * lock_acquire, once it gets lk_spinlock after we let go.
+	 */
+	target = wchan_handoff(lock->lk_wchan, false);
+	if (target != NULL) {
+		spinlock_acquire(&pi_lock);
+		lock->lk_held = true;
+		lock->lk_owner = target;
+		target->t_blocked_on = NULL;
+		spinlock_release(&pi_lock);
+	}
 	spinlock_release(&lock->lk_spinlock); 
+
+	if (demoted && curthread->t_iplhigh_count == 0 &&
+	    !curthread->t_in_interrupt) {
+		// let the waiter we were standing in for run (but not
+		// from cv_wait, which holds the cv's wchan lock here)
+		thread_yield();
+	}
 }
 	
 bool
@@ -248,12 +606,17 @@ cv_create(const char *name)
                 return NULL;
         }
         
+#if OPT_HASHWCHAN
+	/* outer: cv_wait holds it while lock_release locks the lock's */
+	cv->cv_wchan = wchan_hashed(cv, true);
+#else
 	cv->cv_wchan = wchan_create(cv->cv_name); 
        	if (cv->cv_wchan == NULL) {
 		kfree(cv->cv_name);
 		kfree(cv);
 		return NULL;
 	}
+#endif
         return cv;
 }
 
@@ -270,14 +633,44 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+	uint64_t start = 0;
+
 	KASSERT (cv != NULL && lock != NULL); 
 	KASSERT (lock_do_i_hold(lock)); // correction based on A1 feedback
+	if (lockstat_enabled) {
+		start = getnsecs();
+	}
 	wchan_lock (cv->cv_wchan); 
 	lock_release(lock); 
 	wchan_sleep (cv->cv_wchan); 
+	if (lockstat_enabled) {
+		// every wait sleeps, so every wait counts as contended
+		lockstat_acquired(cv, LOCKSTAT_CV, cv->cv_name, 0,
+				  start != 0 ? getnsecs() - start : 0, true);
+	}
 	lock_acquire(lock); 
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+	struct timedwait tw;
+	struct timeout to;
+	bool timedout;
+
+	KASSERT (cv != NULL && lock != NULL); 
+	KASSERT (lock_do_i_hold(lock)); 
+
+	timedwait_init(&tw, &to, cv->cv_wchan);
+	timeout_add(&to, ticks);
+	wchan_lock(cv->cv_wchan); 
+	lock_release(lock); 
+	timedout = timedwait_sleep(&tw, &to);
+	lock_acquire(lock); 
+
+	return timedout ? ETIMEDOUT : 0;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -293,3 +686,200 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan);
        (void) lock; 	
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rw;
+
+        rw = kmalloc(sizeof(struct rwlock));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rw_name = kstrdup(name);
+        if (rw->rw_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+#if OPT_HASHWCHAN
+	/* Two channels, so two keys: use the fields' addresses */
+	rw->rw_readwchan = wchan_hashed(&rw->rw_readwchan, false);
+	rw->rw_writewchan = wchan_hashed(&rw->rw_writewchan, false);
+#else
+	rw->rw_readwchan = wchan_create(rw->rw_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rw_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+#endif
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_writers_waiting = 0;
+	rw->rw_writer = NULL;
+	rw->rw_upgrader = NULL;
+
+        return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+        kfree(rw->rw_name);
+        kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	/* Stand aside for any writer, running or waiting */
+	while (rw->rw_writer != NULL || rw->rw_writers_waiting > 0 ||
+	       rw->rw_upgrader != NULL) {
+		wchan_lock(rw->rw_readwchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_readwchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	rw->rw_readers++;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_upgrader != NULL) {
+		/*
+		 * The upgrader sleeps on the writer channel along with
+		 * any writers; wake them all and let the upgrader win
+		 * once it's the only reader left.
+		 */
+		if (rw->rw_readers == 1) {
+			wchan_wakeall(rw->rw_writewchan);
+		}
+	}
+	else if (rw->rw_readers == 0 && rw->rw_writers_waiting > 0) {
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(!rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	rw->rw_writers_waiting++;
+	while (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+	       rw->rw_upgrader != NULL) {
+		wchan_lock(rw->rw_writewchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_writewchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	rw->rw_writers_waiting--;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	rw->rw_writer = NULL;
+	if (rw->rw_writers_waiting > 0) {
+		wchan_wakeone(rw->rw_writewchan);
+	}
+	else {
+		wchan_wakeall(rw->rw_readwchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_tryupgrade(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_upgrader != curthread);
+	if (rw->rw_upgrader != NULL) {
+		/* Someone else got there first; two upgraders deadlock */
+		spinlock_release(&rw->rw_lock);
+		return false;
+	}
+	rw->rw_upgrader = curthread;
+	while (rw->rw_readers > 1) {
+		wchan_lock(rw->rw_writewchan);
+		spinlock_release(&rw->rw_lock);
+		wchan_sleep(rw->rw_writewchan);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	rw->rw_upgrader = NULL;
+	rw->rw_readers = 0;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+	return true;
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	rw->rw_writer = NULL;
+	rw->rw_readers = 1;
+	if (rw->rw_writers_waiting == 0) {
+		/* Other readers can join us */
+		wchan_wakeall(rw->rw_readwchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	return rw->rw_writer == curthread;
+}
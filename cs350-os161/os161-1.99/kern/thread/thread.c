@@ -50,6 +50,8 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <clock.h>
+#include <ktrace.h>
 
 #include "opt-synchprobs.h"
 
@@ -64,6 +66,17 @@ struct wchan {
 	struct spinlock wc_lock;	/* lock for mutual exclusion */
 };
 
+/*
+ * Hashed wait channels; see wchan_hashed. A handle is the key with
+ * WCHAN_HASHED set, plus WCHAN_OUTER for the outer table. Real
+ * wchans come from kmalloc and have both bits clear.
+ */
+#define WCHAN_HASHBITS	6
+#define WCHAN_HASHSIZE	(1 << WCHAN_HASHBITS)
+#define WCHAN_HASHED	0x1
+#define WCHAN_OUTER	0x2
+static struct wchan wchan_hashtab[2][WCHAN_HASHSIZE];
+
 /* Master array of CPUs. */
 DECLARRAY(cpu);
 DEFARRAY(cpu, /*no inline*/ );
@@ -72,6 +85,19 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Threads moving themselves to another cpu wait here. */
+static struct wchan *affinity_wchan;
+
+/* Number of dead threads each cpu keeps in c_threadcache. */
+static unsigned thread_cache_limit = THREAD_CACHE_MAX;
+
+/* Thread cache statistics; registered in thread_bootstrap. */
+static counter_t thread_cache_hits;
+static counter_t thread_cache_misses;
+
+/* Whether scheduler latency is being measured; see thread_schedlat_start. */
+static volatile bool schedlat_on;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -111,9 +137,113 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Thread cache.
+ *
+ * A kernel stack is a whole page, so allocating one goes to
+ * alloc_kpages and the coremap lock every time. Instead of freeing
+ * dead threads, thread_destroy keeps up to thread_cache_limit of
+ * them, stacks attached, on a per-cpu list, and thread_create takes
+ * from that list first. The lists are only touched by their own cpu
+ * with interrupts off, so they need no lock.
+ *
+ * Returns a thread structure with t_stack set (and its guard band
+ * still intact), or NULL if the cache is empty.
+ */
+static
+struct thread *
+thread_cache_get(void)
+{
+	struct thread *thread;
+	int spl;
+
+	/* no cpu structure yet for the boot thread */
+	if (!CURCPU_EXISTS()) {
+		return NULL;
+	}
+
+	spl = splhigh();
+	thread = NULL;
+	if (thread_cache_limit > 0) {
+		thread = threadlist_remhead(&curcpu->c_threadcache);
+	}
+	splx(spl);
+
+	counter_inc(thread != NULL ? thread_cache_hits : thread_cache_misses);
+
+	return thread;
+}
+
+/*
+ * Offer a dead thread to the cache. Returns true if it was kept.
+ */
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	bool kept = false;
+	int spl;
+
+	if (thread->t_stack == NULL || !CURCPU_EXISTS()) {
+		return false;
+	}
+
+	spl = splhigh();
+	if (curcpu->c_threadcache.tl_count < thread_cache_limit) {
+		threadlistnode_init(&thread->t_listnode, thread);
+		threadlist_addhead(&curcpu->c_threadcache, thread);
+		kept = true;
+	}
+	splx(spl);
+
+	return kept;
+}
+
+void
+thread_cache_stats(unsigned *hits, unsigned *misses)
+{
+	*hits = counter_read(thread_cache_hits);
+	*misses = counter_read(thread_cache_misses);
+}
+
+/*
+ * Change the limit. The current cpu's cache is trimmed right away;
+ * other cpus' caches are left as they are until they next get used
+ * (with a limit of 0 they are just ignored). Also resets the
+ * hit/miss counters, for the benefit of whoever is measuring.
+ */
+void
+thread_cache_setlimit(unsigned limit)
+{
+	struct thread *thread;
+	int spl;
+
+	if (limit > THREAD_CACHE_MAX) {
+		limit = THREAD_CACHE_MAX;
+	}
+
+	spl = splhigh();
+	thread_cache_limit = limit;
+	while (curcpu->c_threadcache.tl_count > limit) {
+		thread = threadlist_remhead(&curcpu->c_threadcache);
+		threadlistnode_cleanup(&thread->t_listnode);
+		kfree(thread->t_stack);
+		kfree(thread);
+	}
+	splx(spl);
+
+	counter_reset(thread_cache_hits);
+	counter_reset(thread_cache_misses);
+}
+
+static void thread_reap(void *data1, unsigned long data2);
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
+ *
+ * The new thread's t_stack is NULL, unless it came from the thread
+ * cache, in which case it already has one.
  */
 static
 struct thread *
@@ -123,14 +253,23 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = thread_cache_get();
 	if (thread == NULL) {
-		return NULL;
+		thread = kmalloc(sizeof(*thread));
+		if (thread == NULL) {
+			return NULL;
+		}
+		thread->t_stack = NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
+		if (!thread_cache_put(thread)) {
+			if (thread->t_stack != NULL) {
+				kfree(thread->t_stack);
+			}
+			kfree(thread);
+		}
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
@@ -139,7 +278,6 @@ thread_create(const char *name)
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
@@ -149,6 +287,27 @@ thread_create(const char *name)
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Scheduling fields */
+	thread->t_priority = PRI_DEFAULT;
+	thread->t_effpriority = PRI_DEFAULT;
+	thread->t_blocked_on = NULL;
+	thread->t_heldlocks = NULL;
+	thread->t_handoff = false;
+	thread->t_wchan_key = NULL;
+	work_init(&thread->t_reapwork, thread_reap, thread, 0);
+
+	/* Accounting fields */
+	thread->t_utime = 0;
+	thread->t_stime = 0;
+
+	thread->t_cpumask = CPUMASK_ALL;
+
+	thread->t_readytime = 0;
+	thread->t_woken = false;
+
+	thread->t_tid = 0;
+	thread->t_futex = NULL;
+
 	/* If you add to struct thread, be sure to initialize here */
 
 	return thread;
@@ -180,6 +339,17 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_idleclocks = 0;
+	c->c_intr_fromuser = false;
+	c->c_intr_pc = 0;
+	c->c_lockstat = NULL;
+	c->c_kprof = NULL;
+	c->c_ktrace = NULL;
+	threadlist_init(&c->c_threadcache);
+	c->c_workqueue = NULL;
+	bzero(c->c_counters, sizeof(c->c_counters));
+	bzero(c->c_runlat, sizeof(c->c_runlat));
+	bzero(c->c_wakelat, sizeof(c->c_wakelat));
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -194,6 +364,11 @@ cpu_create(unsigned hardware_number)
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
 
+	c->c_workqueue = workqueue_create(c->c_number);
+	if (c->c_workqueue == NULL) {
+		panic("cpu_create: workqueue_create failed\n");
+	}
+
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
 	if (c->c_curthread == NULL) {
@@ -213,7 +388,7 @@ cpu_create(unsigned hardware_number)
 		 */
 		/*c->c_curthread->t_stack = ... */
 	}
-	else {
+	else if (c->c_curthread->t_stack == NULL) {
 		c->c_curthread->t_stack = kmalloc(STACK_SIZE);
 		if (c->c_curthread->t_stack == NULL) {
 			panic("cpu_create: couldn't allocate stack");
@@ -227,6 +402,22 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+/*
+ * Accessors for the CPU array.
+ */
+unsigned
+cpu_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_get(unsigned n)
+{
+	KASSERT(n < cpuarray_num(&allcpus));
+	return cpuarray_get(&allcpus, n);
+}
+
 /*
  * Destroy a thread.
  *
@@ -249,9 +440,6 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
@@ -259,14 +447,41 @@ thread_destroy(struct thread *thread)
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
+	thread->t_name = NULL;
+
+	/* Keep the structure and stack for reuse if there's room */
+	thread_checkstack(thread);
+	if (thread_cache_put(thread)) {
+		return;
+	}
+	if (thread->t_stack != NULL) {
+		kfree(thread->t_stack);
+	}
 	kfree(thread);
 }
 
+/*
+ * Workqueue function for destroying a zombie.
+ */
+static
+void
+thread_reap(void *data1, unsigned long data2)
+{
+	struct thread *z = data1;
+
+	(void)data2;
+
+	KASSERT(z->t_state == S_ZOMBIE);
+	thread_destroy(z);
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
  *
- * The list of zombies is per-cpu.
+ * The list of zombies is per-cpu. This runs in the middle of a
+ * context switch, so rather than destroy them here, pass them on to
+ * the cpu's workqueue thread.
  */
 static
 void
@@ -277,7 +492,7 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		work_enqueue(&z->t_reapwork);
 	}
 }
 
@@ -348,9 +563,22 @@ thread_bootstrap(void)
 {
 	struct cpu *bootcpu;
 	struct thread *bootthread;
+	unsigned i;
 
 	cpuarray_init(&allcpus);
 
+	for (i=0; i<WCHAN_HASHSIZE; i++) {
+		spinlock_init(&wchan_hashtab[0][i].wc_lock);
+		threadlist_init(&wchan_hashtab[0][i].wc_threads);
+		wchan_hashtab[0][i].wc_name = "hashed";
+		spinlock_init(&wchan_hashtab[1][i].wc_lock);
+		threadlist_init(&wchan_hashtab[1][i].wc_threads);
+		wchan_hashtab[1][i].wc_name = "hashed-outer";
+	}
+
+	thread_cache_hits = counter_register("thread cache hits");
+	thread_cache_misses = counter_register("thread cache misses");
+
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
 	 * currently running on. Assume the hardware number is 0; that
@@ -380,6 +608,11 @@ thread_bootstrap(void)
 	/* cpu_create() should have set t_proc. */
 	KASSERT(curthread->t_proc != NULL);
 
+	affinity_wchan = wchan_create("affinity");
+	if (affinity_wchan == NULL) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
 	/* Done */
 }
 
@@ -426,10 +659,107 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Put a thread on a run queue, behind every thread of the same or
+ * higher effective priority. The run queue must be locked.
+ */
+static
+void
+thread_enqueue(struct threadlist *runqueue, struct thread *target)
+{
+	struct threadlistnode *tln;
+
+	for (tln = runqueue->tl_head.tln_next; tln->tln_next != NULL;
+	     tln = tln->tln_next) {
+		if (tln->tln_self->t_effpriority < target->t_effpriority) {
+			threadlist_insertbefore(runqueue, target,
+						tln->tln_self);
+			return;
+		}
+	}
+	threadlist_addtail(runqueue, target);
+}
+
+/*
+ * Affinity helpers.
+ *
+ * thread_allcpumask returns the mask of the cpus that exist.
+ *
+ * thread_cpuallowed says whether T may run on C.
+ *
+ * thread_pickcpu chooses a cpu T may run on: the one it has if that's
+ * allowed, otherwise curcpu, otherwise the first one allowed.
+ *
+ * thread_setcpu moves T, which must be on no list (just taken off a
+ * wait channel, or never run), to C. If T went to sleep on its old
+ * cpu, that cpu may not have finished switching away from it yet;
+ * it holds its run queue lock until it has, so wait for that before
+ * letting another cpu at T's stack.
+ */
+static
+uint32_t
+thread_allcpumask(void)
+{
+	unsigned numcpus = cpuarray_num(&allcpus);
+
+	return numcpus >= 32 ? CPUMASK_ALL : CPUMASK_CPU(numcpus) - 1;
+}
+
+static
+bool
+thread_cpuallowed(struct thread *t, struct cpu *c)
+{
+	return (t->t_cpumask & CPUMASK_CPU(c->c_number)) != 0;
+}
+
+static
+struct cpu *
+thread_pickcpu(struct thread *t)
+{
+	struct cpu *c;
+	unsigned i;
+
+	if (thread_cpuallowed(t, t->t_cpu)) {
+		return t->t_cpu;
+	}
+	if (CURCPU_EXISTS() && thread_cpuallowed(t, curcpu->c_self)) {
+		return curcpu->c_self;
+	}
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (thread_cpuallowed(t, c)) {
+			return c;
+		}
+	}
+	/* thread_setaffinity doesn't allow this */
+	panic("Thread %s may not run on any cpu\n", t->t_name);
+}
+
+static
+void
+thread_setcpu(struct thread *t, struct cpu *c)
+{
+	struct cpu *old;
+
+	old = t->t_cpu;
+	if (old == c) {
+		return;
+	}
+	if (old != NULL) {
+		spinlock_acquire(&old->c_runqueue_lock);
+		spinlock_release(&old->c_runqueue_lock);
+	}
+	t->t_cpu = c;
+}
+
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too. 
+ * targetcpu might be curcpu; it might not be, too. If the target's
+ * affinity doesn't allow its current cpu, it's moved first; that
+ * can't be done with the lock already held (that case is only
+ * thread_switch putting curthread back on the run queue), so then
+ * it stays put until thread_setaffinity moves it.
  */
 static
 void
@@ -438,6 +768,10 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	struct cpu *targetcpu;
 	bool isidle;
 
+	if (!already_have_lock && !thread_cpuallowed(target, target->t_cpu)) {
+		thread_setcpu(target, thread_pickcpu(target));
+	}
+
 	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
 
@@ -449,8 +783,19 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	KTRACE(KT_WAKEUP, target, targetcpu->c_number);
+
+	/*
+	 * A thread being woken is still in S_SLEEP; one thread_switch
+	 * is requeueing is still in S_RUN, and a new one is in S_READY.
+	 */
+	if (schedlat_on) {
+		target->t_readytime = getnsecs();
+		target->t_woken = target->t_state == S_SLEEP;
+	}
+
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(&targetcpu->c_runqueue, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -472,17 +817,24 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  *
  * The new thread is created in the process P. If P is null, the
  * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * as the caller, unless the scheduler intervenes first or that CPU
+ * isn't in MASK.
  */
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_affinity(const char *name,
+		     struct proc *proc,
+		     uint32_t mask,
+		     void (*entrypoint)(void *data1, unsigned long data2),
+		     void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
 
+	mask &= thread_allcpumask();
+	if (mask == 0) {
+		return EINVAL;
+	}
+
 #ifdef UW
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
@@ -492,20 +844,31 @@ thread_fork(const char *name,
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
+	/* Allocate a stack, unless the thread came with one */
 	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
-	/* Thread subsystem fields */
+	/*
+	 * Thread subsystem fields. The new thread starts on our cpu,
+	 * or if its affinity forbids that, thread_make_runnable picks
+	 * another.
+	 */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpumask = mask;
+
+	/* New threads start at their parent's base priority */
+	newthread->t_priority = curthread->t_priority;
+	newthread->t_effpriority = curthread->t_priority;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -534,6 +897,198 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * The usual case: the new thread inherits our affinity.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_affinity(name, proc, curthread->t_cpumask,
+				    entrypoint, data1, data2);
+}
+
+/*
+ * Scheduler latency histograms. Bucket N counts latencies from 2^N
+ * up to 2^(N+1) nanoseconds, except that bucket 0 also gets 0 and 1,
+ * and the last bucket gets everything longer.
+ *
+ * They're only kept while schedlat_on is set, so that nobody reads
+ * the clock on every wakeup and switch when no one's looking.
+ */
+static
+unsigned
+thread_schedlat_bucket(uint64_t nsecs)
+{
+	unsigned b;
+
+	for (b = 0; nsecs > 1 && b < SCHEDLAT_NBUCKETS - 1; b++) {
+		nsecs >>= 1;
+	}
+	return b;
+}
+
+/*
+ * Charge NEXT's wait in the run queue to the current cpu. Called by
+ * thread_switch, so interrupts are off.
+ */
+static
+void
+thread_schedlat_record(struct thread *next)
+{
+	uint64_t now;
+	unsigned b;
+
+	if (next->t_readytime == 0) {
+		/*
+		 * Queued while we weren't counting, never queued (the
+		 * boot thread), or the clock wasn't up
+		 */
+		return;
+	}
+	if (schedlat_on) {
+		now = getnsecs();
+		b = now > next->t_readytime ?
+			thread_schedlat_bucket(now - next->t_readytime) : 0;
+		curcpu->c_runlat[b]++;
+		if (next->t_woken) {
+			curcpu->c_wakelat[b]++;
+		}
+	}
+	next->t_readytime = 0;
+}
+
+/*
+ * Return the upper bound of the bucket holding the PCT'th percentile
+ * of histogram H, which has TOTAL entries.
+ */
+static
+uint64_t
+thread_schedlat_percentile(const uint32_t *h, unsigned total, unsigned pct)
+{
+	unsigned b, sum, want;
+
+	want = (total * pct + 99) / 100;
+	sum = 0;
+	for (b=0; b<SCHEDLAT_NBUCKETS - 1; b++) {
+		sum += h[b];
+		if (sum >= want) {
+			break;
+		}
+	}
+	return (uint64_t)2 << b;
+}
+
+static
+void
+thread_schedlat_summary(const char *what, const uint32_t *run,
+			const uint32_t *wake)
+{
+	unsigned b, nrun, nwake;
+
+	nrun = nwake = 0;
+	for (b=0; b<SCHEDLAT_NBUCKETS; b++) {
+		nrun += run[b];
+		nwake += wake[b];
+	}
+	kprintf("%-6s %9u", what, nrun);
+	if (nrun > 0) {
+		kprintf(" %10llu %10llu",
+			thread_schedlat_percentile(run, nrun, 50),
+			thread_schedlat_percentile(run, nrun, 99));
+	}
+	else {
+		kprintf(" %10s %10s", "-", "-");
+	}
+	kprintf("  %9u", nwake);
+	if (nwake > 0) {
+		kprintf(" %10llu %10llu",
+			thread_schedlat_percentile(wake, nwake, 50),
+			thread_schedlat_percentile(wake, nwake, 99));
+	}
+	else {
+		kprintf(" %10s %10s", "-", "-");
+	}
+	kprintf("\n");
+}
+
+/*
+ * Print the per-cpu summaries, then the histogram over all cpus.
+ * Percentiles are bucket upper bounds, so they're within a factor
+ * of two.
+ */
+void
+thread_schedlat_print(void)
+{
+	uint32_t run[SCHEDLAT_NBUCKETS], wake[SCHEDLAT_NBUCKETS];
+	struct cpu *c;
+	unsigned i, b;
+	char name[8];
+
+	bzero(run, sizeof(run));
+	bzero(wake, sizeof(wake));
+
+	kprintf("Scheduler latency (ns), all runs and runs after wakeup:\n");
+	kprintf("%-6s %9s %10s %10s  %9s %10s %10s\n", "cpu",
+		"runs", "p50", "p99", "wakeups", "p50", "p99");
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		snprintf(name, sizeof(name), "%u", c->c_number);
+		thread_schedlat_summary(name, c->c_runlat, c->c_wakelat);
+		for (b=0; b<SCHEDLAT_NBUCKETS; b++) {
+			run[b] += c->c_runlat[b];
+			wake[b] += c->c_wakelat[b];
+		}
+	}
+	thread_schedlat_summary("all", run, wake);
+
+	kprintf("\n%12s %12s %9s %9s\n", "from", "to", "runs", "wakeups");
+	for (b=0; b<SCHEDLAT_NBUCKETS; b++) {
+		if (run[b] == 0) {
+			continue;
+		}
+		kprintf("%12llu ", b == 0 ? 0ULL : (uint64_t)1 << b);
+		if (b < SCHEDLAT_NBUCKETS - 1) {
+			kprintf("%12llu", (uint64_t)2 << b);
+		}
+		else {
+			kprintf("%12s", "-");
+		}
+		kprintf(" %9u %9u\n", run[b], wake[b]);
+	}
+}
+
+void
+thread_schedlat_start(void)
+{
+	schedlat_on = true;
+}
+
+void
+thread_schedlat_stop(void)
+{
+	schedlat_on = false;
+}
+
+/*
+ * Clear the histograms. Like counter_reset, a cpu switching at the
+ * time may keep a stray count.
+ */
+void
+thread_schedlat_reset(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		bzero(c->c_runlat, sizeof(c->c_runlat));
+		bzero(c->c_wakelat, sizeof(c->c_wakelat));
+	}
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -641,6 +1196,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	KTRACE(KT_SWITCH, next, newstate);
+	thread_schedlat_record(next);
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -817,6 +1375,61 @@ thread_yield(void)
 	thread_switch(S_READY, NULL);
 }
 
+/*
+ * Workqueue function for thread_setaffinity: wake the thread up,
+ * which moves it to a cpu it's allowed on.
+ */
+static
+void
+thread_affinity_wake(void *data1, unsigned long data2)
+{
+	struct thread *t = data1;
+
+	(void)data2;
+
+	wchan_lock(affinity_wchan);
+	wchan_wakethread(affinity_wchan, t);
+	wchan_unlock(affinity_wchan);
+}
+
+int
+thread_setaffinity(uint32_t mask)
+{
+	struct work w;
+
+	mask &= thread_allcpumask();
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	curthread->t_cpumask = mask;
+	if (thread_cpuallowed(curthread, curcpu->c_self)) {
+		return 0;
+	}
+
+	/*
+	 * We can't move ourselves while we're running here, so go to
+	 * sleep and have the workqueue wake us, which puts us on an
+	 * allowed cpu (see thread_make_runnable). Keep the channel
+	 * locked until we're asleep on it so the wakeup can't come
+	 * first. W is on our stack, which is fine: we don't return
+	 * until its function has run.
+	 */
+	work_init(&w, thread_affinity_wake, curthread, 0);
+	wchan_lock(affinity_wchan);
+	work_enqueue(&w);
+	wchan_sleep(affinity_wchan);
+
+	KASSERT(thread_cpuallowed(curthread, curcpu->c_self));
+	return 0;
+}
+
+uint32_t
+thread_getaffinity(void)
+{
+	return curthread->t_cpumask & thread_allcpumask();
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -824,15 +1437,32 @@ thread_yield(void)
  *
  * This is called periodically from hardclock(). It should reshuffle
  * the current CPU's run queue by job priority.
+ *
+ * Threads are inserted in priority order when they become runnable,
+ * but a thread's effective priority can change while it is sitting on
+ * the run queue (when a lock it holds receives a priority donation),
+ * so re-sort the queue here. Reinserting in order keeps threads of
+ * equal priority in round-robin order.
  */
 
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct threadlist sorted;
+	struct thread *t;
+
+	threadlist_init(&sorted);
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	while ((t = threadlist_remhead(&curcpu->c_runqueue)) != NULL) {
+		thread_enqueue(&sorted, t);
+	}
+	while ((t = threadlist_remhead(&sorted)) != NULL) {
+		threadlist_addtail(&curcpu->c_runqueue, t);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	threadlist_cleanup(&sorted);
 }
 
 /*
@@ -858,7 +1488,7 @@ thread_consider_migration(void)
 	unsigned my_count, total_count, one_share, to_send;
 	unsigned i, numcpus;
 	struct cpu *c;
-	struct threadlist victims;
+	struct threadlist victims, skipped;
 	struct thread *t;
 
 	my_count = total_count = 0;
@@ -880,6 +1510,7 @@ thread_consider_migration(void)
 
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
+	threadlist_init(&skipped);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 	for (i=0; i<to_send; i++) {
 		t = threadlist_remtail(&curcpu->c_runqueue);
@@ -895,6 +1526,10 @@ thread_consider_migration(void)
 		spinlock_acquire(&c->c_runqueue_lock);
 		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
 			t = threadlist_remhead(&victims);
+			if (t == NULL) {
+				/* Everything left is pinned elsewhere */
+				break;
+			}
 			/*
 			 * Ordinarily, curthread will not appear on
 			 * the run queue. However, it can under the
@@ -923,8 +1558,17 @@ thread_consider_migration(void)
 				continue;
 			}
 
+			/*
+			 * Leave threads whose affinity doesn't allow
+			 * this cpu for the next one.
+			 */
+			if (!thread_cpuallowed(t, c)) {
+				threadlist_addtail(&skipped, t);
+				continue;
+			}
+
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_enqueue(&c->c_runqueue, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -938,6 +1582,10 @@ thread_consider_migration(void)
 			}
 		}
 		spinlock_release(&c->c_runqueue_lock);
+
+		while ((t = threadlist_remhead(&skipped)) != NULL) {
+			threadlist_addtail(&victims, t);
+		}
 	}
 
 	/*
@@ -948,13 +1596,14 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_enqueue(&curcpu->c_runqueue, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
 
 	KASSERT(threadlist_isempty(&victims));
 	threadlist_cleanup(&victims);
+	threadlist_cleanup(&skipped);
 }
 
 ////////////////////////////////////////////////////////////
@@ -989,28 +1638,94 @@ wchan_create(const char *name)
 /*
  * Destroy a wait channel. Must be empty and unlocked.
  * (The corresponding cleanup functions require this.)
+ * A hashed channel has nothing to destroy.
  */
 void
 wchan_destroy(struct wchan *wc)
 {
+	if ((uintptr_t)wc & WCHAN_HASHED) {
+		KASSERT(wchan_isempty(wc));
+		return;
+	}
 	spinlock_cleanup(&wc->wc_lock);
 	threadlist_cleanup(&wc->wc_threads);
 	kfree(wc);
 }
 
+/*
+ * Make a handle for a hashed wait channel. See wchan.h.
+ */
+struct wchan *
+wchan_hashed(const void *key, bool outer)
+{
+	KASSERT(((uintptr_t)key & (WCHAN_HASHED | WCHAN_OUTER)) == 0);
+	return (struct wchan *)((uintptr_t)key | WCHAN_HASHED |
+				(outer ? WCHAN_OUTER : 0));
+}
+
+/*
+ * Find the channel threads actually sleep on for WC, and the key
+ * they sleep with. For an ordinary channel that's WC itself and
+ * NULL; for a hashed one, it's the bucket for the key.
+ */
+static
+struct wchan *
+wchan_resolve(struct wchan *wc, const void **key)
+{
+	uintptr_t handle = (uintptr_t)wc;
+	uint32_t h;
+
+	if ((handle & WCHAN_HASHED) == 0) {
+		*key = NULL;
+		return wc;
+	}
+	*key = (const void *)(handle & ~(uintptr_t)(WCHAN_HASHED|WCHAN_OUTER));
+
+	/* Fibonacci hashing; the top bits are the well-mixed ones */
+	h = ((uint32_t)(uintptr_t)*key * 2654435761U) >> (32 - WCHAN_HASHBITS);
+	return &wchan_hashtab[(handle & WCHAN_OUTER) ? 1 : 0][h];
+}
+
+/*
+ * Take the first thread sleeping with KEY off WC, which must be
+ * locked. On an ordinary channel everyone's key is NULL, so this is
+ * just the head of the list.
+ */
+static
+struct thread *
+wchan_remkey(struct wchan *wc, const void *key)
+{
+	struct threadlistnode *tln;
+	struct thread *target;
+
+	for (tln = wc->wc_threads.tl_head.tln_next; tln->tln_next != NULL;
+	     tln = tln->tln_next) {
+		target = tln->tln_self;
+		if (target->t_wchan_key == key) {
+			threadlist_remove(&wc->wc_threads, target);
+			return target;
+		}
+	}
+	return NULL;
+}
+
 /*
  * Lock and unlock a wait channel, respectively.
  */
 void
 wchan_lock(struct wchan *wc)
 {
-	spinlock_acquire(&wc->wc_lock);
+	const void *key;
+
+	spinlock_acquire(&wchan_resolve(wc, &key)->wc_lock);
 }
 
 void
 wchan_unlock(struct wchan *wc)
 {
-	spinlock_release(&wc->wc_lock);
+	const void *key;
+
+	spinlock_release(&wchan_resolve(wc, &key)->wc_lock);
 }
 
 /*
@@ -1022,9 +1737,13 @@ wchan_unlock(struct wchan *wc)
 void
 wchan_sleep(struct wchan *wc)
 {
+	const void *key;
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
+	wc = wchan_resolve(wc, &key);
+	curthread->t_wchan_key = key;
 	thread_switch(S_SLEEP, wc);
 }
 
@@ -1035,10 +1754,12 @@ void
 wchan_wakeone(struct wchan *wc)
 {
 	struct thread *target;
+	const void *key;
 
 	/* Lock the channel and grab a thread from it */
+	wc = wchan_resolve(wc, &key);
 	spinlock_acquire(&wc->wc_lock);
-	target = threadlist_remhead(&wc->wc_threads);
+	target = wchan_remkey(wc, key);
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
@@ -1053,6 +1774,63 @@ wchan_wakeone(struct wchan *wc)
 	thread_make_runnable(target, false);
 }
 
+/*
+ * Wake up one thread, passing it ownership of whatever it was
+ * waiting for.
+ */
+struct thread *
+wchan_handoff(struct wchan *wc, bool here)
+{
+	struct thread *target;
+	const void *key;
+
+	wc = wchan_resolve(wc, &key);
+	spinlock_acquire(&wc->wc_lock);
+	target = wchan_remkey(wc, key);
+	spinlock_release(&wc->wc_lock);
+
+	if (target == NULL) {
+		return NULL;
+	}
+
+	/*
+	 * The target is on no list now, so nobody else is looking at
+	 * it; it's safe to change its cpu without the runqueue lock,
+	 * once its old cpu is done switching away from it.
+	 */
+	target->t_handoff = true;
+	if (here && CURCPU_EXISTS() &&
+	    thread_cpuallowed(target, curcpu->c_self)) {
+		thread_setcpu(target, curcpu->c_self);
+	}
+	thread_make_runnable(target, false);
+
+	return target;
+}
+
+/*
+ * Wake up a specific thread, if it's on the channel.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct thread *target)
+{
+	struct threadlistnode *tln;
+	const void *key;
+
+	wc = wchan_resolve(wc, &key);
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+
+	for (tln = wc->wc_threads.tl_head.tln_next; tln->tln_next != NULL;
+	     tln = tln->tln_next) {
+		if (tln->tln_self == target && target->t_wchan_key == key) {
+			threadlist_remove(&wc->wc_threads, target);
+			thread_make_runnable(target, false);
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Wake up all threads sleeping on a wait channel.
  */
@@ -1061,6 +1839,7 @@ wchan_wakeall(struct wchan *wc)
 {
 	struct thread *target;
 	struct threadlist list;
+	const void *key;
 
 	threadlist_init(&list);
 
@@ -1068,8 +1847,9 @@ wchan_wakeall(struct wchan *wc)
 	 * Lock the channel and grab all the threads, moving them to a
 	 * private list.
 	 */
+	wc = wchan_resolve(wc, &key);
 	spinlock_acquire(&wc->wc_lock);
-	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+	while ((target = wchan_remkey(wc, key)) != NULL) {
 		threadlist_addtail(&list, target);
 	}
 	/*
@@ -1090,6 +1870,37 @@ wchan_wakeall(struct wchan *wc)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up at most N threads sleeping on a wait channel.
+ */
+unsigned
+wchan_wakesome(struct wchan *wc, unsigned n)
+{
+	struct thread *target;
+	struct threadlist list;
+	const void *key;
+	unsigned count;
+
+	threadlist_init(&list);
+
+	/* As in wchan_wakeall, collect them, then wake them unlocked */
+	wc = wchan_resolve(wc, &key);
+	spinlock_acquire(&wc->wc_lock);
+	count = 0;
+	while (count < n && (target = wchan_remkey(wc, key)) != NULL) {
+		threadlist_addtail(&list, target);
+		count++;
+	}
+	spinlock_release(&wc->wc_lock);
+
+	while ((target = threadlist_remhead(&list)) != NULL) {
+		thread_make_runnable(target, false);
+	}
+
+	threadlist_cleanup(&list);
+	return count;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1097,10 +1908,20 @@ wchan_wakeall(struct wchan *wc)
 bool
 wchan_isempty(struct wchan *wc)
 {
+	struct threadlistnode *tln;
+	const void *key;
 	bool ret;
 
+	wc = wchan_resolve(wc, &key);
 	spinlock_acquire(&wc->wc_lock);
-	ret = threadlist_isempty(&wc->wc_threads);
+	ret = true;
+	for (tln = wc->wc_threads.tl_head.tln_next; tln->tln_next != NULL;
+	     tln = tln->tln_next) {
+		if (tln->tln_self->t_wchan_key == key) {
+			ret = false;
+			break;
+		}
+	}
 	spinlock_release(&wc->wc_lock);
 
 	return ret;
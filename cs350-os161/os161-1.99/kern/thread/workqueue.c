@@ -0,0 +1,206 @@
+/*
+ * Deferred work queues.
+ * The interface is described in workqueue.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <thread.h>
+#include <current.h>
+#include <workqueue.h>
+
+struct workqueue {
+	char wq_name[16];		/* Name of the wchan and thread */
+	struct spinlock wq_lock;	/* Protects everything below */
+	struct wchan *wq_wchan;		/* Worker sleeps here when idle */
+	struct work *wq_head;		/* Items to run, oldest first */
+	struct work *wq_tail;
+
+	/* Statistics */
+	unsigned wq_depth;		/* Items queued now */
+	unsigned wq_maxdepth;		/* Most ever queued at once */
+	unsigned wq_done;		/* Items run */
+	uint64_t wq_totallatency;	/* ns from queueing to running */
+	uint32_t wq_maxlatency;
+};
+
+void
+work_init(struct work *w, void (*func)(void *, unsigned long),
+	  void *data1, unsigned long data2)
+{
+	w->w_next = NULL;
+	w->w_func = func;
+	w->w_data1 = data1;
+	w->w_data2 = data2;
+	w->w_queuedat = 0;
+	w->w_pending = false;
+}
+
+bool
+work_enqueue(struct work *w)
+{
+	struct workqueue *wq;
+	int spl;
+
+	/* Stay on this cpu while we pick its queue */
+	spl = splhigh();
+	KASSERT(CURCPU_EXISTS());
+	wq = curcpu->c_workqueue;
+
+	spinlock_acquire(&wq->wq_lock);
+	if (w->w_pending) {
+		spinlock_release(&wq->wq_lock);
+		splx(spl);
+		return false;
+	}
+	w->w_pending = true;
+	w->w_next = NULL;
+	w->w_queuedat = getnsecs();
+	if (wq->wq_tail == NULL) {
+		wq->wq_head = w;
+	}
+	else {
+		wq->wq_tail->w_next = w;
+	}
+	wq->wq_tail = w;
+	wq->wq_depth++;
+	if (wq->wq_depth > wq->wq_maxdepth) {
+		wq->wq_maxdepth = wq->wq_depth;
+	}
+	wchan_wakeone(wq->wq_wchan);
+	spinlock_release(&wq->wq_lock);
+
+	splx(spl);
+	return true;
+}
+
+struct workqueue *
+workqueue_create(unsigned cpunum)
+{
+	struct workqueue *wq;
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return NULL;
+	}
+	snprintf(wq->wq_name, sizeof(wq->wq_name), "workq/%u", cpunum);
+	wq->wq_wchan = wchan_create(wq->wq_name);
+	if (wq->wq_wchan == NULL) {
+		kfree(wq);
+		return NULL;
+	}
+	spinlock_init(&wq->wq_lock);
+	wq->wq_head = wq->wq_tail = NULL;
+	wq->wq_depth = 0;
+	wq->wq_maxdepth = 0;
+	wq->wq_done = 0;
+	wq->wq_totallatency = 0;
+	wq->wq_maxlatency = 0;
+	return wq;
+}
+
+/*
+ * Worker thread: take items off the queue and run them, forever.
+ */
+static
+void
+workqueue_thread(void *data1, unsigned long data2)
+{
+	struct workqueue *wq = data1;
+	struct work *w;
+	uint64_t latency;
+
+	(void)data2;
+
+	spinlock_acquire(&wq->wq_lock);
+	while (1) {
+		while (wq->wq_head == NULL) {
+			wchan_lock(wq->wq_wchan);
+			spinlock_release(&wq->wq_lock);
+			wchan_sleep(wq->wq_wchan);
+			spinlock_acquire(&wq->wq_lock);
+		}
+
+		w = wq->wq_head;
+		wq->wq_head = w->w_next;
+		if (wq->wq_head == NULL) {
+			wq->wq_tail = NULL;
+		}
+		w->w_next = NULL;
+		w->w_pending = false;
+		wq->wq_depth--;
+
+		latency = getnsecs() - w->w_queuedat;
+		wq->wq_done++;
+		wq->wq_totallatency += latency;
+		if (latency > wq->wq_maxlatency) {
+			wq->wq_maxlatency = latency > 0xffffffff ?
+				0xffffffff : latency;
+		}
+		spinlock_release(&wq->wq_lock);
+
+		/* W may be freed (or requeued) by this */
+		w->w_func(w->w_data1, w->w_data2);
+
+		spinlock_acquire(&wq->wq_lock);
+	}
+}
+
+void
+workqueue_bootstrap(void)
+{
+	struct cpu *c;
+	unsigned i;
+	int result;
+
+	for (i=0; i<cpu_numcpus(); i++) {
+		c = cpu_get(i);
+		/*
+		 * Pin each worker to its cpu from the start, so the
+		 * items run where they were queued. (It can't move
+		 * itself with thread_setaffinity; that needs a
+		 * worker.)
+		 */
+		result = thread_fork_affinity(c->c_workqueue->wq_name, NULL,
+					      CPUMASK_CPU(c->c_number),
+					      workqueue_thread,
+					      c->c_workqueue, 0);
+		if (result) {
+			panic("workqueue_bootstrap: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+}
+
+void
+workqueue_printstats(void)
+{
+	struct workqueue *wq;
+	unsigned i, depth, maxdepth, done;
+	uint64_t total;
+	uint32_t maxlatency;
+
+	kprintf("%-10s %6s %8s %10s %12s %12s\n", "queue", "depth",
+		"maxdepth", "run", "avg lat(us)", "max lat(us)");
+	for (i=0; i<cpu_numcpus(); i++) {
+		wq = cpu_get(i)->c_workqueue;
+
+		spinlock_acquire(&wq->wq_lock);
+		depth = wq->wq_depth;
+		maxdepth = wq->wq_maxdepth;
+		done = wq->wq_done;
+		total = wq->wq_totallatency;
+		maxlatency = wq->wq_maxlatency;
+		spinlock_release(&wq->wq_lock);
+
+		kprintf("%-10s %6u %8u %10u %12llu %12u\n", wq->wq_name,
+			depth, maxdepth, done,
+			(unsigned long long)(done ? total / done / 1000 : 0),
+			maxlatency / 1000);
+	}
+}
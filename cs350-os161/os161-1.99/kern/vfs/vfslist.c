@@ -42,7 +42,10 @@
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
+#include <addrspace.h>
 #include <device.h>
+#include <clock.h>
+#include <workqueue.h>
 
 /*
  * Structure for a single named device.
@@ -169,6 +172,43 @@ vfs_sync(void)
 	return 0;
 }
 
+/*
+ * Background syncer. Filesystems write some things (e.g. the SFS
+ * superblock and freemap) back only on sync; rather than leave them
+ * dirty until unmount, a timeout kicks a workqueue thread into
+ * calling vfs_sync every VFS_SYNC_SECS seconds. The timeout can't do
+ * it itself because it runs in an interrupt handler.
+ */
+static struct timeout vfs_synctimeout;
+static struct work vfs_syncwork;
+
+static
+void
+vfs_syncer_work(void *data1, unsigned long data2)
+{
+	(void)data1;
+	(void)data2;
+
+	vfs_sync();
+	timeout_add(&vfs_synctimeout, VFS_SYNC_SECS * clock_tickspersec());
+}
+
+static
+void
+vfs_syncer_timeout(void *data)
+{
+	(void)data;
+	work_enqueue(&vfs_syncwork);
+}
+
+void
+vfs_syncer_start(void)
+{
+	work_init(&vfs_syncwork, vfs_syncer_work, NULL, 0);
+	timeout_init(&vfs_synctimeout, vfs_syncer_timeout, NULL);
+	timeout_add(&vfs_synctimeout, VFS_SYNC_SECS * clock_tickspersec());
+}
+
 /*
  * Given a device name (lhd0, emu0, somevolname, null, etc.), hand
  * back an appropriate vnode.
@@ -571,6 +611,9 @@ vfs_unmount(const char *devname)
 	KASSERT(kd->kd_rawname != NULL);
 	KASSERT(kd->kd_device != NULL);
 
+	/* The exec header cache holds vnodes open */
+	elfcache_purge(kd->kd_fs);
+
 	result = FSOP_SYNC(kd->kd_fs);
 	if (result) {
 		goto fail;
@@ -619,6 +662,8 @@ vfs_unmountall(void)
 
 		kprintf("vfs: Unmounting %s:\n", dev->kd_name);
 
+		elfcache_purge(dev->kd_fs);
+
 		result = FSOP_SYNC(dev->kd_fs);
 		if (result) {
 			kprintf("vfs: Warning: sync failed for %s: %s, trying "
@@ -53,6 +53,10 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	vn->vn_opencount = 0;
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
+	spinlock_init(&vn->vn_imagelock);
+	vn->vn_image = NULL;
+	vn->vn_imagegen = 0;
+	vn->vn_imagewriters = 0;
 	return 0;
 }
 
@@ -71,6 +75,9 @@ vnode_cleanup(struct vnode *vn)
 	vn->vn_opencount = 0;
 	vn->vn_fs = NULL;
 	vn->vn_data = NULL;
+	kfree(vn->vn_image);
+	vn->vn_image = NULL;
+	spinlock_cleanup(&vn->vn_imagelock);
 }
 
 
@@ -225,3 +232,67 @@ vnode_check(struct vnode *v, const char *opstr)
 
 	vfs_biglock_release();
 }
+
+/*
+ * Throw away the cached executable image, if any, before a write or
+ * truncate, and note that one is under way. Bumping vn_imagegen, and
+ * vn_imagewriters being nonzero, stop a load_elf that is reading the
+ * old or half-written contents from caching them.
+ */
+static
+void
+vnode_modified(struct vnode *vn)
+{
+	struct elfimage *ei;
+
+	spinlock_acquire(&vn->vn_imagelock);
+	ei = vn->vn_image;
+	vn->vn_image = NULL;
+	vn->vn_imagegen++;
+	vn->vn_imagewriters++;
+	spinlock_release(&vn->vn_imagelock);
+
+	kfree(ei);
+}
+
+/*
+ * The write or truncate vnode_modified announced is over.
+ */
+static
+void
+vnode_modifydone(struct vnode *vn)
+{
+	spinlock_acquire(&vn->vn_imagelock);
+	KASSERT(vn->vn_imagewriters > 0);
+	vn->vn_imagewriters--;
+	vn->vn_imagegen++;
+	spinlock_release(&vn->vn_imagelock);
+}
+
+/*
+ * Called by VOP_WRITE.
+ */
+int
+vnode_write(struct vnode *vn, struct uio *uio)
+{
+	int result;
+
+	vnode_modified(vn);
+	result = __VOP(vn, write)(vn, uio);
+	vnode_modifydone(vn);
+	return result;
+}
+
+/*
+ * Called by VOP_TRUNCATE.
+ */
+int
+vnode_truncate(struct vnode *vn, off_t pos)
+{
+	int result;
+
+	vnode_modified(vn);
+	result = __VOP(vn, truncate)(vn, pos);
+	vnode_modifydone(vn);
+	return result;
+}
@@ -347,6 +347,30 @@ kheap_printstats(void)
 	spinlock_release(&kmalloc_spinlock);
 }
 
+/*
+ * Return the number of bytes allocated from the subpage allocator,
+ * counting each block at its full size. (Allocations of a page or
+ * more go straight to the VM system and aren't counted.)
+ */
+size_t
+kheap_getused(void)
+{
+	struct pageref *pr;
+	size_t total;
+	unsigned blktype;
+
+	total = 0;
+	spinlock_acquire(&kmalloc_spinlock);
+	for (pr = allbase; pr != NULL; pr = pr->next_all) {
+		blktype = PR_BLOCKTYPE(pr);
+		total += (PAGE_SIZE / sizes[blktype] - pr->nfree) *
+			sizes[blktype];
+	}
+	spinlock_release(&kmalloc_spinlock);
+
+	return total;
+}
+
 ////////////////////////////////////////
 
 static
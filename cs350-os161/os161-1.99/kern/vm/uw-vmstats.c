@@ -2,24 +2,19 @@
 
 /* belongs in kern/vm/uw-vmstats.c */
 
-/* NOTE !!!!!! WARNING !!!!!
- * All of the functions whose names begin with '_'
- * assume that atomicity is ensured elsewhere
- * (i.e., outside of these routines) by acquiring stats_lock.
- * All of the functions whose names do not begin
- * with '_' ensure atomicity locally.
+/* The counts are kept in per-cpu counters (see counter.h), which
+ * need no lock. The functions whose names begin with '_' used to
+ * assume the caller held a global stats_lock; they're now the same
+ * as the ones without, and are kept for compatibility.
  */
 
 #include <types.h>
 #include <lib.h>
-#include <synch.h>
-#include <spl.h>
+#include <counter.h>
 #include <uw-vmstats.h>
 
 /* Counters for tracking statistics */
-static unsigned int stats_counts[VMSTAT_COUNT];
-
-struct spinlock stats_lock = SPINLOCK_INITIALIZER;
+static counter_t stats_counters[VMSTAT_COUNT];
 
 /* Strings used in printing out the statistics */
 static const char *stats_names[] = {
@@ -41,23 +36,17 @@ static const char *stats_names[] = {
 void
 vmstats_inc(unsigned int index)
 {
-    spinlock_acquire(&stats_lock);
-      _vmstats_inc(index);
-    spinlock_release(&stats_lock);
+  _vmstats_inc(index);
 }
 
 /* ---------------------------------------------------------------------- */
 void
 vmstats_init(void)
 {
-  /* Although the spinlock is initialized at declaration time we do it here
-   * again in case we want use/reset these stats repeatedly without shutting down the kernel.
+  /* May be called repeatedly, to reset the stats without shutting down
+   * the kernel; registering a counter again just finds the old one.
    */
-  spinlock_init(&stats_lock);
-
-  spinlock_acquire(&stats_lock);
-    _vmstats_init();
-  spinlock_release(&stats_lock);
+  _vmstats_init();
 }
 
 /* ---------------------------------------------------------------------- */
@@ -65,7 +54,7 @@ void
 _vmstats_inc(unsigned int index)
 {
   KASSERT(index < VMSTAT_COUNT);
-  stats_counts[index]++;
+  counter_inc(stats_counters[index]);
 }
 
 /* ---------------------------------------------------------------------- */
@@ -81,21 +70,23 @@ _vmstats_init(void)
   }
 
   for (i=0; i<VMSTAT_COUNT; i++) {
-    stats_counts[i] = 0;
+    stats_counters[i] = counter_register(stats_names[i]);
+    counter_reset(stats_counters[i]);
   }
 
 }
 
 /* ---------------------------------------------------------------------- */
 /* Assumes vmstat_init has already been called */
-/* NOTE: We do not grab the spinlock here because kprintf may block
- * and we can't block while holding a spinlock.
- * Just use this when there is only one thread remaining.
+/* NOTE: The totals are read without stopping anyone from counting,
+ * so use this when there is only one thread remaining if the
+ * consistency checks below are to mean anything.
  */
 
 void
 vmstats_print(void)
 {
+  unsigned int stats_counts[VMSTAT_COUNT];
   int i = 0;
   int free_plus_replace = 0;
   int disk_plus_zeroed_plus_reload = 0;
@@ -103,6 +94,10 @@ vmstats_print(void)
   int elf_plus_swap_reads = 0;
   int disk_reads = 0;
 
+  for (i=0; i<VMSTAT_COUNT; i++) {
+    stats_counts[i] = counter_read(stats_counters[i]);
+  }
+
   kprintf("VMSTATS:\n");
   for (i=0; i<VMSTAT_COUNT; i++) {
     kprintf("VMSTAT %25s = %10d\n", stats_names[i], stats_counts[i]);
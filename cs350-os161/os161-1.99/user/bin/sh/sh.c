@@ -65,6 +65,23 @@
 /* set to nonzero if __time syscall seems to work */
 static int timing = 0;
 
+/*
+ * how to start commands: fork then execv, vfork then execv, or spawn,
+ * which does both in one system call. the bench builtin compares them.
+ */
+#define LAUNCH_FORK	0
+#define LAUNCH_VFORK	1
+#define LAUNCH_SPAWN	2
+#define NLAUNCH		3
+
+static const char *const launchnames[NLAUNCH] = { "fork", "vfork", "spawn" };
+
+#ifdef HOST
+static int launchhow = LAUNCH_FORK;
+#else
+static int launchhow = LAUNCH_SPAWN;
+#endif
+
 /* array of backgrounded jobs (allows "foregrounding") */
 #define MAXBG 128
 static pid_t bgpids[MAXBG];
@@ -277,6 +294,108 @@ cmd_exit(int ac, char *av[])
 	return 0; /* quell the compiler warning */
 }
 
+/*
+ * launch
+ * starts the command in args the way how says and returns its pid, or
+ * -1 if it couldn't be started. with fork and vfork, a failed execv
+ * only shows up as the child's exit status; spawn reports it here.
+ */
+static
+pid_t
+launch(char **args, int how)
+{
+	pid_t pid;
+
+	switch (how) {
+#ifndef HOST
+	    case LAUNCH_SPAWN:
+		return spawn(args[0], args);
+	    case LAUNCH_VFORK:
+		/* the child runs in our memory until it execs or exits */
+		pid = vfork();
+		break;
+#endif
+	    default:
+		pid = fork();
+		break;
+	}
+	if (pid == 0) {
+		/* child */
+		execv(args[0], args);
+		warn("%s", args[0]);
+		/*
+		 * Use _exit() instead of exit() in the child
+		 * process to avoid calling atexit() functions,
+		 * which would cause hostcompat (if present) to
+		 * reset the tty state and mess up our input
+		 * handling.
+		 */
+		_exit(1);
+	}
+	return pid;
+}
+
+/*
+ * bench
+ * runs a command count times in the foreground with each way of
+ * starting it, and prints how many launches per second each manages.
+ * best run with something quick, like /bin/true.
+ */
+static
+int
+cmd_bench(int ac, char *av[])
+{
+	int count, how, i, status, failed;
+	pid_t pid;
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs, ms;
+
+	if (ac < 3 || (count = atoi(av[1])) <= 0) {
+		printf("Usage: bench count command [args]\n");
+		return 1;
+	}
+	if (!timing) {
+		printf("bench: no timing available\n");
+		return 1;
+	}
+
+	for (how = 0; how < NLAUNCH; how++) {
+		failed = 0;
+		__time(&startsecs, &startnsecs);
+		for (i = 0; i < count && !failed; i++) {
+			pid = launch(av + 2, how);
+			if (pid < 0) {
+				warn("bench: %s", launchnames[how]);
+				failed = 1;
+			}
+			else if (waitpid(pid, &status, 0) < 0) {
+				warn("bench: waitpid");
+				failed = 1;
+			}
+			else if (status != 0) {
+				printf("bench: %s: ", av[2]);
+				printstatus(status);
+				printf("\n");
+				failed = 1;
+			}
+		}
+		__time(&endsecs, &endnsecs);
+		if (failed) {
+			continue;
+		}
+
+		ms = (endsecs - startsecs) * 1000;
+		ms = ms + endnsecs / 1000000 - startnsecs / 1000000;
+		if (ms == 0) {
+			ms = 1;
+		}
+		printf("%-5s: %d launches in %lu.%03lu seconds, %lu per second\n",
+		       launchnames[how], count, ms / 1000, ms % 1000,
+		       (unsigned long) count * 1000 / ms);
+	}
+	return 0;
+}
+
 /*
  * a struct of the builtins associates the builtin name with the function that
  * executes it.  they must all take an argc and argv.
@@ -288,6 +407,7 @@ static struct {
 	{ "cd",    cmd_chdir },
 	{ "chdir", cmd_chdir },
 	{ "exit",  cmd_exit },
+	{ "bench", cmd_bench },
 	{ "wait",  cmd_wait },
 	{ NULL, NULL }
 };
@@ -354,26 +474,20 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			return _MKWAIT_EXIT(255);
-		case 0:
-			/* child */
-			execv(args[0], args);
+	pid = launch(args, launchhow);
+	if (pid < 0 && launchhow == LAUNCH_SPAWN && errno == ENOSYS) {
+		/* no spawn in this kernel; don't try it again */
+		launchhow = LAUNCH_FORK;
+		pid = launch(args, launchhow);
+	}
+	if (pid < 0) {
+		if (launchhow == LAUNCH_SPAWN) {
+			/* the same as a child whose execv failed */
 			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
+			return _MKWAIT_EXIT(1);
+		}
+		warn("%s", launchnames[launchhow]);
+		return _MKWAIT_EXIT(255);
 	}
 
 	/* parent */
@@ -0,0 +1,42 @@
+#ifndef _SYNCH_H_
+#define _SYNCH_H_
+
+/*
+ * Mutexes and condition variables for threads sharing memory.
+ *
+ * Both are built on futex(): they work with atomic operations on a
+ * word of user memory, and only call into the kernel when a thread
+ * actually has to sleep, or when one might be sleeping and needs a
+ * wakeup. Locking a free mutex, unlocking one nobody's waiting for,
+ * and signalling a condition variable nobody's waiting on are all
+ * done without a system call.
+ *
+ * Either can be set up with its initializer or its init function;
+ * neither needs cleaning up. As with the kernel's, cond_wait may
+ * return without a signal, so wait in a loop that checks for what
+ * you're waiting for.
+ */
+
+struct mutex {
+	volatile int m_state;		/* 0 free, 1 locked, 2 contended */
+};
+
+struct cond {
+	volatile int c_seq;		/* Bumped by each signal */
+	volatile int c_waiters;		/* Threads in cond_wait */
+};
+
+#define MUTEX_INITIALIZER	{ 0 }
+#define COND_INITIALIZER	{ 0, 0 }
+
+void mutex_init(struct mutex *m);
+void mutex_lock(struct mutex *m);
+int mutex_trylock(struct mutex *m);	/* nonzero if it got the lock */
+void mutex_unlock(struct mutex *m);
+
+void cond_init(struct cond *c);
+void cond_wait(struct cond *c, struct mutex *m);
+void cond_signal(struct cond *c);
+void cond_broadcast(struct cond *c);
+
+#endif /* _SYNCH_H_ */
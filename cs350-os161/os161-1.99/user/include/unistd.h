@@ -42,8 +42,11 @@
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
+#include <kern/resource.h>	/* needs struct timeval */
 #include <kern/unistd.h>
 #include <kern/wait.h>
+#include <kern/sysring.h>
+#include <kern/futex.h>
 
 
 /*
@@ -154,6 +157,17 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+int getrusage(int who, struct rusage *usage);
+int setaffinity(unsigned mask);
+int getaffinity(unsigned *mask);
+pid_t vfork(void);
+pid_t spawn(const char *prog, char *const *args);
+int sysstat(struct syscallstat *stats, unsigned max);
+int sysbatch(struct sysring *ring);
+int futex(int *addr, int op, int val);
+int __thread_create(void (*entry)(void *), void *arg, void *stack);
+__DEAD void thread_exit(int code);
+int thread_join(int tid, int *code);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -162,6 +176,9 @@ int __getcwd(char *buf, size_t buflen);
  */
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
-time_t time(time_t *seconds);			/* calls __time */
+time_t time(time_t *seconds);			/* reads the time page */
+time_t __time_coarse(time_t *seconds, unsigned long *nanoseconds);
+int thread_create(int (*func)(void *), void *arg,
+		  void *stack, size_t stacksize);	/* calls __thread_create */
 
 #endif /* _UNISTD_H_ */
@@ -0,0 +1,216 @@
+/*
+ * User-level mutexes and condition variables, on top of futex().
+ * See <synch.h>.
+ */
+
+#include <unistd.h>
+#include <synch.h>
+
+/* More than there can be threads to wake */
+#define WAKE_ALL 0x7fffffff
+
+/*
+ * Atomic operations using LL/SC, as the kernel's spinlocks do. Each
+ * retries until its SC goes through. membar() orders memory around
+ * taking and dropping a lock on a multiprocessor.
+ */
+
+#define membar() __asm volatile(".set push; .set mips32; sync; .set pop" \
+			      ::: "memory")
+
+/* If *P is OLD, make it NEW. Returns what *P was. */
+static
+int
+cas(volatile int *p, int old, int new)
+{
+	int x, y;
+
+	do {
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set noreorder;"	/* we fill the delay slot */
+			"ll %0, 0(%2);"		/*   x = *p */
+			"bne %0, %3, 1f;"	/*   if (x != old) give up */
+			" li %1, 1;"		/*   (delay slot) y = 1 */
+			"move %1, %4;"		/*   y = new */
+			"sc %1, 0(%2);"		/*   *p = y; y = success? */
+			"1: .set pop"		/* restore assembler mode */
+			: "=&r" (x), "=&r" (y)
+			: "r" (p), "r" (old), "r" (new)
+			: "memory");
+	} while (y == 0);
+	return x;
+}
+
+/* Set *P to NEW and return what it was. */
+static
+int
+xchg(volatile int *p, int new)
+{
+	int x, y;
+
+	do {
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *p */
+			"move %1, %3;"		/*   y = new */
+			"sc %1, 0(%2);"		/*   *p = y; y = success? */
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "=&r" (y) : "r" (p), "r" (new)
+			: "memory");
+	} while (y == 0);
+	return x;
+}
+
+/* Add DELTA to *P and return what it was. */
+static
+int
+fetchadd(volatile int *p, int delta)
+{
+	int x, y;
+
+	do {
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *p */
+			"addu %1, %0, %3;"	/*   y = x + delta */
+			"sc %1, 0(%2);"		/*   *p = y; y = success? */
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "=&r" (y) : "r" (p), "r" (delta)
+			: "memory");
+	} while (y == 0);
+	return x;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Mutexes.
+//
+// The state is 0 when free, 1 when locked, and 2 when locked and
+// someone may be asleep waiting for it. Only the last makes unlock
+// call futex; a locker that has to wait sets 2 before sleeping, and
+// having once slept keeps setting 2 when it gets the lock, since it
+// can't tell whether others are still waiting. (This is the third
+// mutex in Drepper's "Futexes Are Tricky".)
+
+void
+mutex_init(struct mutex *m)
+{
+	m->m_state = 0;
+}
+
+/*
+ * Take the lock having already seen it held: mark it contended and
+ * sleep until a swap to 2 finds it free.
+ */
+static
+void
+mutex_lock_slow(struct mutex *m, int c)
+{
+	if (c != 2) {
+		c = xchg(&m->m_state, 2);
+	}
+	while (c != 0) {
+		futex((int *)&m->m_state, FUTEX_WAIT, 2);
+		c = xchg(&m->m_state, 2);
+	}
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+	int c;
+
+	c = cas(&m->m_state, 0, 1);
+	if (c != 0) {
+		mutex_lock_slow(m, c);
+	}
+	membar();
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+	if (cas(&m->m_state, 0, 1) != 0) {
+		return 0;
+	}
+	membar();
+	return 1;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+	membar();
+	if (xchg(&m->m_state, 0) == 2) {
+		futex((int *)&m->m_state, FUTEX_WAKE, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Condition variables.
+//
+// A waiter notes c_seq, counts itself in c_waiters, and sleeps on
+// c_seq as long as it hasn't changed. A signal bumps c_seq first, so
+// a waiter that hasn't gone to sleep yet won't, and only then looks
+// at c_waiters, so it can skip the wakeup if nobody is there: any
+// waiter it doesn't see counted read c_seq too early to sleep.
+
+void
+cond_init(struct cond *c)
+{
+	c->c_seq = 0;
+	c->c_waiters = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+	int seq;
+
+	seq = c->c_seq;
+	fetchadd(&c->c_waiters, 1);
+	mutex_unlock(m);
+
+	/* EAGAIN if signalled since we looked; that's a wakeup too */
+	futex((int *)&c->c_seq, FUTEX_WAIT, seq);
+
+	fetchadd(&c->c_waiters, -1);
+
+	/*
+	 * Others woken by a broadcast may be queueing for the mutex
+	 * behind us, so take it as contended and leave the unlock to
+	 * wake them.
+	 */
+	mutex_lock_slow(m, 1);
+	membar();
+}
+
+static
+void
+cond_wake(struct cond *c, int n)
+{
+	fetchadd(&c->c_seq, 1);
+	membar();
+	if (c->c_waiters > 0) {
+		futex((int *)&c->c_seq, FUTEX_WAKE, n);
+	}
+}
+
+void
+cond_signal(struct cond *c)
+{
+	cond_wake(c, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+	cond_wake(c, WAKE_ALL);
+}
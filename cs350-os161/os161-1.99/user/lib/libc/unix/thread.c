@@ -0,0 +1,49 @@
+/*
+ * thread_create: start a thread in this process running FUNC(ARG)
+ * on the stack the caller supplies, and return its id for
+ * thread_join. When FUNC returns, the thread exits with its return
+ * value as the exit code. The stack mustn't be reused until the
+ * thread has been joined.
+ *
+ * Uses the system call __thread_create, which starts the thread at
+ * thread_start with FUNC and ARG stored at the top of its stack.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+
+/* Smaller than this can't be a usable stack */
+#define THREAD_MINSTACK 256
+
+struct thread_args {
+	int (*ta_func)(void *);
+	void *ta_arg;
+};
+
+static
+void
+thread_start(void *data)
+{
+	struct thread_args *ta = data;
+
+	thread_exit(ta->ta_func(ta->ta_arg));
+}
+
+int
+thread_create(int (*func)(void *), void *arg, void *stack, size_t stacksize)
+{
+	struct thread_args *ta;
+	unsigned long top;
+
+	if (stacksize < THREAD_MINSTACK) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* FUNC and ARG on top, then thread_start's argument save area */
+	top = ((unsigned long)stack + stacksize) & ~7UL;
+	ta = (struct thread_args *)((top - sizeof(*ta)) & ~7UL);
+	ta->ta_func = func;
+	ta->ta_arg = arg;
+	return __thread_create(thread_start, ta, (char *)ta - 16);
+}
@@ -0,0 +1,308 @@
+/*
+ * host-kprof: make a flat profile from the kernel profiler's samples.
+ *
+ * Usage: host-kprof kernel [dumpfile]
+ *
+ * KERNEL is the kernel image that was running (with its symbol
+ * table); DUMPFILE is a capture of the console output of the
+ * "kprof dump" menu command (standard input if not given). Anything
+ * outside the kprof-begin/kprof-end lines is ignored, so a whole
+ * session log will do.
+ *
+ * Prints every function that got samples, busiest first, with its
+ * share of the total and the running total.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#define MAXLINE 256
+
+/* ELF bits we need; the kernel is 32-bit MIPS, normally big-endian */
+#define EI_CLASS	4
+#define EI_DATA		5
+#define ELFCLASS32	1
+#define ELFDATA2LSB	1
+#define SHT_SYMTAB	2
+#define STT_FUNC	2
+
+#define EHDR_SHOFF	32	/* offsets of fields in Elf32_Ehdr */
+#define EHDR_SHENTSIZE	46
+#define EHDR_SHNUM	48
+#define SHDR_SIZE	40
+#define SYM_SIZE	16
+
+struct func {
+	uint32_t addr;
+	uint32_t end;
+	const char *name;
+	unsigned long hits;
+};
+
+static struct func *funcs;
+static unsigned nfuncs;
+static int littleendian;
+
+static
+uint32_t
+get32(const unsigned char *p)
+{
+	if (littleendian) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static
+uint16_t
+get16(const unsigned char *p)
+{
+	if (littleendian) {
+		return p[0] | (p[1] << 8);
+	}
+	return (p[0] << 8) | p[1];
+}
+
+static
+unsigned char *
+readfile(const char *path, size_t *len)
+{
+	FILE *f;
+	unsigned char *buf;
+	long size;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		err(1, "%s", path);
+	}
+	if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0) {
+		err(1, "%s: seek", path);
+	}
+	rewind(f);
+	buf = malloc(size);
+	if (buf == NULL) {
+		err(1, "malloc");
+	}
+	if (fread(buf, 1, size, f) != (size_t)size) {
+		errx(1, "%s: short read", path);
+	}
+	fclose(f);
+	*len = size;
+	return buf;
+}
+
+static
+int
+funccmp(const void *a, const void *b)
+{
+	const struct func *fa = a, *fb = b;
+
+	if (fa->addr != fb->addr) {
+		return fa->addr < fb->addr ? -1 : 1;
+	}
+	return 0;
+}
+
+static
+int
+hitscmp(const void *a, const void *b)
+{
+	const struct func *fa = a, *fb = b;
+
+	if (fa->hits != fb->hits) {
+		return fa->hits > fb->hits ? -1 : 1;
+	}
+	return strcmp(fa->name, fb->name);
+}
+
+/*
+ * Load the function symbols from the kernel image.
+ */
+static
+void
+loadsyms(const char *path)
+{
+	unsigned char *img, *sh, *symsh, *strsh, *sym;
+	size_t len;
+	uint32_t shoff, symoff, symsize, stroff, strsize, i;
+	unsigned shnum, link;
+
+	img = readfile(path, &len);
+	if (len < 52 || memcmp(img, "\177ELF", 4) != 0 ||
+	    img[EI_CLASS] != ELFCLASS32) {
+		errx(1, "%s: not a 32-bit ELF file", path);
+	}
+	littleendian = img[EI_DATA] == ELFDATA2LSB;
+
+	shoff = get32(img + EHDR_SHOFF);
+	shnum = get16(img + EHDR_SHNUM);
+	if (get16(img + EHDR_SHENTSIZE) != SHDR_SIZE ||
+	    shoff + (uint64_t)shnum * SHDR_SIZE > len) {
+		errx(1, "%s: bad section headers", path);
+	}
+
+	symsh = NULL;
+	for (i=0; i<shnum; i++) {
+		sh = img + shoff + i * SHDR_SIZE;
+		if (get32(sh + 4) == SHT_SYMTAB) {
+			symsh = sh;
+			break;
+		}
+	}
+	if (symsh == NULL) {
+		errx(1, "%s: no symbol table (stripped?)", path);
+	}
+	link = get32(symsh + 24);
+	if (link >= shnum) {
+		errx(1, "%s: bad symbol table", path);
+	}
+	strsh = img + shoff + link * SHDR_SIZE;
+
+	symoff = get32(symsh + 16);
+	symsize = get32(symsh + 20);
+	stroff = get32(strsh + 16);
+	strsize = get32(strsh + 20);
+	if (symoff + (uint64_t)symsize > len ||
+	    stroff + (uint64_t)strsize > len || strsize == 0 ||
+	    img[stroff + strsize - 1] != 0) {
+		errx(1, "%s: bad symbol table", path);
+	}
+
+	funcs = malloc((symsize / SYM_SIZE) * sizeof(*funcs));
+	if (funcs == NULL) {
+		err(1, "malloc");
+	}
+	nfuncs = 0;
+	for (i=0; i + SYM_SIZE <= symsize; i += SYM_SIZE) {
+		sym = img + symoff + i;
+		if ((sym[12] & 0xf) != STT_FUNC || get32(sym + 4) == 0 ||
+		    get32(sym) >= strsize) {
+			continue;
+		}
+		funcs[nfuncs].addr = get32(sym + 4);
+		funcs[nfuncs].end = funcs[nfuncs].addr + get32(sym + 8);
+		funcs[nfuncs].name = (const char *)img + stroff + get32(sym);
+		funcs[nfuncs].hits = 0;
+		nfuncs++;
+	}
+	qsort(funcs, nfuncs, sizeof(*funcs), funccmp);
+
+	/* Assembler functions often have no size; run to the next one */
+	for (i=0; i+1<nfuncs; i++) {
+		if (funcs[i].end == funcs[i].addr) {
+			funcs[i].end = funcs[i+1].addr;
+		}
+	}
+	/* IMG stays allocated; the names point into it */
+}
+
+static
+struct func *
+lookup(uint32_t pc)
+{
+	unsigned lo, hi, mid;
+
+	lo = 0;
+	hi = nfuncs;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (funcs[mid].addr <= pc) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	if (lo == 0 || pc >= funcs[lo-1].end) {
+		return NULL;
+	}
+	return &funcs[lo-1];
+}
+
+int
+main(int argc, char *argv[])
+{
+	FILE *in;
+	char line[MAXLINE];
+	unsigned long pc, count, total, unknown, cumulative;
+	struct func *f;
+	int inside, sawdump;
+	unsigned i;
+
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "Usage: %s kernel [dumpfile]\n", argv[0]);
+		exit(1);
+	}
+	loadsyms(argv[1]);
+
+	if (argc == 3) {
+		in = fopen(argv[2], "r");
+		if (in == NULL) {
+			err(1, "%s", argv[2]);
+		}
+	}
+	else {
+		in = stdin;
+	}
+
+	/* If there are several dumps, the last one wins */
+	total = unknown = 0;
+	inside = sawdump = 0;
+	while (fgets(line, sizeof(line), in) != NULL) {
+		if (!strncmp(line, "kprof-begin", 11)) {
+			for (i=0; i<nfuncs; i++) {
+				funcs[i].hits = 0;
+			}
+			total = unknown = 0;
+			inside = sawdump = 1;
+			continue;
+		}
+		if (!strncmp(line, "kprof-end", 9)) {
+			inside = 0;
+			continue;
+		}
+		if (!inside || sscanf(line, "%lx %lu", &pc, &count) != 2) {
+			continue;
+		}
+		total += count;
+		f = lookup(pc);
+		if (f == NULL) {
+			unknown += count;
+		}
+		else {
+			f->hits += count;
+		}
+	}
+	if (in != stdin) {
+		fclose(in);
+	}
+	if (!sawdump) {
+		errx(1, "no kprof-begin line found");
+	}
+	if (total == 0) {
+		printf("No kernel samples.\n");
+		return 0;
+	}
+
+	qsort(funcs, nfuncs, sizeof(*funcs), hitscmp);
+
+	printf("%6s %6s %9s  %s\n", "%", "cum %", "samples", "function");
+	cumulative = 0;
+	for (i=0; i<nfuncs && funcs[i].hits > 0; i++) {
+		cumulative += funcs[i].hits;
+		printf("%6.2f %6.2f %9lu  %s\n",
+		       100.0 * funcs[i].hits / total,
+		       100.0 * cumulative / total,
+		       funcs[i].hits, funcs[i].name);
+	}
+	if (unknown > 0) {
+		printf("%6.2f %6s %9lu  (not in any function)\n",
+		       100.0 * unknown / total, "", unknown);
+	}
+	printf("%6s %6s %9lu  total\n", "", "", total);
+	return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * host-ktrace: turn a kernel event trace into a timeline.
+ *
+ * Usage: host-ktrace [dumpfile]
+ *
+ * DUMPFILE is the output of the "ktrace dump" menu command, either
+ * the file it wrote or a capture of the console (standard input if
+ * not given). Anything outside the ktrace-begin/ktrace-end lines is
+ * ignored, so a whole session log will do; if there are several
+ * dumps, the last one wins.
+ *
+ * Writes JSON in the Chrome trace event format to standard output;
+ * load it into chrome://tracing or ui.perfetto.dev. It shows:
+ *
+ *    - a track per cpu, with a slice for each stretch a thread ran;
+ *    - a track per thread, with its system calls as slices and its
+ *      faults, wakeups, and lock contention as instants;
+ *    - a track per disk, with each sector transfer.
+ *
+ * Threads are identified by the address of their struct thread.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "kern/syscall.h"
+
+#define MAXLINE 256
+#define MAXCPUS 32
+#define MAXTHREADS 1024
+
+/* Track groups ("processes" in the trace format) */
+#define PID_CPUS	1
+#define PID_THREADS	2
+#define PID_DISKS	3
+
+/* Must match KT_DISKWRITE and the LOCKSTAT_* kinds in the kernel */
+#define DISKWRITE	0x80000000
+static const char *const lockkinds[] = { "spinlock", "lock", "sem", "cv" };
+
+static const char *const states[] = { "run", "ready", "sleep", "zombie" };
+
+static const char *const callnames[] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_getrusage] = "getrusage",
+	[SYS_open] = "open",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_write] = "write",
+	[SYS_lseek] = "lseek",
+	[SYS___time] = "__time",
+	[SYS_reboot] = "reboot",
+	[SYS_setaffinity] = "setaffinity",
+	[SYS_getaffinity] = "getaffinity",
+	[SYS_spawn] = "spawn",
+	[SYS_sysstat] = "sysstat",
+	[SYS_sysbatch] = "sysbatch",
+	[SYS_futex] = "futex",
+	[SYS___thread_create] = "__thread_create",
+	[SYS_thread_exit] = "thread_exit",
+	[SYS_thread_join] = "thread_join",
+};
+#define NCALLNAMES (sizeof(callnames) / sizeof(callnames[0]))
+
+struct rec {
+	double ts;			/* microseconds since the first record */
+	unsigned cpu;
+	uint32_t thread;
+	char event[16];
+	uint32_t arg1, arg2;
+};
+
+/* What each cpu is running, and since when */
+static uint32_t running[MAXCPUS];
+static double runstart[MAXCPUS];
+static int seencpu[MAXCPUS];
+
+/* Threads we've seen, and whether each is in a system call */
+static uint32_t threads[MAXTHREADS];
+static int insyscall[MAXTHREADS];
+static unsigned nthreads;
+
+static double lastts;
+static int needcomma;
+
+static
+void
+emit(const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("%s\n", needcomma ? "," : "");
+	needcomma = 1;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+static
+unsigned
+threadslot(uint32_t t)
+{
+	unsigned i;
+
+	for (i=0; i<nthreads; i++) {
+		if (threads[i] == t) {
+			return i;
+		}
+	}
+	if (nthreads == MAXTHREADS) {
+		errx(1, "too many threads");
+	}
+	threads[nthreads] = t;
+	insyscall[nthreads] = 0;
+	emit("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+	     "\"tid\":%u,\"args\":{\"name\":\"thread 0x%08x\"}}",
+	     PID_THREADS, (unsigned)t, (unsigned)t);
+	return nthreads++;
+}
+
+static
+const char *
+callname(uint32_t callno)
+{
+	static char buf[32];
+
+	if (callno < NCALLNAMES && callnames[callno] != NULL) {
+		return callnames[callno];
+	}
+	snprintf(buf, sizeof(buf), "syscall %u", (unsigned)callno);
+	return buf;
+}
+
+/*
+ * End the slice for whatever cpu C has been running.
+ */
+static
+void
+endrun(unsigned c, double ts, const char *state)
+{
+	emit("{\"ph\":\"X\",\"name\":\"thread 0x%08x\",\"pid\":%d,"
+	     "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+	     "\"args\":{\"thread\":\"0x%08x\",\"then\":\"%s\"}}",
+	     (unsigned)running[c], PID_CPUS, c, runstart[c],
+	     ts - runstart[c], (unsigned)running[c], state);
+}
+
+static
+void
+handle(const struct rec *r)
+{
+	unsigned c = r->cpu, slot;
+
+	if (c >= MAXCPUS) {
+		errx(1, "cpu %u out of range", c);
+	}
+	if (!seencpu[c]) {
+		emit("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+		     "\"tid\":%u,\"args\":{\"name\":\"cpu%u\"}}",
+		     PID_CPUS, c, c);
+		/* Whoever made the first record was already running */
+		seencpu[c] = 1;
+		running[c] = r->thread;
+		runstart[c] = r->ts;
+	}
+	slot = threadslot(r->thread);
+	lastts = r->ts;
+
+	if (!strcmp(r->event, "switch")) {
+		endrun(c, r->ts,
+		       r->arg2 < 4 ? states[r->arg2] : "?");
+		running[c] = r->arg1;
+		runstart[c] = r->ts;
+	}
+	else if (!strcmp(r->event, "syscall")) {
+		emit("{\"ph\":\"B\",\"name\":\"%s\",\"pid\":%d,\"tid\":%u,"
+		     "\"ts\":%.3f}",
+		     callname(r->arg1), PID_THREADS, (unsigned)r->thread, r->ts);
+		insyscall[slot] = 1;
+	}
+	else if (!strcmp(r->event, "sysret")) {
+		/* Skip calls that were already going when tracing began */
+		if (insyscall[slot]) {
+			emit("{\"ph\":\"E\",\"pid\":%d,\"tid\":%u,"
+			     "\"ts\":%.3f,\"args\":{\"error\":%u}}",
+			     PID_THREADS, (unsigned)r->thread, r->ts,
+			     (unsigned)r->arg2);
+			insyscall[slot] = 0;
+		}
+	}
+	else if (!strcmp(r->event, "vmfault")) {
+		emit("{\"ph\":\"i\",\"s\":\"t\",\"name\":\"vm_fault\","
+		     "\"pid\":%d,\"tid\":%u,\"ts\":%.3f,"
+		     "\"args\":{\"addr\":\"0x%08x\",\"type\":%u}}",
+		     PID_THREADS, (unsigned)r->thread, r->ts,
+		     (unsigned)r->arg1, (unsigned)r->arg2);
+	}
+	else if (!strcmp(r->event, "wakeup")) {
+		threadslot(r->arg1);
+		emit("{\"ph\":\"i\",\"s\":\"t\",\"name\":\"wakeup\","
+		     "\"pid\":%d,\"tid\":%u,\"ts\":%.3f,"
+		     "\"args\":{\"by\":\"0x%08x\",\"cpu\":%u}}",
+		     PID_THREADS, (unsigned)r->arg1, r->ts,
+		     (unsigned)r->thread, (unsigned)r->arg2);
+	}
+	else if (!strcmp(r->event, "contend")) {
+		emit("{\"ph\":\"i\",\"s\":\"t\",\"name\":\"contend %s\","
+		     "\"pid\":%d,\"tid\":%u,\"ts\":%.3f,"
+		     "\"args\":{\"lock\":\"0x%08x\"}}",
+		     r->arg2 < 4 ? lockkinds[r->arg2] : "?",
+		     PID_THREADS, (unsigned)r->thread, r->ts,
+		     (unsigned)r->arg1);
+	}
+	else if (!strcmp(r->event, "diskstart")) {
+		/* begin and end must have the same name to match up */
+		emit("{\"ph\":\"b\",\"cat\":\"disk\",\"name\":\"I/O\","
+		     "\"id\":\"0x%08x\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,"
+		     "\"args\":{\"op\":\"%s\",\"sector\":%u}}",
+		     (unsigned)r->arg1, PID_DISKS, (unsigned)r->arg1, r->ts,
+		     (r->arg2 & DISKWRITE) ? "write" : "read",
+		     (unsigned)(r->arg2 & ~DISKWRITE));
+	}
+	else if (!strcmp(r->event, "diskdone")) {
+		emit("{\"ph\":\"e\",\"cat\":\"disk\",\"name\":\"I/O\","
+		     "\"id\":\"0x%08x\","
+		     "\"pid\":%d,\"tid\":%u,\"ts\":%.3f,"
+		     "\"args\":{\"error\":%u}}",
+		     (unsigned)r->arg1, PID_DISKS, (unsigned)r->arg1, r->ts,
+		     (unsigned)r->arg2);
+	}
+}
+
+/*
+ * Close off whatever was still going at the end of the trace.
+ */
+static
+void
+finish(void)
+{
+	unsigned c, i;
+
+	for (c=0; c<MAXCPUS; c++) {
+		if (seencpu[c]) {
+			endrun(c, lastts, "run");
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		if (insyscall[i]) {
+			emit("{\"ph\":\"E\",\"pid\":%d,\"tid\":%u,"
+			     "\"ts\":%.3f}",
+			     PID_THREADS, (unsigned)threads[i], lastts);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	FILE *in, *tmp;
+	char line[MAXLINE];
+	struct rec r;
+	unsigned long long nsecs, first = 0;
+	unsigned long thread, arg1, arg2;
+	long dumpstart = -1;
+	int inside, nrecs;
+
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [dumpfile]\n", argv[0]);
+		exit(1);
+	}
+	if (argc == 2) {
+		in = fopen(argv[1], "r");
+		if (in == NULL) {
+			err(1, "%s", argv[1]);
+		}
+	}
+	else {
+		in = stdin;
+	}
+
+	/*
+	 * Find the last dump. Standard input may not be seekable, so
+	 * keep the lines of the current dump in a temporary file.
+	 */
+	tmp = tmpfile();
+	if (tmp == NULL) {
+		err(1, "tmpfile");
+	}
+	inside = 0;
+	while (fgets(line, sizeof(line), in) != NULL) {
+		if (!strncmp(line, "ktrace-begin", 12)) {
+			rewind(tmp);
+			dumpstart = 0;
+			inside = 1;
+			continue;
+		}
+		if (!strncmp(line, "ktrace-end", 10)) {
+			inside = 0;
+			fflush(tmp);
+			dumpstart = ftell(tmp);
+			continue;
+		}
+		if (inside) {
+			fputs(line, tmp);
+		}
+	}
+	if (in != stdin) {
+		fclose(in);
+	}
+	if (dumpstart < 0) {
+		errx(1, "no ktrace-begin line found");
+	}
+	if (inside) {
+		/* Cut off before ktrace-end; use what there is */
+		fflush(tmp);
+		dumpstart = ftell(tmp);
+	}
+	rewind(tmp);
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	emit("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+	     "\"args\":{\"name\":\"cpus\"}}", PID_CPUS);
+	emit("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+	     "\"args\":{\"name\":\"threads\"}}", PID_THREADS);
+	emit("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+	     "\"args\":{\"name\":\"disks\"}}", PID_DISKS);
+
+	nrecs = 0;
+	while (ftell(tmp) < dumpstart &&
+	       fgets(line, sizeof(line), tmp) != NULL) {
+		if (sscanf(line, "%llu %u %lx %15s %lx %lx", &nsecs, &r.cpu,
+			   &thread, r.event, &arg1, &arg2) != 6) {
+			continue;
+		}
+		if (nrecs == 0) {
+			first = nsecs;
+		}
+		r.ts = (nsecs - first) / 1000.0;
+		r.thread = thread;
+		r.arg1 = arg1;
+		r.arg2 = arg2;
+		handle(&r);
+		nrecs++;
+	}
+	fclose(tmp);
+	finish();
+	printf("\n]}\n");
+
+	fprintf(stderr, "host-ktrace: %d records\n", nrecs);
+	return 0;
+}
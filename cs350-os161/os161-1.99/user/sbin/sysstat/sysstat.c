@@ -0,0 +1,61 @@
+/*
+ * sysstat - print system call statistics.
+ * Usage: sysstat [N]
+ *
+ * Prints the N (default 10) system calls the system has spent the
+ * most time in since boot, or since the last "sysstat reset" at the
+ * kernel menu, with how often each was called. The numbers cover all
+ * processes on all cpus, except this program's own sysstat call,
+ * which isn't counted until it returns.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <kern/syscall.h>
+
+static struct syscallstat stats[SYS_NCALLS];
+
+int
+main(int argc, char *argv[])
+{
+	int i, n, num;
+	uint64_t total;
+
+	n = 10;
+	if (argc == 2) {
+		n = atoi(argv[1]);
+	}
+	else if (argc != 1) {
+		errx(1, "Usage: sysstat [N]");
+	}
+
+	num = sysstat(stats, SYS_NCALLS);
+	if (num < 0) {
+		err(1, "sysstat");
+	}
+
+	total = 0;
+	for (i=0; i<num; i++) {
+		total += stats[i].ss_nsecs;
+	}
+	if (n > num) {
+		n = num;
+	}
+
+	printf("%-12s %10s %12s %10s %6s\n", "call", "count",
+	       "total usecs", "avg usecs", "%time");
+	for (i=0; i<n; i++) {
+		printf("%-12s %10u %12llu %10llu %6u\n", stats[i].ss_name,
+		       stats[i].ss_count, stats[i].ss_nsecs / 1000,
+		       stats[i].ss_nsecs / stats[i].ss_count / 1000,
+		       (unsigned)(total ? stats[i].ss_nsecs * 100 / total : 0));
+	}
+	if (n < num) {
+		printf("(%d more)\n", num - n);
+	}
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * pinmat.c
+ *
+ * 	Runs three copies of matmult, as triplemat does, twice: once
+ * 	letting the scheduler place them, and once with each copy
+ * 	pinned to its own cpu with setaffinity. Reports both times and
+ * 	the speedup from pinning.
+ *
+ * 	Needs more than one cpu to show anything; set the cpu count in
+ * 	sys161.conf.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+
+#define PROG	"/testbin/matmult"
+#define NCOPIES	3
+
+static
+unsigned
+countcpus(void)
+{
+	unsigned mask, n;
+
+	if (getaffinity(&mask) < 0) {
+		err(1, "getaffinity");
+	}
+	for (n = 0; mask != 0; mask >>= 1) {
+		n += mask & 1;
+	}
+	return n;
+}
+
+/*
+ * Return the current time in milliseconds.
+ */
+static
+unsigned long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return secs * 1000 + nsecs / 1000000;
+}
+
+/*
+ * Run NCOPIES copies of matmult. If PIN, copy I is restricted to cpu
+ * I (mod NCPUS) before it execs; the affinity survives the exec.
+ * Returns the elapsed time in milliseconds.
+ */
+static
+unsigned long
+runcopies(int pin, unsigned ncpus)
+{
+	pid_t pids[NCOPIES];
+	char *args[2];
+	unsigned long start;
+	int i, status, failures = 0;
+
+	args[0] = (char *)PROG;
+	args[1] = NULL;
+
+	start = now();
+	for (i=0; i<NCOPIES; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			/* child */
+			if (pin && setaffinity(1U << (i % ncpus)) < 0) {
+				err(1, "setaffinity");
+			}
+			execv(args[0], args);
+			err(1, "%s: execv", args[0]);
+		}
+	}
+
+	for (i=0; i<NCOPIES; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid for copy #%d (pid %d)", i, pids[i]);
+			failures++;
+		}
+		else if (WIFSIGNALED(status) || WEXITSTATUS(status) != 0) {
+			warnx("copy #%d (pid %d) failed", i, pids[i]);
+			failures++;
+		}
+	}
+	if (failures > 0) {
+		errx(1, "%d failures", failures);
+	}
+
+	return now() - start;
+}
+
+int
+main(void)
+{
+	unsigned ncpus;
+	unsigned long unpinned, pinned;
+
+	ncpus = countcpus();
+	printf("pinmat: %d copies of %s on %u cpus\n", NCOPIES, PROG, ncpus);
+	if (ncpus < 2) {
+		warnx("only one cpu; pinning won't make a difference");
+	}
+
+	unpinned = runcopies(0, ncpus);
+	printf("unpinned: %lu ms\n", unpinned);
+
+	pinned = runcopies(1, ncpus);
+	printf("pinned:   %lu ms\n", pinned);
+
+	if (pinned > 0) {
+		printf("speedup:  %lu.%02lux\n", unpinned / pinned,
+		       (unpinned % pinned) * 100 / pinned);
+	}
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * pmatmult - parallel matrix multiply, with threads in one process.
+ *
+ * Usage: pmatmult [nthreads]
+ *
+ * Multiplies two Dim x Dim matrices REPS times, with the rows of the
+ * result split among NTHREADS threads, and checks the answer (the
+ * same one matmult gets). Each thread adds its share of the trace
+ * to a total under a mutex, and its exit code is the number of rows
+ * it did, which the main thread checks as it joins them.
+ *
+ * With no argument, runs with 1 through MAXTHREADS threads and
+ * reports the speedup over one thread. With as many cpus as threads
+ * (see sys161.conf) the speedup should come close to the number of
+ * threads; past the number of cpus it should level off.
+ *
+ * Example of correct output on 4 cpus (speedups a little under N):
+ *     pmatmult: 1 threads: T ms, speedup 1.00
+ *     pmatmult: 2 threads: T ms, speedup 1.90
+ *     pmatmult: 3 threads: T ms, speedup 2.85
+ *     pmatmult: 4 threads: T ms, speedup 3.80
+ *     pmatmult: passed
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include <synch.h>
+
+#define Dim		72
+#define RIGHT		8772192		/* correct answer, as in matmult */
+#define REPS		10
+#define MAXTHREADS	4
+#define STACKSIZE	8192
+
+static int A[Dim][Dim];
+static int B[Dim][Dim];
+static int C[Dim][Dim];
+
+/* Thread stacks; doubles, to keep them 8-aligned */
+static double stacks[MAXTHREADS][STACKSIZE / sizeof(double)];
+
+struct rows {
+	int lo, hi;
+};
+static struct rows rows[MAXTHREADS];
+
+static struct mutex tracelock = MUTEX_INITIALIZER;
+static int trace;
+
+static
+int
+worker(void *data)
+{
+	struct rows *r = data;
+	int i, j, k, n, sum, mytrace;
+
+	for (n = 0; n < REPS; n++) {
+		for (i = r->lo; i < r->hi; i++) {
+			for (j = 0; j < Dim; j++) {
+				sum = 0;
+				for (k = 0; k < Dim; k++) {
+					sum += A[i][k] * B[k][j];
+				}
+				C[i][j] = sum;
+			}
+		}
+	}
+
+	mytrace = 0;
+	for (i = r->lo; i < r->hi; i++) {
+		mytrace += C[i][i];
+	}
+	mutex_lock(&tracelock);
+	trace += mytrace;
+	mutex_unlock(&tracelock);
+
+	return r->hi - r->lo;
+}
+
+static
+unsigned long
+msecs(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return secs * 1000 + nsecs / 1000000;
+}
+
+/*
+ * Do the multiply with NTHREADS threads; return how long it took, in
+ * milliseconds.
+ */
+static
+unsigned long
+run(int nthreads)
+{
+	int tids[MAXTHREADS];
+	unsigned long start;
+	int i, code;
+
+	for (i = 0; i < Dim; i++) {
+		bzero(C[i], sizeof(C[i]));
+	}
+	trace = 0;
+
+	start = msecs();
+	for (i = 0; i < nthreads; i++) {
+		rows[i].lo = Dim * i / nthreads;
+		rows[i].hi = Dim * (i + 1) / nthreads;
+		tids[i] = thread_create(worker, &rows[i], stacks[i],
+					sizeof(stacks[i]));
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		if (thread_join(tids[i], &code) < 0) {
+			err(1, "thread_join");
+		}
+		if (code != rows[i].hi - rows[i].lo) {
+			errx(1, "thread %d did %d rows, not %d", i, code,
+			     rows[i].hi - rows[i].lo);
+		}
+	}
+	return msecs() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long one, t;
+	int i, j, n, lo, hi, failed;
+
+	lo = 1;
+	hi = MAXTHREADS;
+	if (argc > 1) {
+		lo = hi = atoi(argv[1]);
+		if (lo < 1 || lo > MAXTHREADS) {
+			errx(1, "Usage: pmatmult [nthreads], 1-%d threads",
+			     MAXTHREADS);
+		}
+	}
+
+	for (i = 0; i < Dim; i++) {
+		for (j = 0; j < Dim; j++) {
+			A[i][j] = i;
+			B[i][j] = j;
+		}
+	}
+
+	one = 0;
+	failed = 0;
+	for (n = lo; n <= hi; n++) {
+		t = run(n);
+		if (n == 1) {
+			one = t;
+		}
+		if (one > 0 && t > 0) {
+			printf("pmatmult: %d threads: %lu ms, speedup %lu.%02lu\n",
+			       n, t, one / t, (one * 100 / t) % 100);
+		}
+		else {
+			printf("pmatmult: %d threads: %lu ms\n", n, t);
+		}
+		if (trace != RIGHT) {
+			printf("pmatmult: answer is %d (should be %d)\n",
+			       trace, RIGHT);
+			failed = 1;
+		}
+	}
+
+	printf(failed ? "pmatmult: FAILED\n" : "pmatmult: passed\n");
+	return failed;
+}
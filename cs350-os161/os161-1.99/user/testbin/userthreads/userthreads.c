@@ -32,17 +32,11 @@
  * forks 3 threads off 2 to functions, each of which displays a string
  * every once in a while.
  *
- * This won't do much of anything unless you implement user-level
- * threads.
- *
- * It also makes various assumptions about the thread API. In
- * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
+ * Threads are made with thread_create, each on a stack of its own.
+ * The parent leaves with thread_exit rather than by returning from
+ * main, which would exit the whole process; the process exits when
+ * the last thread does. Child threads exit when they return from the
+ * function they started in.
  *
  * This is also a rather basic test and you'll probably want to write
  * some more of your own.
@@ -51,9 +45,14 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <err.h>
 
 #define NTHREADS  3
 #define MAX       1<<25
+#define STACKSIZE 8192
+
+/* stacks for the threads; doubles, to keep them 8-aligned */
+static double stacks[NTHREADS][STACKSIZE / sizeof(double)];
 
 /* counter for the loop in the threads : 
    This variable is shared and incremented by each 
@@ -61,26 +60,28 @@
 volatile int count = 0;
 
 /* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
+int ThreadRunner(void *);
+int BladeRunner(void *);
 
 int
 main(int argc, char *argv[])
 {
-    int i;
+    int i, tid;
 
     (void)argc;
     (void)argv;
 
     for (i=0; i<NTHREADS; i++) {
 	if (i)
-	    threadfork(ThreadRunner);
+	    tid = thread_create(ThreadRunner, NULL, stacks[i], STACKSIZE);
         else
-	    threadfork(BladeRunner);
+	    tid = thread_create(BladeRunner, NULL, stacks[i], STACKSIZE);
+	if (tid < 0)
+	    err(1, "thread_create");
     }
 
     printf("Parent has left.\n");
-    return 0;
+    thread_exit(0);
 }
 
 /* multiple threads will simply print out the global variable.
@@ -88,23 +89,27 @@ main(int argc, char *argv[])
    random results.
 */
 
-void
-BladeRunner()
+int
+BladeRunner(void *unused)
 {
+    (void)unused;
     while (count < MAX) {
 	if (count % 500 == 0)
 	    printf("Blade ");
 	count++;
     }
+    return 0;
 }
 
-void
-ThreadRunner()
+int
+ThreadRunner(void *unused)
 {
+    (void)unused;
     while (count < MAX) {
 	if (count % 513 == 0)
 	    printf(" Runner\n");
 	count++;
     }
+    return 0;
 }
     
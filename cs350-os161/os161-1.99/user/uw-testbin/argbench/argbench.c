@@ -0,0 +1,183 @@
+/*
+ * argbench - time execv with many arguments.
+ *
+ *  Usage: argbench [iterations]
+ *
+ *  the parent repeatedly forks a child that execs this program again
+ *  with 1000 arguments ("-c" and then "arg1" through "arg999"); the
+ *  exec'd copy checks that every argument arrived intact and exits.
+ *  the parent reports the time per fork/exec/exit/wait round. Then it
+ *  does one exec whose arguments take up nearly all of ARG_MAX, and
+ *  one that is over it, which should fail with E2BIG.
+ *
+ *  Example of correct output:
+ *     argbench: 20 execs of 1000 arguments in N.NNN seconds
+ *     argbench: big arguments ok
+ *     argbench: passed
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+#define PROG "/uw-testbin/argbench"
+#define NARGS 1000
+#define DEFAULT_ITERS 20
+
+/* for the big exec: each argument is BIGLEN characters plus a NUL */
+#define BIGLEN 1000
+#define NBIG ((ARG_MAX - 4096) / (BIGLEN + 1 + sizeof(char *)))
+#define NOVER (ARG_MAX / (BIGLEN + 1) + 1)
+
+static char *args[NARGS + 1];
+static char names[NARGS][8];
+static char bigbuf[NOVER][BIGLEN + 1];
+static char *bigargs[NOVER + 3];
+
+/*
+ * Run as the exec'd child: check the arguments.
+ */
+static
+int
+check(int argc, char *argv[])
+{
+  char expect[8];
+  int i;
+
+  if (argv[argc] != NULL) {
+    errx(1, "argv not NULL-terminated");
+  }
+  if (!strcmp(argv[1], "-b")) {
+    /* the big exec: every argument is BIGLEN 'a's */
+    for (i = 2; i < argc; i++) {
+      if (strlen(argv[i]) != BIGLEN || argv[i][0] != 'a' ||
+          argv[i][BIGLEN-1] != 'a') {
+        errx(1, "big argument %d is wrong", i);
+      }
+    }
+    return 0;
+  }
+  if (argc != NARGS) {
+    errx(1, "argc is %d, not %d", argc, NARGS);
+  }
+  for (i = 2; i < argc; i++) {
+    snprintf(expect, sizeof(expect), "arg%d", i - 1);
+    if (strcmp(argv[i], expect) != 0) {
+      errx(1, "argv[%d] is \"%s\", not \"%s\"", i, argv[i], expect);
+    }
+  }
+  return 0;
+}
+
+/*
+ * Fork and exec ourselves with ARGV; return the child's exit status,
+ * or -1 if the exec itself failed (with the error in errno).
+ */
+static
+int
+run(char **argv)
+{
+  pid_t pid;
+  int status;
+
+  pid = fork();
+  if (pid < 0) {
+    err(1, "fork");
+  }
+  if (pid == 0) {
+    execv(PROG, argv);
+    /* tell the parent what went wrong */
+    _exit(errno == E2BIG ? 100 : 101);
+  }
+  if (waitpid(pid, &status, 0) < 0) {
+    err(1, "waitpid");
+  }
+  if (!WIFEXITED(status)) {
+    errx(1, "child did not exit normally");
+  }
+  switch (WEXITSTATUS(status)) {
+  case 100:
+    errno = E2BIG;
+    return -1;
+  case 101:
+    err(1, "execv %s", PROG);
+  }
+  return WEXITSTATUS(status);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int iters, i, failures;
+  time_t startsecs, endsecs;
+  unsigned long startnsecs, endnsecs, ms;
+
+  if (argc > 1 && (!strcmp(argv[1], "-c") || !strcmp(argv[1], "-b"))) {
+    return check(argc, argv);
+  }
+
+  iters = DEFAULT_ITERS;
+  if (argc > 1) {
+    iters = atoi(argv[1]);
+  }
+  if (iters <= 0) {
+    errx(1, "Usage: argbench [iterations]");
+  }
+
+  args[0] = (char *)"argbench";
+  args[1] = (char *)"-c";
+  for (i = 2; i < NARGS; i++) {
+    snprintf(names[i], sizeof(names[i]), "arg%d", i - 1);
+    args[i] = names[i];
+  }
+  args[NARGS] = NULL;
+
+  failures = 0;
+  __time(&startsecs, &startnsecs);
+  for (i = 0; i < iters; i++) {
+    if (run(args) != 0) {
+      warnx("exec %d: the child saw the wrong arguments", i);
+      failures++;
+    }
+  }
+  __time(&endsecs, &endnsecs);
+  ms = (endsecs - startsecs) * 1000;
+  ms = ms + endnsecs / 1000000 - startnsecs / 1000000;
+  printf("argbench: %d execs of %d arguments in %lu.%03lu seconds\n",
+         iters, NARGS, ms / 1000, ms % 1000);
+
+  /* nearly ARG_MAX of arguments */
+  bigargs[0] = (char *)"argbench";
+  bigargs[1] = (char *)"-b";
+  for (i = 0; i < (int)NOVER; i++) {
+    memset(bigbuf[i], 'a', BIGLEN);
+    bigbuf[i][BIGLEN] = 0;
+    bigargs[i + 2] = bigbuf[i];
+  }
+  bigargs[NBIG + 2] = NULL;
+  if (run(bigargs) != 0) {
+    warn("big arguments");
+    failures++;
+  }
+  else {
+    printf("argbench: big arguments ok\n");
+  }
+
+  /* and over it */
+  bigargs[NBIG + 2] = bigbuf[NBIG];
+  bigargs[NOVER + 2] = NULL;
+  errno = 0;
+  if (run(bigargs) != -1 || errno != E2BIG) {
+    warnx("too many arguments did not fail with E2BIG");
+    failures++;
+  }
+
+  if (failures > 0) {
+    errx(1, "%d failures", failures);
+  }
+  printf("argbench: passed\n");
+  return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * batch-io - compare plain write() calls against the same writes
+ *  submitted through a sysbatch() ring, in the style of conc-io.
+ *
+ *  Usage: batch-io [len]
+ *
+ *  forks PROCS children, which run at the same time. Each does
+ *  NUM_WRITES writes of LEN bytes (0 by default) to standard output,
+ *  first one write() per call and then RING_SIZE requests per
+ *  sysbatch() call, and reports how long each way took. With LEN 0
+ *  nothing is printed and the times are all system call overhead;
+ *  a larger LEN adds the console's own cost to both. Each batched
+ *  write's result is checked.
+ *
+ *  Example of correct output:
+ *     batch-io: proc 0: plain N usecs, batched M usecs
+ *     (and so on for each proc)
+ *     PASSED
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include <kern/syscall.h>
+
+#define PROCS         (4)
+#define NUM_WRITES    (2000)
+#define RING_SIZE     (32)
+#define MAX_LEN       (64)
+
+/* the ring; unsigned so it's aligned for struct sysring */
+static unsigned ringbuf[SYSRING_BYTES(RING_SIZE) / sizeof(unsigned)];
+static char buffer[MAX_LEN];
+
+static
+unsigned long
+usecs_since(time_t secs, unsigned long nsecs)
+{
+  time_t nowsecs;
+  unsigned long nownsecs;
+
+  __time(&nowsecs, &nownsecs);
+  return (nowsecs - secs) * 1000000 + nownsecs / 1000 - nsecs / 1000;
+}
+
+static
+unsigned long
+plain_writes(int len)
+{
+  time_t secs;
+  unsigned long nsecs;
+  int i;
+
+  __time(&secs, &nsecs);
+  for (i = 0; i < NUM_WRITES; i++) {
+    if (write(STDOUT_FILENO, buffer, len) != len) {
+      err(1, "write");
+    }
+  }
+  return usecs_since(secs, nsecs);
+}
+
+static
+unsigned long
+batched_writes(int len)
+{
+  struct sysring *ring = (struct sysring *)ringbuf;
+  struct sysring_entry *se;
+  time_t secs;
+  unsigned long nsecs;
+  int i, n, first, rval;
+
+  ring->sr_head = ring->sr_tail = 0;
+  ring->sr_size = RING_SIZE;
+
+  __time(&secs, &nsecs);
+  for (i = 0; i < NUM_WRITES; i += n) {
+    n = NUM_WRITES - i;
+    if (n > RING_SIZE) {
+      n = RING_SIZE;
+    }
+
+    /* fill the ring, then run the lot with one trap */
+    first = ring->sr_head;
+    while (ring->sr_head - first < (unsigned)n) {
+      se = &ring->sr_ents[ring->sr_head & (RING_SIZE - 1)];
+      se->se_callno = SYS_write;
+      se->se_args[0] = STDOUT_FILENO;
+      se->se_args[1] = (unsigned)buffer;
+      se->se_args[2] = len;
+      ring->sr_head++;
+    }
+    rval = sysbatch(ring);
+    if (rval < 0) {
+      err(1, "sysbatch");
+    }
+    if (rval != n || ring->sr_tail != ring->sr_head) {
+      errx(1, "sysbatch returned %d, expected %d", rval, n);
+    }
+
+    /* check the completions */
+    while (first != (int)ring->sr_tail) {
+      se = &ring->sr_ents[first & (RING_SIZE - 1)];
+      if (se->se_errno != 0 || se->se_retval != len) {
+        errx(1, "batched write: returned %d, error %d",
+             se->se_retval, se->se_errno);
+      }
+      first++;
+    }
+  }
+  return usecs_since(secs, nsecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+  pid_t pid[PROCS];
+  unsigned long plain, batched;
+  int len, i, status, failed;
+
+  len = 0;
+  if (argc > 1) {
+    len = atoi(argv[1]);
+  }
+  if (len < 0 || len > MAX_LEN) {
+    errx(1, "Usage: batch-io [len], len at most %d", MAX_LEN);
+  }
+  memset(buffer, '.', sizeof(buffer));
+
+  for (i = 0; i < PROCS; i++) {
+    pid[i] = fork();
+    if (pid[i] < 0) {
+      err(1, "fork %d", i);
+    }
+    if (pid[i] == 0) {
+      plain = plain_writes(len);
+      batched = batched_writes(len);
+      printf("batch-io: proc %d: plain %lu usecs, batched %lu usecs\n",
+             i, plain, batched);
+      _exit(0);
+    }
+  }
+
+  failed = 0;
+  for (i = 0; i < PROCS; i++) {
+    if (waitpid(pid[i], &status, 0) != pid[i]) {
+      warn("waitpid %d", i);
+      failed = 1;
+    }
+    else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      warnx("proc %d failed", i);
+      failed = 1;
+    }
+  }
+  printf(failed ? "### TEST FAILED\n" : "PASSED\n");
+  return failed;
+}
@@ -0,0 +1,128 @@
+/*
+ * futextest - check futex()'s error cases, and that the libc mutex
+ *  and condition variable make no system calls when uncontended.
+ *
+ *  Usage: futextest [count]
+ *
+ *  Checks that FUTEX_WAIT returns EAGAIN at once when the word
+ *  doesn't hold the value given, that FUTEX_WAKE with nobody waiting
+ *  wakes nobody, and that bad addresses and operations are refused.
+ *  Then locks and unlocks a mutex, and signals and broadcasts a
+ *  condition variable, COUNT times each (10000 by default), and uses
+ *  sysstat to see that none of it called futex.
+ *
+ *  Contended locking needs threads sharing memory; see the thread
+ *  tests for that.
+ *
+ *  Example of correct output:
+ *     futextest: passed
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+#include <synch.h>
+#include <kern/syscall.h>
+
+#define DEFAULT_COUNT 10000
+#define MAXSTATS 128
+
+static int failures;
+
+static
+void
+check(int result, int wanterr, const char *what)
+{
+  if (wanterr == 0 && result < 0) {
+    warn("%s", what);
+    failures++;
+  }
+  else if (wanterr != 0 && (result >= 0 || errno != wanterr)) {
+    warnx("%s: got %d (errno %d), expected errno %d",
+          what, result, result < 0 ? errno : 0, wanterr);
+    failures++;
+  }
+}
+
+/* How many futex calls the system has made */
+static
+unsigned
+futexcalls(void)
+{
+  static struct syscallstat stats[MAXSTATS];
+  int i, n;
+
+  n = sysstat(stats, MAXSTATS);
+  if (n < 0) {
+    err(1, "sysstat");
+  }
+  for (i = 0; i < n; i++) {
+    if (stats[i].ss_callno == SYS_futex) {
+      return stats[i].ss_count;
+    }
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int word;
+  static struct mutex m = MUTEX_INITIALIZER;
+  static struct cond c = COND_INITIALIZER;
+  unsigned before, after;
+  int count, i, result;
+
+  count = DEFAULT_COUNT;
+  if (argc > 1) {
+    count = atoi(argv[1]);
+  }
+  if (count <= 0) {
+    errx(1, "Usage: futextest [count]");
+  }
+
+  /* the system call itself */
+  word = 5;
+  check(futex(&word, FUTEX_WAIT, 6), EAGAIN, "wait on changed word");
+  result = futex(&word, FUTEX_WAKE, 10);
+  check(result, 0, "wake with no waiters");
+  if (result > 0) {
+    warnx("wake with no waiters woke %d", result);
+    failures++;
+  }
+  check(futex(&word, FUTEX_WAKE, 0), 0, "wake zero");
+  check(futex(&word, 42, 0), EINVAL, "bad operation");
+  check(futex((int *)((char *)&word + 1), FUTEX_WAKE, 1), EINVAL,
+        "unaligned address");
+  check(futex(NULL, FUTEX_WAIT, 0), EFAULT, "NULL address");
+  check(futex((int *)0x80000000, FUTEX_WAIT, 0), EFAULT,
+        "kernel address");
+
+  /* uncontended paths stay in user space */
+  before = futexcalls();
+  for (i = 0; i < count; i++) {
+    mutex_lock(&m);
+    cond_signal(&c);
+    cond_broadcast(&c);
+    mutex_unlock(&m);
+  }
+  if (!mutex_trylock(&m)) {
+    warnx("trylock of a free mutex failed");
+    failures++;
+  }
+  if (mutex_trylock(&m)) {
+    warnx("trylock of a held mutex succeeded");
+    failures++;
+  }
+  mutex_unlock(&m);
+  after = futexcalls();
+  if (after != before) {
+    warnx("%u futex calls for %d uncontended lock/signal rounds",
+          after - before, count);
+    failures++;
+  }
+
+  printf(failures ? "futextest: FAILED\n" : "futextest: passed\n");
+  return failures != 0;
+}
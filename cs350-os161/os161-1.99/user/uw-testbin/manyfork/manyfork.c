@@ -0,0 +1,81 @@
+/*
+ * manyfork - a long-running widefork: the parent forks and reaps a
+ *  child at a time, many times over.
+ *
+ *  Usage: manyfork [count]
+ *
+ *  makes COUNT children (100000 by default), each of which exits at
+ *  once with a code derived from its number. The parent waits for each
+ *  before making the next and checks the exit status. Since each child
+ *  is reaped before the next is made, the kernel has to recycle PIDs
+ *  once the count goes past PID_MAX; the parent reports how many
+ *  times the PIDs it saw wrapped around.
+ *
+ *  Example of correct output:
+ *     manyfork: 100000 children, PIDs wrapped 3 times
+ *     manyfork: N seconds
+ *     manyfork: passed
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define DEFAULT_COUNT 100000
+
+int
+main(int argc, char *argv[])
+{
+  int count, i, rval, failures, wraps;
+  pid_t pid, lastpid;
+  time_t start, end;
+
+  count = DEFAULT_COUNT;
+  if (argc > 1) {
+    count = atoi(argv[1]);
+  }
+  if (count <= 0) {
+    errx(1, "Usage: manyfork [count]");
+  }
+
+  failures = 0;
+  wraps = 0;
+  lastpid = 0;
+  __time(&start, NULL);
+  for (i = 0; i < count; i++) {
+    pid = fork();
+    if (pid < 0) {
+      err(1, "fork %d", i);
+    }
+    if (pid == 0) {
+      /* child */
+      _exit(i & 0xff);
+    }
+    if (pid < lastpid) {
+      wraps++;
+    }
+    lastpid = pid;
+
+    if (waitpid(pid, &rval, 0) < 0) {
+      warn("waitpid %d", i);
+      failures++;
+      continue;
+    }
+    if (!WIFEXITED(rval) || WEXITSTATUS(rval) != (i & 0xff)) {
+      warnx("child %d (pid %d): bad exit status 0x%x", i, pid, rval);
+      failures++;
+    }
+    if (i > 0 && i % 10000 == 0) {
+      printf("manyfork: %d children so far\n", i);
+    }
+  }
+  __time(&end, NULL);
+
+  printf("manyfork: %d children, PIDs wrapped %d times\n", count, wraps);
+  printf("manyfork: %ld seconds\n", (long)(end - start));
+  if (failures > 0) {
+    errx(1, "%d failures", failures);
+  }
+  printf("manyfork: passed\n");
+  return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * timepage - check the kernel's time page against __time, and
+ *  compare what each costs.
+ *
+ *  Usage: timepage [count]
+ *
+ *  reads the time COUNT times (100000 by default) each way and reports
+ *  the cost per call. Checks along the way that the time page never
+ *  goes backwards and is never more than MAXLAG behind __time, and
+ *  that a child writing to the page is killed rather than changing
+ *  it.
+ *
+ *  Example of correct output:
+ *     timepage: __time N ns/call, time page M ns/call
+ *     timepage: passed
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include <kern/timepage.h>
+
+#define DEFAULT_COUNT 100000
+#define MAXLAG 50000000ULL	/* ns; a few timer ticks */
+
+static
+unsigned long long
+nsecs(time_t secs, unsigned long ns)
+{
+  return (unsigned long long)secs * 1000000000ULL + ns;
+}
+
+int
+main(int argc, char *argv[])
+{
+  time_t secs, start, end;
+  unsigned long ns, startns, endns;
+  unsigned long long now, page, lastpage, syscallns, pagens;
+  int count, i, status, failures;
+  pid_t pid;
+
+  count = DEFAULT_COUNT;
+  if (argc > 1) {
+    count = atoi(argv[1]);
+  }
+  if (count <= 0) {
+    errx(1, "Usage: timepage [count]");
+  }
+  failures = 0;
+
+  /* agreement and monotonicity */
+  lastpage = 0;
+  for (i = 0; i < count; i++) {
+    __time_coarse(&secs, &ns);
+    page = nsecs(secs, ns);
+    __time(&secs, &ns);
+    now = nsecs(secs, ns);
+    if (page < lastpage) {
+      warnx("time page went backwards");
+      failures++;
+    }
+    if (page > now || now - page > MAXLAG) {
+      warnx("time page %llu ns, __time %llu ns", page, now);
+      failures++;
+    }
+    lastpage = page;
+    if (failures > 10) {
+      break;
+    }
+  }
+
+  /* cost of each */
+  __time(&start, &startns);
+  for (i = 0; i < count; i++) {
+    __time(&secs, &ns);
+  }
+  __time(&end, &endns);
+  syscallns = (nsecs(end, endns) - nsecs(start, startns)) / count;
+
+  __time(&start, &startns);
+  for (i = 0; i < count; i++) {
+    __time_coarse(&secs, &ns);
+  }
+  __time(&end, &endns);
+  pagens = (nsecs(end, endns) - nsecs(start, startns)) / count;
+
+  printf("timepage: __time %llu ns/call, time page %llu ns/call\n",
+         syscallns, pagens);
+
+  /* the page is read-only */
+  pid = fork();
+  if (pid < 0) {
+    err(1, "fork");
+  }
+  if (pid == 0) {
+    *(volatile unsigned *)TIMEPAGE_VADDR = 0;
+    _exit(0);
+  }
+  if (waitpid(pid, &status, 0) < 0) {
+    err(1, "waitpid");
+  }
+  if (!WIFSIGNALED(status)) {
+    warnx("child writing the time page wasn't killed");
+    failures++;
+  }
+
+  printf(failures ? "timepage: FAILED\n" : "timepage: passed\n");
+  return failures != 0;
+}
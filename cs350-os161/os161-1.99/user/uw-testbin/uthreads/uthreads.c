@@ -0,0 +1,199 @@
+/*
+ * uthreads - check threads in a user process: a contended mutex,
+ *  join and exit codes, and what happens to threads when the process
+ *  goes.
+ *
+ *  Usage: uthreads
+ *
+ *  Runs NTHREADS threads that each add to a shared counter COUNT
+ *  times under a mutex, and checks the total and the exit codes they
+ *  hand to thread_join. Then, in child processes, checks that _exit
+ *  in one thread takes down the others wherever they are (spinning
+ *  in user mode, asleep in cond_wait, asleep in thread_join), and
+ *  that when the last thread calls thread_exit the process exits
+ *  with its code.
+ *
+ *  Example of correct output:
+ *     uthreads: passed
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include <synch.h>
+
+#define NTHREADS 4
+#define COUNT 10000
+#define STACKSIZE 8192
+
+/* doubles, to keep them 8-aligned */
+static double stacks[NTHREADS][STACKSIZE / sizeof(double)];
+
+static struct mutex m = MUTEX_INITIALIZER;
+static struct cond c = COND_INITIALIZER;
+static volatile int counter;
+static volatile int spinner;
+
+static
+int
+start(int i, int (*func)(void *), void *arg)
+{
+  int tid;
+
+  tid = thread_create(func, arg, stacks[i], sizeof(stacks[i]));
+  if (tid < 0) {
+    err(1, "thread_create");
+  }
+  return tid;
+}
+
+static
+int
+adder(void *arg)
+{
+  int i;
+
+  for (i = 0; i < COUNT; i++) {
+    mutex_lock(&m);
+    counter++;
+    mutex_unlock(&m);
+  }
+  return (int)arg;
+}
+
+static
+int
+sleeper(void *arg)
+{
+  (void)arg;
+  mutex_lock(&m);
+  while (1) {
+    cond_wait(&c, &m);
+  }
+  return 0;
+}
+
+static
+int
+spin(void *arg)
+{
+  (void)arg;
+  while (1) {
+    spinner++;
+  }
+  return 0;
+}
+
+static
+int
+joiner(void *arg)
+{
+  thread_join((int)arg, NULL);
+  return 0;
+}
+
+static
+int
+slowexit(void *arg)
+{
+  volatile int i;
+
+  for (i = 0; i < 1000000; i++) {
+    /* nothing */
+  }
+  return (int)arg;
+}
+
+/* Run FUNC in a child process and return its exit status */
+static
+int
+inchild(void (*func)(void))
+{
+  pid_t pid;
+  int status;
+
+  pid = fork();
+  if (pid < 0) {
+    err(1, "fork");
+  }
+  if (pid == 0) {
+    func();
+    _exit(99);
+  }
+  if (waitpid(pid, &status, 0) < 0) {
+    err(1, "waitpid");
+  }
+  return status;
+}
+
+/* _exit with threads all over the place */
+static
+void
+teardown(void)
+{
+  int spintid;
+
+  start(0, sleeper, NULL);
+  spintid = start(1, spin, NULL);
+  start(2, joiner, (void *)spintid);
+  while (spinner < 100000) {
+    /* let them all get going */
+  }
+  _exit(7);
+}
+
+/* the last thread out decides the exit code */
+static
+void
+lastexit(void)
+{
+  start(0, slowexit, (void *)3);
+  thread_exit(5);
+}
+
+int
+main(void)
+{
+  int tids[NTHREADS];
+  int i, code, status, failures;
+
+  failures = 0;
+
+  for (i = 0; i < NTHREADS; i++) {
+    tids[i] = start(i, adder, (void *)(i + 100));
+  }
+  for (i = 0; i < NTHREADS; i++) {
+    if (thread_join(tids[i], &code) < 0) {
+      warn("thread_join %d", tids[i]);
+      failures++;
+    }
+    else if (code != i + 100) {
+      warnx("thread %d exited with %d, not %d", tids[i], code, i + 100);
+      failures++;
+    }
+  }
+  if (counter != NTHREADS * COUNT) {
+    warnx("counter is %d, not %d", counter, NTHREADS * COUNT);
+    failures++;
+  }
+  if (thread_join(tids[0], &code) == 0) {
+    warnx("joined thread %d twice", tids[0]);
+    failures++;
+  }
+
+  status = inchild(teardown);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 7) {
+    warnx("_exit with other threads: status 0x%x, expected exit 7",
+          status);
+    failures++;
+  }
+
+  status = inchild(lastexit);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 3) {
+    warnx("last thread_exit: status 0x%x, expected exit 3", status);
+    failures++;
+  }
+
+  printf(failures ? "uthreads: FAILED\n" : "uthreads: passed\n");
+  return failures != 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * waitany - exercise waitpid's WNOHANG option and WAIT_ANY (-1).
+ *
+ *  Usage: waitany [count]
+ *
+ *  the parent forks COUNT children (8 by default), each of which
+ *  spins for a while and exits with its own code. The parent polls
+ *  with WNOHANG until some child has exited, then collects all of
+ *  them with waitpid(-1, ...), checking that each PID comes back
+ *  exactly once with the right code. Finally, with no children left,
+ *  both kinds of wait should fail with ECHILD.
+ *
+ *  Example of correct output:
+ *     waitany: N polls before the first exit
+ *     waitany: passed
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define MAXCHILDREN 64
+#define DEFAULT_COUNT 8
+
+static pid_t pids[MAXCHILDREN];
+
+static
+void
+spin(int n)
+{
+  volatile int i;
+
+  for (i = 0; i < n; i++) {
+    /* nothing */
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int count, i, j, rval, failures, polls;
+  pid_t pid;
+
+  count = DEFAULT_COUNT;
+  if (argc > 1) {
+    count = atoi(argv[1]);
+  }
+  if (count <= 0 || count > MAXCHILDREN) {
+    errx(1, "Usage: waitany [count], count at most %d", MAXCHILDREN);
+  }
+
+  for (i = 0; i < count; i++) {
+    pid = fork();
+    if (pid < 0) {
+      err(1, "fork %d", i);
+    }
+    if (pid == 0) {
+      /* child: the later ones take longer */
+      spin(100000 * (i + 1));
+      _exit(i + 1);
+    }
+    pids[i] = pid;
+  }
+
+  failures = 0;
+  polls = 0;
+  while (1) {
+    pid = waitpid(pids[count-1], &rval, WNOHANG);
+    if (pid < 0) {
+      err(1, "waitpid WNOHANG");
+    }
+    if (pid != 0) {
+      /* The slowest one finished first; it still counts */
+      break;
+    }
+    polls++;
+    pid = waitpid(WAIT_ANY, &rval, WNOHANG);
+    if (pid < 0) {
+      err(1, "waitpid -1 WNOHANG");
+    }
+    if (pid != 0) {
+      break;
+    }
+  }
+  printf("waitany: %d polls before the first exit\n", polls);
+
+  /* PID is reaped, RVAL is its status; now collect the rest */
+  for (i = 0; i < count; i++) {
+    if (i > 0) {
+      pid = waitpid(WAIT_ANY, &rval, 0);
+      if (pid < 0) {
+        err(1, "waitpid -1");
+      }
+    }
+    for (j = 0; j < count && pids[j] != pid; j++) {
+      /* nothing */
+    }
+    if (j == count) {
+      warnx("waitpid returned unknown or repeated pid %d", pid);
+      failures++;
+      continue;
+    }
+    if (!WIFEXITED(rval) || WEXITSTATUS(rval) != j + 1) {
+      warnx("pid %d: bad exit status 0x%x", pid, rval);
+      failures++;
+    }
+    pids[j] = -1;
+  }
+
+  if (waitpid(WAIT_ANY, &rval, 0) >= 0 || errno != ECHILD) {
+    warnx("waitpid -1 with no children did not fail with ECHILD");
+    failures++;
+  }
+  if (waitpid(WAIT_ANY, &rval, WNOHANG) >= 0 || errno != ECHILD) {
+    warnx("waitpid -1 WNOHANG with no children did not fail with ECHILD");
+    failures++;
+  }
+
+  if (failures > 0) {
+    errx(1, "%d failures", failures);
+  }
+  printf("waitany: passed\n");
+  return 0;
+}